@@ -40,11 +40,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
 #include <linux/i2c-dev.h>
 
 #include "../lib/libbmp085.h"
+#include "../lib/libstream.h"
 
 
 #define USAGE "BOSCH Digital Pressure Sensor\n" \
@@ -54,7 +57,138 @@
 	          "-v   Get all values\n" \
 	          "-t   Get temperature\n" \
 	          "-p   Get pressure\n" \
-	          "-a   Get altitude\n"
+	          "-a   Get altitude\n" \
+	          "-s   Stream temperature, pressure and altitude to stdout\n" \
+	          "\n" \
+	          "Stream options:\n" \
+	          "-n <count>     Number of samples, default 0 until interrupted\n" \
+	          "-i <ms>        Sample interval, default 0 as fast as possible\n" \
+	          "-f <format>    csv, json or bin, default csv\n" \
+	          "-o <0..3>      Over sampling, default 0 (low)\n"
+
+
+#define STREAM_TEMPERATURE_AGE 1000000 ///< Temperature is measured again after this many us
+
+
+volatile sig_atomic_t stream_stop = 0;
+
+
+/**
+ * SIGINT/SIGTERM handler, ends the stream after the current sample
+ */
+static void stream_signal(int signal) {
+
+	(void)signal;
+	stream_stop = 1;
+}
+
+
+/**
+ * Sleep for a number of micro seconds, 0 returns at once
+ */
+static void stream_sleep(long us) {
+
+	struct timespec wait;
+
+	if(us <= 0)
+		return;
+
+	wait.tv_sec  = us / 1000000L;
+	wait.tv_nsec = (us % 1000000L) * 1000L;
+
+	nanosleep(&wait, NULL);
+}
+
+
+/**
+ * Streaming mode
+ * The device is opened and its calibration read once. The temperature
+ * is measured again only after STREAM_TEMPERATURE_AGE, as the datasheet
+ * allows, so the rate is set by the pressure conversion. Samples go to
+ * stdout through the buffer of libstream.h, the summary to stderr.
+ */
+static int bmp085_stream(int argc, char **argv) {
+
+	static const char * const names[] = { "temperature", "pressure", "altitude" };
+	static struct stream stream;
+
+	struct bmp085_device dev;
+	struct timespec now, next;
+	unsigned long count = 0, n;
+	long interval = 0;
+	long long begin, measured = 0;
+	int format = STREAM_CSV;
+	int oversampling = BMP085_OVERSAMPLING_LOW;
+	int i;
+	float values[3];
+
+	for(i=2; i<argc; i++) {
+
+		if(!strcmp(argv[i], "-n") && i+1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if(!strcmp(argv[i], "-i") && i+1 < argc)
+			interval = (long)(atof(argv[++i]) * 1000.0);
+		else if(!strcmp(argv[i], "-f") && i+1 < argc)
+			format = stream_format(argv[++i]);
+		else if(!strcmp(argv[i], "-o") && i+1 < argc)
+			oversampling = atoi(argv[++i]);
+		else
+			format = -1;
+
+		if(format < 0 || oversampling < BMP085_OVERSAMPLING_LOW || oversampling > BMP085_OVERSAMPLING_ULTRA) {
+
+			puts("Error: Invalid stream option!");
+			puts(USAGE);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, stream_signal);
+	signal(SIGTERM, stream_signal);
+
+	bmp085_open(&dev, bmp085_i2c_device, bmp085_i2c_address, oversampling);
+	stream_init(&stream, STDOUT_FILENO, format, names, 3);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for(n=0; !stream_stop && (count == 0 || n < count); n++) {
+
+		// Absolute deadlines, a late sample does not shift the ones after it
+		if(interval > 0) {
+
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+			next.tv_nsec += (interval % 1000000L) * 1000L;
+			next.tv_sec  += interval / 1000000L + next.tv_nsec / 1000000000L;
+			next.tv_nsec %= 1000000000L;
+		}
+
+		begin = stream_now();
+
+		if(n == 0 || begin - measured >= STREAM_TEMPERATURE_AGE) {
+
+			stream_sleep(bmp085_start_temperature(&dev));
+			values[0] = bmp085_calc_temperature(&dev.calibration, bmp085_fetch_temperature(&dev));
+			measured  = begin;
+		}
+
+		stream_sleep(bmp085_start_pressure(&dev));
+
+		values[1] = bmp085_calc_pressure(&dev.calibration, dev.oversampling, bmp085_fetch_pressure(&dev));
+		values[2] = bmp085_get_altitude(values[1]);
+
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		stream_write(&stream, now.tv_sec * 1000000LL + now.tv_nsec / 1000, stream_now() - begin, values);
+	}
+
+	stream_flush(&stream);
+	stream_summary(&stream, stderr);
+
+	bmp085_close(&dev);
+
+	return 0;
+}
 
 
 int main(int argc, char **argv) {
@@ -69,6 +203,9 @@ int main(int argc, char **argv) {
 
 	struct bmp085_value bmp085;
 
+	if(argc > 1 && !strcmp(argv[1], "-s"))
+		return bmp085_stream(argc, argv);
+
 	if(argc > 1) {
 
 
@@ -0,0 +1,137 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut.welzels@googlemail.com)
+ *
+ *  main.c is a demo program for BOSCH BMP280 Digital Pressure Sensor
+ *  and BME280 Combined Humidity and Pressure Sensor.
+ *
+ *  From user space you will need the SMBus level access helper functions
+ *  written by Simon G. Vogl, Frodo Looijaard and Jean Delvare.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -lm
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/i2c-dev.h>
+
+#include "../lib/libbmp280.h"
+
+
+#define USAGE "BOSCH BMP280/BME280 Digital Pressure Sensor\n" \
+			  "Usage: i2c-lib [OPTION]\n" \
+	          "\n" \
+	          "Options:\n" \
+	          "-v   Get all values\n" \
+	          "-t   Get temperature\n" \
+	          "-p   Get pressure\n" \
+	          "-rh  Get humidity (BME280 only)\n" \
+	          "-a   Get altitude\n"
+
+
+int main(int argc, char **argv) {
+
+	char line[72];
+
+	memset(&line[0], 0x2d, sizeof(line)-1);
+	line[sizeof(line)-1] = '\0';
+
+	float altitude;
+	float temperature;
+	float pressure;
+	float humidity;
+
+	struct bmp280_value bmp280;
+
+	if(argc > 1) {
+
+
+		bmp280_setup(1, 0x76, BMP280_OVERSAMPLING_X1, BMP280_MODE_FORCED);
+
+
+		if(!strcmp(argv[1], "-v")) {
+
+			bmp280 = bmp280_get_values();
+			puts("\nBMP280 values 'bmp280_get_values()':");
+			puts(line);
+			printf("Temperature:\t %6.2f°C\n", bmp280.temperature);
+			printf("Pressure:\t %6.2fmbar\n",  bmp280.pressure);
+			if(bmp280_chip_id == BME280_CHIP_ID)
+				printf("Humidity:\t %6.2fRh\n", bmp280.humidity);
+			printf("Altitude:\t %.1fm\n",  bmp280.altitude);
+		}
+		else if(!strcmp(argv[1], "-p")) {
+
+			pressure = bmp280_get_pressure();
+			puts("\nBMP280 pressure 'bmp280_get_pressure()':");
+			puts(line);
+			printf("Pressure:\t %6.2fmbar\n", pressure);
+		}
+		else if(!strcmp(argv[1], "-t")) {
+
+			temperature = bmp280_get_temperature();
+			puts("\nBMP280 temperature 'bmp280_get_temperature()':");
+			puts(line);
+			printf("Temperature:\t %5.2f°C\n", temperature);
+		}
+		else if(!strcmp(argv[1], "-rh")) {
+
+			humidity = bmp280_get_humidity();
+			puts("\nBME280 humidity 'bmp280_get_humidity()':");
+			puts(line);
+			printf("Humidity:\t %5.2fRh\n", humidity);
+		}
+		else if(!strcmp(argv[1], "-a")) {
+
+			altitude = bmp280_get_altitude(bmp280_get_pressure());
+			puts("\nBMP280 altitude 'bmp280_get_altitude(float pressure)':");
+			puts(line);
+			printf("Altitude:\t %5.1fm\n", altitude);
+		}
+		else if((strcmp(argv[1], "--help") == 0) || (strcmp(argv[1], "-h") == 0)) {
+
+			puts(USAGE);
+		}
+		else {
+			puts("Error: No option selected!");
+			puts(USAGE);
+		}
+
+		bmp280_close();
+	}
+	else {
+		puts("Error: No option selected!");
+		puts(USAGE);
+	}
+
+	return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c compares range queries of libcolumn.h with the same rows kept as an
+ *  array of structs, checks the results against each other and measures the
+ *  time per query. No sensor is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/libcolumn.h"
+
+
+#define ROWS    4000000                 ///< Rows at 10Hz, about 4.6 days
+#define CHUNKS  (ROWS / COL_CHUNK + 1)
+#define QUERIES 200                     ///< Random ranges of 1/4 to 1/2 of the rows
+#define CHECKED 20                      ///< Queries compared with the baseline
+
+#define TEMPERATURE 0
+#define PRESSURE    1
+#define ALTITUDE    2
+
+#define USAGE "Usage: main\n" \
+	"\n" \
+	"Benchmark of libcolumn.h against an array of structs.\n"
+
+
+/**
+ * Baseline: one struct per row, as a sampling loop would keep them
+ */
+struct row {
+	long long time;
+	float temperature;
+	float pressure;
+	float altitude;
+};
+
+
+struct row rows[ROWS];
+struct col_chunk chunk[CHUNKS];
+struct col_store store;
+
+long long query_from[QUERIES], query_to[QUERIES];
+volatile double sink;
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * BMP085 rows every 100 ms: pressure as a bounded random walk,
+ * temperature as noise; the same rows go into the column store
+ */
+static void generate(void) {
+
+	float values[3], pressure = 1000.0f;
+	int i;
+
+	srand(2);
+
+	col_init(&store, chunk, CHUNKS, 3);
+
+	for(i=0; i<ROWS; i++) {
+
+		pressure += (rand() % 201 - 100) / 2000.0f;
+
+		if(pressure < 980.0f)
+			pressure = 980.0f;
+
+		if(pressure > 1040.0f)
+			pressure = 1040.0f;
+
+		rows[i].time        = i * 100000LL;
+		rows[i].temperature = 20.0f + (rand() % 100) / 10.0f;
+		rows[i].pressure    = pressure;
+		rows[i].altitude    = 0.0f;
+
+		values[TEMPERATURE] = rows[i].temperature;
+		values[PRESSURE]    = rows[i].pressure;
+		values[ALTITUDE]    = rows[i].altitude;
+
+		col_append(&store, rows[i].time, values);
+	}
+
+	for(i=0; i<QUERIES; i++) {
+
+		query_from[i] = (long long)(rand() % (ROWS / 2)) * 100000LL + rand() % 100000;
+		query_to[i]   = query_from[i] + (long long)(ROWS / 4 + rand() % (ROWS / 4)) * 100000LL;
+	}
+}
+
+
+/**
+ * Baseline aggregate of the pressure over a time range
+ */
+static unsigned long rows_aggregate(long long from, long long to, double *sum, float *min, float *max) {
+
+	unsigned long count = 0;
+	int i;
+
+	*sum = 0.0;
+	*min = INFINITY;
+	*max = -INFINITY;
+
+	for(i=0; i<ROWS; i++) {
+
+		if(rows[i].time < from || rows[i].time > to)
+			continue;
+
+		*sum += rows[i].pressure;
+
+		if(rows[i].pressure < *min)
+			*min = rows[i].pressure;
+
+		if(rows[i].pressure > *max)
+			*max = rows[i].pressure;
+
+		count++;
+	}
+
+	return count;
+}
+
+
+/**
+ * Baseline count of the rows in a time range with low <= value
+ */
+static unsigned long rows_count(long long from, long long to, int column, float low) {
+
+	unsigned long count = 0;
+	float value;
+	int i;
+
+	for(i=0; i<ROWS; i++) {
+
+		if(rows[i].time < from || rows[i].time > to)
+			continue;
+
+		value = column == PRESSURE ? rows[i].pressure : rows[i].temperature;
+		count += value >= low;
+	}
+
+	return count;
+}
+
+
+/**
+ * Compare aggregate and count of the store with the baseline, including
+ * the open end of the time range
+ * \return Number of mismatches
+ */
+static int check(void) {
+
+	struct col_result result;
+	unsigned long count;
+	long long from, to;
+	double sum;
+	float min, max;
+	int i, mismatches = 0;
+
+	for(i=0; i<=CHECKED; i++) {
+
+		from = query_from[i];
+
+		// Last check: open end of the time range
+		to = i < CHECKED ? query_to[i] : LLONG_MAX;
+
+		count = rows_aggregate(from, to, &sum, &min, &max);
+
+		col_aggregate(&store, PRESSURE, from, to, &result);
+
+		if(result.count != count || result.min != min || result.max != max || fabs(result.sum - sum) / sum > 1e-6
+		|| col_count_where(&store, PRESSURE, from, to, 1010.0f, INFINITY) != rows_count(from, to, PRESSURE, 1010.0f)) {
+
+			printf("Range %lld..%lld: count %lu/%lu, min %f/%f, max %f/%f, sum %.3f/%.3f\n",
+					from, to, result.count, count, result.min, min, result.max, max, result.sum, sum);
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+
+/**
+ * Time per query of the store and of the baseline
+ */
+static void benchmark(void) {
+
+	struct col_result result;
+	double start, rows_time, column_time, sum;
+	float min, max;
+	unsigned long count = 0;
+	int i, k;
+
+	printf("Time per query over %d rows, %d ranges of 1/4 to 1/2 of the rows:\n", ROWS, QUERIES);
+	printf("\t\t\t array of structs\t column store\n");
+
+	// Mean, min and max of a range
+	start = now();
+
+	for(i=0; i<QUERIES; i++) {
+
+		count += rows_aggregate(query_from[i], query_to[i], &sum, &min, &max);
+		sink  += sum + min + max;
+	}
+
+	rows_time = (now() - start) / QUERIES;
+
+	start = now();
+
+	for(i=0; i<QUERIES; i++) {
+
+		col_aggregate(&store, PRESSURE, query_from[i], query_to[i], &result);
+		sink += result.sum;
+	}
+
+	column_time = (now() - start) / QUERIES;
+
+	printf("mean/min/max pressure:\t %10.3fms\t\t %8.3fms (x%.0f), %lu rows on average\n",
+			rows_time * 1e3, column_time * 1e3, rows_time / column_time, count / QUERIES);
+
+	// Count with a value condition, the pressure random walk lets the
+	// zone map skip chunks, the temperature noise does not
+	for(k=0; k<2; k++) {
+
+		start = now();
+
+		for(i=0; i<QUERIES; i++)
+			sink += rows_count(query_from[i], query_to[i], k ? TEMPERATURE : PRESSURE, k ? 25.0f : 1010.0f);
+
+		rows_time = (now() - start) / QUERIES;
+
+		start = now();
+
+		for(i=0; i<QUERIES; i++)
+			sink += col_count_where(&store, k ? TEMPERATURE : PRESSURE, query_from[i], query_to[i], k ? 25.0f : 1010.0f, INFINITY);
+
+		column_time = (now() - start) / QUERIES;
+
+		printf("%s\t %10.3fms\t\t %8.3fms (x%.0f)\n", k ? "count temperature >= 25:" : "count pressure >= 1010:",
+				rows_time * 1e3, column_time * 1e3, rows_time / column_time);
+	}
+}
+
+
+int main(int argc, char **argv) {
+
+	(void)argv;
+
+	if(argc > 1) {
+
+		printf(USAGE);
+		return 1;
+	}
+
+	generate();
+
+	if(check() > 0) {
+
+		puts("Error: column store differs from the array of structs");
+		return 1;
+	}
+
+	benchmark();
+
+	return 0;
+}
@@ -0,0 +1,336 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c compares median, MAD and output of libfilter.h with sorting the
+ *  window by qsort() and measures the cost per sample. No sensor is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/libfilter.h"
+
+
+#define SAMPLES    300000      ///< Samples per benchmark run
+#define CHECKED    20000       ///< Samples compared with the brute force result
+#define MAX_WINDOW 16384       ///< Largest window of the benchmark
+#define THRESHOLD  3.0f        ///< Hampel threshold in standard deviations
+
+#define USAGE "Usage: main [-c]\n" \
+	"\n" \
+	"Benchmark of libfilter.h, cost per sample against sorting the window.\n" \
+	"  -c  only compare median, MAD and Hampel output with qsort\n"
+
+
+float sample[SAMPLES];
+int sample_int[SAMPLES];
+
+struct filter_node filter_node[MAX_WINDOW + 1];
+unsigned int filter_ring[MAX_WINDOW];
+
+float window_float[MAX_WINDOW];
+double deviation[MAX_WINDOW];
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * qsort() comparisons
+ */
+static int compare_float(const void *a, const void *b) {
+
+	float x = *(const float *)a, y = *(const float *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int compare_double(const void *a, const void *b) {
+
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Pressure readings in hPa with noise, repeated values and 0.5% spikes,
+ * raw UP readings with 0.3% dropouts to 0
+ */
+static void generate(void) {
+
+	int i;
+
+	srand(5);
+
+	for(i=0; i<SAMPLES; i++) {
+
+		sample[i] = 1000.0f + (rand() % 2001 - 1000) / 100.0f;
+
+		if(rand() % 200 == 0)
+			sample[i] += rand() % 2 ? 50.0f : -50.0f;
+
+		if(rand() % 7 == 0)
+			sample[i] = sample[i > 0 ? i - 1 : 0];
+
+		sample_int[i] = 23843 + rand() % 41 - 20;
+
+		if(rand() % 300 == 0)
+			sample_int[i] = 0;
+	}
+}
+
+
+/**
+ * Median of sorted values
+ */
+static double sorted_median(const double *sorted, int n) {
+
+	return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+
+/**
+ * Median and MAD by definition, sorts values
+ */
+static double brute_force(double *values, int n, double *mad) {
+
+	double median;
+	int i;
+
+	qsort(values, n, sizeof(double), compare_double);
+	median = sorted_median(values, n);
+
+	for(i=0; i<n; i++)
+		deviation[i] = fabs(values[i] - median);
+
+	qsort(deviation, n, sizeof(double), compare_double);
+	*mad = sorted_median(deviation, n);
+
+	return median;
+}
+
+
+/**
+ * Compare median, MAD and Hampel output of the float and the integer
+ * filter after every sample with qsort() of the window
+ * \return Number of mismatches
+ */
+static int check(void) {
+
+	static const int windows[] = { 1, 2, 3, 5, 16, 101, 1000 };
+	static double values[MAX_WINDOW];
+	struct filter filter, filter_i;
+	struct filter_node *node_i;
+	unsigned int *ring_i;
+	double median, mad;
+	float output, expect;
+	int output_i, expect_i, median_i, mad_i;
+	int w, window, i, j, n, mismatches = 0;
+
+	node_i = malloc((MAX_WINDOW + 1) * sizeof(*node_i));
+	ring_i = malloc(MAX_WINDOW * sizeof(*ring_i));
+
+	if(node_i == NULL || ring_i == NULL) {
+
+		perror("Error while allocate filter:");
+		exit(1);
+	}
+
+	for(w=0; w<(int)(sizeof(windows) / sizeof(windows[0])); w++) {
+
+		window = windows[w];
+
+		filter_init(&filter, filter_node, filter_ring, window, THRESHOLD);
+		filter_init_int(&filter_i, node_i, ring_i, window, THRESHOLD);
+
+		for(i=0; i<CHECKED; i++) {
+
+			output   = filter_update(&filter, sample[i]);
+			output_i = filter_update_int(&filter_i, sample_int[i]);
+
+			n = i + 1 < window ? i + 1 : window;
+
+			// Float filter: the median of an even window is the mean of
+			// the middle pair, rounded to float
+			for(j=0; j<n; j++)
+				values[j] = sample[i - j];
+
+			median = brute_force(values, n, &mad);
+			expect = n >= 3 && fabs(sample[i] - median) > THRESHOLD * FILTER_MAD_SCALE * mad
+					? (float)median : sample[i];
+
+			if(filter_median(&filter) != (float)median || fabs(filter_mad(&filter) - mad) > 1e-9 || output != expect) {
+
+				if(mismatches++ < 5)
+					printf("float window %d sample %d: median %f/%f, MAD %f/%f, output %f/%f\n",
+							window, i, filter_median(&filter), median, filter_mad(&filter), mad, output, expect);
+			}
+
+			// Integer filter: median and MAD rounded down
+			for(j=0; j<n; j++)
+				values[j] = sample_int[i - j];
+
+			median   = brute_force(values, n, &mad);
+			median_i = (int)floor(median);
+
+			for(j=0; j<n; j++)
+				deviation[j] = fabs(values[j] - median_i);
+
+			qsort(deviation, n, sizeof(double), compare_double);
+			mad_i = (int)floor(sorted_median(deviation, n));
+
+			expect_i = n >= 3 && fabs((double)sample_int[i] - median_i) > THRESHOLD * FILTER_MAD_SCALE * mad_i
+					? median_i : sample_int[i];
+
+			if(filter_median_int(&filter_i) != median_i || filter_mad(&filter_i) != mad_i || output_i != expect_i) {
+
+				if(mismatches++ < 5)
+					printf("int window %d sample %d: median %d/%d, MAD %.0f/%d, output %d/%d\n",
+							window, i, filter_median_int(&filter_i), median_i, filter_mad(&filter_i), mad_i,
+							output_i, expect_i);
+			}
+		}
+	}
+
+	free(node_i);
+	free(ring_i);
+
+	printf("Brute force check, %d samples per window: %d mismatches\n", CHECKED, mismatches);
+
+	return mismatches;
+}
+
+
+/**
+ * Cost per sample of the sliding median, the float and the integer
+ * Hampel filter and of sorting a copy of the window with qsort()
+ */
+static void benchmark(void) {
+
+	static const int windows[] = { 64, 1024, 4096, 16384 };
+	struct filter filter;
+	double start, median, hampel, hampel_int, sorted;
+	volatile float sink = 0.0f;
+	int w, window, i, sorts;
+
+	printf("\nTime per sample, %d samples:\n", SAMPLES);
+	printf("window\t median\t hampel\t int\t qsort\t rejected\n");
+
+	for(w=0; w<(int)(sizeof(windows) / sizeof(windows[0])); w++) {
+
+		window = windows[w];
+
+		filter_init(&filter, filter_node, filter_ring, window, 0.0f);
+
+		start = now();
+
+		for(i=0; i<SAMPLES; i++) {
+
+			filter_update(&filter, sample[i]);
+			sink += filter_median(&filter);
+		}
+
+		median = now() - start;
+
+		filter_init(&filter, filter_node, filter_ring, window, THRESHOLD);
+
+		start = now();
+
+		for(i=0; i<SAMPLES; i++)
+			sink += filter_update(&filter, sample[i]);
+
+		hampel = now() - start;
+
+		filter_init_int(&filter, filter_node, filter_ring, window, THRESHOLD);
+
+		start = now();
+
+		for(i=0; i<SAMPLES; i++)
+			sink += filter_update_int(&filter, sample_int[i]);
+
+		hampel_int = now() - start;
+
+		// The baseline is slow, fewer runs for large windows
+		sorts = window >= 4096 ? 300 : 3000;
+
+		start = now();
+
+		for(i=window; i<window+sorts; i++) {
+
+			memcpy(window_float, sample + i - window, window * sizeof(float));
+			qsort(window_float, window, sizeof(float), compare_float);
+			sink += window_float[window / 2];
+		}
+
+		sorted = now() - start;
+
+		printf("%6d\t %4.0fns\t %4.0fns\t %4.0fns\t %6.0fns\t %lu\n", window,
+				median * 1e9 / SAMPLES, hampel * 1e9 / SAMPLES, hampel_int * 1e9 / SAMPLES,
+				sorted * 1e9 / sorts, filter.rejected);
+	}
+}
+
+
+int main(int argc, char **argv) {
+
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-c") != 0)) {
+
+		printf(USAGE);
+		return 1;
+	}
+
+	generate();
+
+	if(check() > 0)
+		return 1;
+
+	if(argc == 1)
+		benchmark();
+
+	return 0;
+}
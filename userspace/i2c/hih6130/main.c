@@ -36,10 +36,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
 #include <linux/i2c-dev.h>
 #include "../lib/libhih6130.h"
+#include "../lib/libstream.h"
 
 #define USAGE "Honeywell Digital Humidity/Temperature Sensors:\n" \
               "Usage: i2c-lib [OPTION]\n" \
@@ -48,6 +54,295 @@
 	          "  -v   Get all values\n" \
 	          "  -t   Get Temperature\n" \
 	          "  -rh  Get Humidity values\n" \
+	          "  -s   Stream humidity and temperature to stdout\n" \
+	          "  -c   Check the batch decoding against the single frame functions\n" \
+	          "  -a   Test the wired alarm wait, an eventfd replaces the alarm line\n" \
+	          "\n" \
+	          "Stream options:\n" \
+	          "  -n <count>   Number of samples, default 0 until interrupted\n" \
+	          "  -i <ms>      Sample interval, default 0 as fast as possible\n" \
+	          "  -f <format>  csv, json or bin, default csv\n"
+
+
+volatile sig_atomic_t stream_stop = 0;
+
+
+/**
+ * SIGINT/SIGTERM handler, ends the stream after the current sample
+ */
+static void stream_signal(int signal) {
+
+	(void)signal;
+	stream_stop = 1;
+}
+
+
+/**
+ * Check hih6130_decode_frames() and hih6130_decode_frames_centi()
+ * against hih6130_calc_*() over all 65536 values of a 16 bit word,
+ * which covers every status, humidity and temperature bit pattern.
+ * The float results must be bit exact, see the note in libhih6130.h on
+ * -ffp-contract=off. An offset of one frame leaves a scalar tail and
+ * an unaligned start for the vector path. No device is needed.
+ */
+static int hih6130_check_decode(void) {
+
+	static __u8 frames[65536 * 4];
+	static unsigned char status[65536];
+	static float humidity[65536], temperature[65536];
+	static short humidity_centi[65536], temperature_centi[65536];
+
+	const __u8 *frame;
+	float value;
+	int i, offset, errors = 0;
+
+	for(i=0; i<65536; i++) {
+
+		frames[i*4 + 0] = i >> 8;
+		frames[i*4 + 1] = i & 0xff;
+		frames[i*4 + 2] = i >> 8;
+		frames[i*4 + 3] = i & 0xff;
+	}
+
+	for(offset=0; offset<2; offset++) {
+
+		hih6130_decode_frames(frames + offset*4, 65536 - offset, status, humidity, temperature);
+		hih6130_decode_frames_centi(frames + offset*4, 65536 - offset, status, humidity_centi, temperature_centi);
+
+		for(i=0; i<65536 - offset; i++) {
+
+			frame = frames + (i + offset)*4;
+
+			if(status[i] != frame[0]>>6)
+				errors++;
+
+			value = hih6130_calc_humidity(frame);
+			if(memcmp(&value, &humidity[i], sizeof(value)))
+				errors++;
+
+			value = hih6130_calc_temperature(frame);
+			if(memcmp(&value, &temperature[i], sizeof(value)))
+				errors++;
+
+			if(humidity_centi[i] != hih6130_calc_humidity_centi(frame)
+			|| temperature_centi[i] != hih6130_calc_temperature_centi(frame))
+				errors++;
+		}
+	}
+
+	printf("HIH6130 batch decoding: %d mismatches in 2 x 65536 frames\n", errors);
+
+	return errors != 0;
+}
+
+
+/**
+ * Alarm test state, the SIGALRM handler stands in for the alarm line
+ */
+int alarm_event_fd = -1;
+volatile sig_atomic_t alarm_edge = 0;
+
+
+/**
+ * SIGALRM handler: an edge on the eventfd, or only an interruption
+ */
+static void alarm_signal(int signal) {
+
+	unsigned long long one = 1;
+
+	(void)signal;
+
+	if(alarm_edge && write(alarm_event_fd, &one, sizeof(one)) < 0)
+		alarm_edge = 0;
+}
+
+
+/**
+ * Run hih6130_alarm_wait() for 350 ms with a SIGALRM after 150 ms
+ * \return Result of the wait, elapsed ms in *elapsed
+ */
+static int hih6130_alarm_run(struct hih6130_alarm *alarm, long *elapsed) {
+
+	struct itimerval timer;
+	struct timespec start, end;
+	int result;
+
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_usec = 150000;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	setitimer(ITIMER_REAL, &timer, NULL);
+
+	result = hih6130_alarm_wait(alarm, 350, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*elapsed = (end.tv_sec - start.tv_sec) * 1000L + (end.tv_nsec - start.tv_nsec) / 1000000L;
+
+	return result;
+}
+
+
+/**
+ * Test of the wired alarm path of hih6130_alarm_wait()
+ * An eventfd takes the place of the alarm output line. The thresholds
+ * are never crossed, every wait must last its full timeout and send a
+ * measurement request every 100 ms:
+ *   1. no edge
+ *   2. a signal without an edge, which must not end the wait
+ *   3. an edge written by the signal handler, which must wake the wait
+ *      up and read a sample
+ */
+static int hih6130_alarm_test(void) {
+
+	struct hih6130_device dev;
+	struct hih6130_alarm alarm;
+	struct sigaction action;
+	unsigned long requests, samples;
+	long elapsed;
+	int result, errors = 0;
+
+	if((alarm_event_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+
+		perror("Error while create eventfd:");
+		return 1;
+	}
+
+	// No SA_RESTART, poll() sees EINTR
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = alarm_signal;
+	sigaction(SIGALRM, &action, NULL);
+
+	hih6130_open(&dev, hih6130_i2c_device, hih6130_i2c_address, 0);
+	hih6130_alarm_init(&alarm, &dev, 101.0f, 101.0f, -1.0f, -1.0f, alarm_event_fd, -1);
+
+	alarm.interval = 100000;
+
+	for(alarm_edge=0; alarm_edge<=1; alarm_edge++) {
+
+		requests = alarm.requests;
+		samples  = alarm.samples;
+
+		result = hih6130_alarm_run(&alarm, &elapsed);
+
+		printf("%s: result %d after %ldms, %lu requests, %lu samples, %lu edges\n",
+				alarm_edge ? "Edge" : "Signal", result, elapsed,
+				alarm.requests - requests, alarm.samples - samples, alarm.events);
+
+		if(result != 0 || elapsed < 350 || alarm.requests - requests < 3)
+			errors++;
+
+		if(alarm.events != (unsigned long)alarm_edge || alarm.samples - samples != (unsigned long)alarm_edge)
+			errors++;
+	}
+
+	hih6130_close(&dev);
+	close(alarm_event_fd);
+
+	printf("HIH6130 alarm test: %s\n", errors ? "failed" : "passed");
+
+	return errors != 0;
+}
+
+
+/**
+ * Streaming mode
+ * The device is opened once in pipelined mode: every fetch starts the
+ * next measurement and polling follows the learned conversion time, so
+ * the rate is set by the sensor. Stale frames are skipped. Samples go to
+ * stdout through the buffer of libstream.h, the summary to stderr. The
+ * latency is the time a loop iteration waits for its sample, as in the
+ * BMP085 stream; the summary adds the mean age of the samples since
+ * their measurement request, which in pipelined mode with -i is mostly
+ * the interval.
+ */
+static int hih6130_stream(int argc, char **argv) {
+
+	static const char * const names[] = { "humidity", "temperature" };
+	static struct stream stream;
+
+	struct hih6130_device dev;
+	struct hih6130_value value;
+	struct timespec now, next, requested;
+	unsigned long count = 0, n = 0;
+	long interval = 0;
+	long long begin, age = 0;
+	int format = STREAM_CSV;
+	int i;
+	float values[2];
+
+	for(i=2; i<argc; i++) {
+
+		if(!strcmp(argv[i], "-n") && i+1 < argc)
+			count = strtoul(argv[++i], NULL, 10);
+		else if(!strcmp(argv[i], "-i") && i+1 < argc)
+			interval = (long)(atof(argv[++i]) * 1000.0);
+		else if(!strcmp(argv[i], "-f") && i+1 < argc)
+			format = stream_format(argv[++i]);
+		else
+			format = -1;
+
+		if(format < 0) {
+
+			puts("Error: Invalid stream option!");
+			puts(USAGE);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, stream_signal);
+	signal(SIGTERM, stream_signal);
+
+	hih6130_open(&dev, hih6130_i2c_device, hih6130_i2c_address, 1);
+	stream_init(&stream, STDOUT_FILENO, format, names, 2);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while(!stream_stop && (count == 0 || n < count)) {
+
+		// Absolute deadlines, a late sample does not shift the ones after it
+		if(interval > 0) {
+
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+			next.tv_nsec += (interval % 1000000L) * 1000L;
+			next.tv_sec  += interval / 1000000L + next.tv_nsec / 1000000000L;
+			next.tv_nsec %= 1000000000L;
+		}
+
+		begin = stream_now();
+
+		// The fetch requests the next measurement, keep the time of this one
+		if(!dev.pending)
+			hih6130_request_measurement(&dev);
+
+		requested = dev.requested;
+		value     = hih6130_read_value(&dev);
+
+		if(value.status != HIH6130_STATUS_NORMAL)
+			continue;
+
+		age += hih6130_elapsed(&requested);
+
+		values[0] = value.humidity;
+		values[1] = value.temperature;
+
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		stream_write(&stream, now.tv_sec * 1000000LL + now.tv_nsec / 1000, stream_now() - begin, values);
+		n++;
+	}
+
+	stream_flush(&stream);
+	stream_summary(&stream, stderr);
+
+	if(n > 0)
+		fprintf(stderr, "Age:\t\t mean %.3fms since the measurement request\n", age / 1e3 / n);
+
+	hih6130_close(&dev);
+
+	return 0;
+}
 
 
 
@@ -62,6 +357,15 @@ int main(int argc, char **argv) {
 
 	struct hih6130_value hih6130;
 
+	if(argc > 1 && !strcmp(argv[1], "-s"))
+		return hih6130_stream(argc, argv);
+
+	if(argc > 1 && !strcmp(argv[1], "-c"))
+		return hih6130_check_decode();
+
+	if(argc > 1 && !strcmp(argv[1], "-a"))
+		return hih6130_alarm_test();
+
 	if(argc == 2) {
 
 		if(!strcmp(argv[1], "-v")) {
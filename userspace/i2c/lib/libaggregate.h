@@ -0,0 +1,600 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libaggregate.h keeps rollups (count, mean, standard deviation, min,
+ *  max, percentiles) of a sample stream over several sliding windows at
+ *  once, e.g. 1 s, 1 min and 1 h, updated from the sampling loop.
+ *
+ *  A window of width W is a ring of panes of width W/panes, aligned to
+ *  multiples of the pane width. A sample updates only the open pane:
+ *  Welford mean and variance, min, max and a histogram bucket, O(1).
+ *  When the time moves into the next pane, the closed pane is merged into
+ *  the window totals and the pane falling out of the window is removed
+ *  again:
+ *
+ *    mean, variance: Chan's parallel formulas for adding and removing,
+ *                    rebuilt from the panes once per turn of the ring
+ *    min, max:       monotonic deques of the panes
+ *    percentiles:    sum of the pane histograms, counts are exact
+ *
+ *  That is O(panes + buckets) once per pane, amortised O(1) per sample as
+ *  long as a pane holds a few samples. A query merges the totals with
+ *  the open pane and does not look at samples. The window slides by
+ *  whole panes: it covers the open pane and the panes - 1 before it.
+ *
+ *  Memory is fixed, AGG_PANES panes of AGG_BUCKETS counters per window
+ *  (about 33 KB with the defaults); both can be defined before including
+ *  this header. Percentiles have the resolution of the histogram range
+ *  given at init divided by AGG_BUCKETS, interpolated in the bucket.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBAGGREGATE_H_
+#define LIBAGGREGATE_H_
+
+#ifndef AGG_PANES
+#define AGG_PANES   60    ///< Most panes of a window
+#endif
+
+#ifndef AGG_BUCKETS
+#define AGG_BUCKETS 128   ///< Histogram buckets of a pane
+#endif
+
+
+/** FUNCTION DEFINITONS **/
+
+struct agg;
+struct agg_window;
+struct agg_result;
+
+void agg_init(struct agg *agg, struct agg_window *window, int max, float low, float high);
+int agg_add_window(struct agg *agg, long long width, int panes);
+void agg_update(struct agg *agg, long long time, float value);
+int agg_query(const struct agg *agg, int index, struct agg_result *result);
+float agg_percentile(const struct agg *agg, int index, float quantile);
+
+static inline void agg_advance(struct agg_window *window, long long pane);
+static inline void agg_close_pane(struct agg_window *window);
+static inline void agg_clear_pane(struct agg_window *window, int slot);
+static inline void agg_rebuild(struct agg_window *window);
+static inline void agg_merge(double *count, double *mean, double *m2, double count_b, double mean_b, double m2_b);
+static inline void agg_unmerge(double *count, double *mean, double *m2, double count_b, double mean_b, double m2_b);
+static inline int agg_bucket(const struct agg *agg, float value);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Statistics of one pane
+ * 	count: samples
+ * 	mean:  Welford mean
+ * 	m2:    Welford sum of squared differences from the mean
+ */
+struct agg_pane {
+	unsigned int count;
+	float min;
+	float max;
+	double mean;
+	double m2;
+};
+
+
+/**
+ * Monotonic deque of pane numbers, front holds the extreme value
+ */
+struct agg_deque {
+	long long pane[AGG_PANES];
+	int head;
+	int size;
+};
+
+
+/**
+ * A sliding window
+ * 	width:     pane width, in the time unit of agg_update()
+ * 	panes:     panes in the window
+ * 	current:   number (time / width) of the open pane, -1 before the first
+ * 	           sample
+ * 	pane:      ring of panes, pane n is in slot n % panes
+ * 	count:     samples of the closed panes in the window
+ * 	mean, m2:  merged Welford state of the closed panes
+ * 	min, max:  deques of the closed panes
+ * 	total:     summed histogram of the closed panes
+ * 	histogram: histogram by pane
+ */
+struct agg_window {
+	long long width;
+	int panes;
+	long long current;
+	struct agg_pane pane[AGG_PANES];
+	double count;
+	double mean;
+	double m2;
+	struct agg_deque min;
+	struct agg_deque max;
+	unsigned int total[AGG_BUCKETS];
+	unsigned int histogram[AGG_PANES][AGG_BUCKETS];
+};
+
+
+/**
+ * Aggregation of one sample stream
+ * 	low, scale: histogram bucket of a value is (value - low) * scale,
+ * 	            values outside go to the first or last bucket
+ */
+struct agg {
+	struct agg_window *window;
+	int count;
+	int max;
+	float low;
+	float scale;
+};
+
+
+/**
+ * Rollup of a window
+ */
+struct agg_result {
+	unsigned long count;
+	float mean;
+	float stddev;
+	float min;
+	float max;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/**
+ * Initialize the aggregation of a stream
+ * \param window Array for max windows
+ * \param low, high Value range of the percentile histogram
+ */
+void agg_init(struct agg *agg, struct agg_window *window, int max, float low, float high) {
+
+	agg->window = window;
+	agg->count  = 0;
+	agg->max    = max;
+	agg->low    = low;
+	agg->scale  = AGG_BUCKETS / (high - low);
+}
+
+
+/**
+ * Add a window of panes * width
+ * \param width Pane width in the time unit of agg_update(), e.g. a 1 min
+ * window in us of 60 panes is a width of 1000000
+ * \return Index of the window for agg_query()
+ */
+int agg_add_window(struct agg *agg, long long width, int panes) {
+
+	struct agg_window *window;
+
+	if(agg->count >= agg->max || panes < 1 || panes > AGG_PANES || width < 1) {
+
+		printf("Error while add window: %d panes of %lld (max %d windows of %d panes)\n", panes, width, agg->max, AGG_PANES);
+		exit(1);
+	}
+
+	window = &agg->window[agg->count];
+
+	memset(window, 0, sizeof(*window));
+
+	window->width   = width;
+	window->panes   = panes;
+	window->current = -1;
+
+	return agg->count++;
+}
+
+
+/**
+ * Add a sample to all windows
+ * \param time Sample time, not decreasing; an older sample is counted in
+ * the open pane
+ */
+void agg_update(struct agg *agg, long long time, float value) {
+
+	struct agg_window *window;
+	struct agg_pane *pane;
+	long long number;
+	double delta;
+	int i, slot;
+
+	for(i=0; i<agg->count; i++) {
+
+		window = &agg->window[i];
+		number = time / window->width;
+
+		if(number > window->current)
+			agg_advance(window, number);
+
+		slot = (int)(window->current % window->panes);
+		pane = &window->pane[slot];
+
+		// Welford
+		pane->count++;
+		delta       = value - pane->mean;
+		pane->mean += delta / pane->count;
+		pane->m2   += delta * (value - pane->mean);
+
+		if(pane->count == 1 || value < pane->min)
+			pane->min = value;
+
+		if(pane->count == 1 || value > pane->max)
+			pane->max = value;
+
+		window->histogram[slot][agg_bucket(agg, value)]++;
+	}
+}
+
+
+/**
+ * Rollup of a window, the open pane included
+ * \return 0 if the window has no samples yet
+ */
+int agg_query(const struct agg *agg, int index, struct agg_result *result) {
+
+	const struct agg_window *window = &agg->window[index];
+	const struct agg_pane *pane;
+	double count, mean, m2;
+
+	memset(result, 0, sizeof(*result));
+
+	if(window->current < 0)
+		return 0;
+
+	pane  = &window->pane[window->current % window->panes];
+	count = window->count;
+	mean  = window->mean;
+	m2    = window->m2;
+
+	agg_merge(&count, &mean, &m2, pane->count, pane->mean, pane->m2);
+
+	if(count < 1)
+		return 0;
+
+	result->count  = (unsigned long)count;
+	result->mean   = (float)mean;
+	result->stddev = count > 1 ? (float)sqrt(m2 / (count - 1)) : 0.0f;
+
+	result->min = window->min.size ? window->pane[window->min.pane[window->min.head] % window->panes].min : pane->min;
+	result->max = window->max.size ? window->pane[window->max.pane[window->max.head] % window->panes].max : pane->max;
+
+	if(pane->count && pane->min < result->min)
+		result->min = pane->min;
+
+	if(pane->count && pane->max > result->max)
+		result->max = pane->max;
+
+	return 1;
+}
+
+
+/**
+ * Percentile of a window from the histogram, e.g. quantile 0.5 for the
+ * median; NAN if the window has no samples
+ */
+float agg_percentile(const struct agg *agg, int index, float quantile) {
+
+	const struct agg_window *window = &agg->window[index];
+	const unsigned int *open;
+	struct agg_result result;
+	double rank, below, count;
+	float value;
+	int i;
+
+	if(!agg_query(agg, index, &result))
+		return NAN;
+
+	open = window->histogram[window->current % window->panes];
+	rank = quantile * result.count;
+
+	below = 0;
+
+	for(i=0; i<AGG_BUCKETS; i++) {
+
+		count = (double)window->total[i] + open[i];
+
+		if(count > 0 && below + count >= rank)
+			break;
+
+		below += count;
+	}
+
+	if(i == AGG_BUCKETS)
+		i = AGG_BUCKETS - 1;
+
+	// Interpolate in the bucket, the extremes are known exactly
+	value = agg->low + (i + (float)((rank - below) / (count > 0 ? count : 1))) / agg->scale;
+
+	if(value < result.min)
+		value = result.min;
+
+	if(value > result.max)
+		value = result.max;
+
+	return value;
+}
+
+
+/**
+ * Move the open pane of a window forward (internal function)
+ */
+static inline void agg_advance(struct agg_window *window, long long pane) {
+
+	// A gap of a whole window leaves nothing to keep
+	if(window->current < 0 || pane - window->current > window->panes) {
+
+		memset(window->pane, 0, sizeof(window->pane));
+		memset(window->total, 0, sizeof(window->total));
+		memset(window->histogram, 0, sizeof(window->histogram));
+
+		window->count    = 0;
+		window->mean     = 0;
+		window->m2       = 0;
+		window->min.size = 0;
+		window->max.size = 0;
+		window->current  = pane;
+
+		return;
+	}
+
+	while(window->current < pane) {
+
+		agg_close_pane(window);
+
+		window->current++;
+
+		// The slot of the new pane is the one of the pane leaving the window
+		agg_clear_pane(window, (int)(window->current % window->panes));
+
+		// Drift of the removals is bounded by a rebuild per turn of the ring
+		if(window->current % window->panes == 0)
+			agg_rebuild(window);
+	}
+}
+
+
+/**
+ * Merge the open pane into the window totals (internal function)
+ */
+static inline void agg_close_pane(struct agg_window *window) {
+
+	struct agg_deque *deque;
+	struct agg_pane *pane;
+	int slot, i, back;
+
+	slot = (int)(window->current % window->panes);
+	pane = &window->pane[slot];
+
+	if(pane->count == 0)
+		return;
+
+	agg_merge(&window->count, &window->mean, &window->m2, pane->count, pane->mean, pane->m2);
+
+	for(i=0; i<AGG_BUCKETS; i++)
+		window->total[i] += window->histogram[slot][i];
+
+	// Drop the panes the new one dominates, they can never be the extreme
+	deque = &window->min;
+
+	while(deque->size) {
+
+		back = (deque->head + deque->size - 1) % AGG_PANES;
+
+		if(window->pane[deque->pane[back] % window->panes].min < pane->min)
+			break;
+
+		deque->size--;
+	}
+
+	deque->pane[(deque->head + deque->size++) % AGG_PANES] = window->current;
+
+	deque = &window->max;
+
+	while(deque->size) {
+
+		back = (deque->head + deque->size - 1) % AGG_PANES;
+
+		if(window->pane[deque->pane[back] % window->panes].max > pane->max)
+			break;
+
+		deque->size--;
+	}
+
+	deque->pane[(deque->head + deque->size++) % AGG_PANES] = window->current;
+}
+
+
+/**
+ * Remove the pane of a slot from the window and empty it (internal function)
+ */
+static inline void agg_clear_pane(struct agg_window *window, int slot) {
+
+	struct agg_pane *pane = &window->pane[slot];
+	long long oldest = window->current - window->panes;
+	int i;
+
+	if(pane->count) {
+
+		agg_unmerge(&window->count, &window->mean, &window->m2, pane->count, pane->mean, pane->m2);
+
+		for(i=0; i<AGG_BUCKETS; i++)
+			window->total[i] -= window->histogram[slot][i];
+	}
+
+	// The fronts are the oldest panes
+	while(window->min.size && window->min.pane[window->min.head] <= oldest) {
+
+		window->min.head = (window->min.head + 1) % AGG_PANES;
+		window->min.size--;
+	}
+
+	while(window->max.size && window->max.pane[window->max.head] <= oldest) {
+
+		window->max.head = (window->max.head + 1) % AGG_PANES;
+		window->max.size--;
+	}
+
+	memset(pane, 0, sizeof(*pane));
+	memset(window->histogram[slot], 0, sizeof(window->histogram[slot]));
+}
+
+
+/**
+ * Merge the closed panes again (internal function)
+ */
+static inline void agg_rebuild(struct agg_window *window) {
+
+	int slot, open;
+
+	open = (int)(window->current % window->panes);
+
+	window->count = 0;
+	window->mean  = 0;
+	window->m2    = 0;
+
+	for(slot=0; slot<window->panes; slot++) {
+
+		if(slot != open)
+			agg_merge(&window->count, &window->mean, &window->m2,
+					  window->pane[slot].count, window->pane[slot].mean, window->pane[slot].m2);
+	}
+}
+
+
+/**
+ * Add the Welford state b to a (internal function)
+ */
+static inline void agg_merge(double *count, double *mean, double *m2, double count_b, double mean_b, double m2_b) {
+
+	double total = *count + count_b;
+	double delta = mean_b - *mean;
+
+	if(count_b == 0)
+		return;
+
+	*mean  += delta * count_b / total;
+	*m2    += m2_b + delta * delta * *count * count_b / total;
+	*count  = total;
+}
+
+
+/**
+ * Remove the Welford state b from a (internal function)
+ */
+static inline void agg_unmerge(double *count, double *mean, double *m2, double count_b, double mean_b, double m2_b) {
+
+	double rest = *count - count_b;
+	double delta;
+
+	if(rest <= 0) {
+
+		*count = 0;
+		*mean  = 0;
+		*m2    = 0;
+		return;
+	}
+
+	delta  = mean_b - (*count * *mean - count_b * mean_b) / rest;
+	*m2   -= m2_b + delta * delta * rest * count_b / *count;
+	*mean  = (*count * *mean - count_b * mean_b) / rest;
+	*count = rest;
+
+	if(*m2 < 0)
+		*m2 = 0;
+}
+
+
+/**
+ * Histogram bucket of a value (internal function)
+ */
+static inline int agg_bucket(const struct agg *agg, float value) {
+
+	float bucket = (value - agg->low) * agg->scale;
+
+	if(!(bucket >= 0))
+		return 0;
+
+	if(bucket >= AGG_BUCKETS - 1)
+		return AGG_BUCKETS - 1;
+
+	return (int)bucket;
+}
+
+
+#endif /* LIBAGGREGATE_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBAGGREGATE_BMP085_)
+#define LIBAGGREGATE_BMP085_
+
+/**
+ * Add a BMP085 sample to a temperature and a pressure aggregation
+ */
+static inline void agg_update_bmp085(struct agg *temperature, struct agg *pressure, long long time, const struct bmp085_value *value) {
+
+	agg_update(temperature, time, value->temperature);
+	agg_update(pressure, time, value->pressure);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBAGGREGATE_HIH6130_)
+#define LIBAGGREGATE_HIH6130_
+
+/**
+ * Add a HIH6130 sample to a humidity and a temperature aggregation,
+ * stale samples are left out
+ */
+static inline void agg_update_hih6130(struct agg *humidity, struct agg *temperature, long long time, const struct hih6130_value *value) {
+
+	if(value->status != HIH6130_STATUS_NORMAL)
+		return;
+
+	agg_update(humidity, time, value->humidity);
+	agg_update(temperature, time, value->temperature);
+}
+
+#endif
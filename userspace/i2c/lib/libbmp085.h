@@ -41,6 +41,8 @@
 #ifndef LIBBMP085_H_
 #define LIBBMP085_H_
 
+#include <time.h>
+
 /*
  * BMP085 Over sampling Modes
  */
@@ -49,6 +51,18 @@
 #define BMP085_OVERSAMPLING_HIGH     2  ///< High over sampling mode
 #define BMP085_OVERSAMPLING_ULTRA    3  ///< Ultra high over sampling mode
 
+#define BMP085_UT_TIME 5000  ///< Temperature conversion time in us (max. 4.5 ms)
+
+/*
+ * Pressure conversion time in us, dependent on over sampling
+ * (max. 4.5, 7.5, 13.5 and 25.5 ms)
+ */
+#define BMP085_UP_TIME(oversampling) ((2 + (3<<(oversampling))) * 1000)
+
+
+struct bmp085_device;
+struct bmb085_calibration;
+
 
 void bmp085_setup(__u8 i2c_device, __u8 i2c_address, unsigned char oversampling);
 static inline void bmb085_get_calibration_parameter();
@@ -63,6 +77,21 @@ float bmp085_get_temperature(void);
 float bmp085_get_altitude(float pressure);
 
 static inline __s32 bmp085_i2c_read_int(int fd, __u8 reg_no);
+static inline int bmp085_i2c_open_device(__u8 device, __u8 addr);
+static inline void bmp085_read_calibration(int fd, struct bmb085_calibration *calibration);
+static inline unsigned int bmp085_read_up(int fd, unsigned char oversampling);
+
+float bmp085_calc_temperature(struct bmb085_calibration *calibration, unsigned int ut);
+float bmp085_calc_pressure(const struct bmb085_calibration *calibration, unsigned char oversampling, unsigned int up);
+
+void bmp085_open(struct bmp085_device *dev, __u8 i2c_device, __u8 i2c_address, unsigned char oversampling);
+void bmp085_close(struct bmp085_device *dev);
+long bmp085_time_to_ready(struct bmp085_device *dev);
+int bmp085_poll_value(struct bmp085_device *dev, struct bmp085_value *value);
+long bmp085_start_temperature(struct bmp085_device *dev);
+unsigned int bmp085_fetch_temperature(struct bmp085_device *dev);
+long bmp085_start_pressure(struct bmp085_device *dev);
+unsigned int bmp085_fetch_pressure(struct bmp085_device *dev);
 
 
 
@@ -105,6 +134,31 @@ struct bmb085_calibration {
 struct bmb085_calibration bmb085_calibration;
 
 
+/**
+ * \brief Handle of one sensor for the non-blocking API
+ * A measurement runs in three phases: start the temperature conversion,
+ * read UT and start the pressure conversion, read UP. The bus is only
+ * used for these short transfers, the conversions run in between.
+ * @param fd          - Open i2c line, addressed to the sensor
+ * @param phase       - 0 idle, 1 temperature and 2 pressure conversion running
+ * @param started     - CLOCK_MONOTONIC time the running conversion was started
+ * @param due         - Conversion time of the running conversion in us
+ * @param ut          - Uncompensated temperature of the current measurement
+ * @param calibration - Calibration values of this sensor
+ */
+struct bmp085_device {
+	int fd;
+	__u8 i2c_device;
+	__u8 i2c_address;
+	unsigned char oversampling;
+	unsigned char phase;
+	struct timespec started;
+	long due;
+	unsigned int ut;
+	struct bmb085_calibration calibration;
+};
+
+
 /* RUNTIME VARIABLES */
 
 /**
@@ -154,6 +208,26 @@ unsigned char bmb085_calibration_parameter = 0;
 #include <sys/ioctl.h>
 
 #include "smbus.h"
+#include "libprobe.h"
+
+
+/* TRACE PROBES */
+
+PROBE_SEMAPHORE(bmp085, open_entry);
+PROBE_SEMAPHORE(bmp085, open_return);
+PROBE_SEMAPHORE(bmp085, close);
+PROBE_SEMAPHORE(bmp085, calibration_entry);
+PROBE_SEMAPHORE(bmp085, calibration_return);
+PROBE_SEMAPHORE(bmp085, start_temperature);
+PROBE_SEMAPHORE(bmp085, fetch_temperature);
+PROBE_SEMAPHORE(bmp085, start_pressure);
+PROBE_SEMAPHORE(bmp085, fetch_pressure);
+PROBE_SEMAPHORE(bmp085, temperature_entry);
+PROBE_SEMAPHORE(bmp085, temperature_return);
+PROBE_SEMAPHORE(bmp085, pressure_entry);
+PROBE_SEMAPHORE(bmp085, pressure_return);
+PROBE_SEMAPHORE(bmp085, altitude_entry);
+PROBE_SEMAPHORE(bmp085, altitude_return);
 
 
 
@@ -168,6 +242,8 @@ static inline int bmb085_i2c_open(__u8 addr) {
 	int fd;
 	char fn[10];
 
+	PROBE2(bmp085, open_entry, bmp085_i2c_device, addr);
+
 	sprintf(fn, "/dev/i2c-%d", bmp085_i2c_device);
 
 	// Open port for reading and writing
@@ -185,6 +261,8 @@ static inline int bmb085_i2c_open(__u8 addr) {
 		exit(1);
 	}
 
+	PROBE3(bmp085, open_return, bmp085_i2c_device, addr, fd);
+
 	return fd;
 }
 
@@ -227,25 +305,43 @@ static inline void bmb085_get_calibration_parameter() {
 	// Open I2C line
 	int fd = bmb085_i2c_open(bmp085_i2c_address);
 
-	bmb085_calibration.ac1 = (short)bmp085_i2c_read_int(fd, 0xAA);
-	bmb085_calibration.ac2 = (short)bmp085_i2c_read_int(fd, 0xAC);
-	bmb085_calibration.ac3 = (short)bmp085_i2c_read_int(fd, 0xAE);
-	bmb085_calibration.ac4 = (unsigned short)bmp085_i2c_read_int(fd, 0xB0);
-	bmb085_calibration.ac5 = (unsigned short)bmp085_i2c_read_int(fd, 0xB2);
-	bmb085_calibration.ac6 = (unsigned short)bmp085_i2c_read_int(fd, 0xB4);
-	bmb085_calibration.b1  = (short)bmp085_i2c_read_int(fd, 0xB6);
-	bmb085_calibration.b2  = (short)bmp085_i2c_read_int(fd, 0xB8);
-	bmb085_calibration.mb  = (short)bmp085_i2c_read_int(fd, 0xBA);
-	bmb085_calibration.mc  = (short)bmp085_i2c_read_int(fd, 0xBC);
-	bmb085_calibration.md  = (short)bmp085_i2c_read_int(fd, 0xBE);
+	bmp085_read_calibration(fd, &bmb085_calibration);
 
 	bmb085_calibration_parameter = 1;
 
 	// Close I2C line
+	PROBE1(bmp085, close, fd);
 	close(fd);
 }
 
 
+/**
+ * Read the calibration values from the EEPROM
+ * \param fd The I2C descriptor as an integer
+ * \param calibration Receives the values
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp085_read_calibration(int fd, struct bmb085_calibration *calibration) {
+
+	PROBE1(bmp085, calibration_entry, fd);
+
+	calibration->ac1 = (short)bmp085_i2c_read_int(fd, 0xAA);
+	calibration->ac2 = (short)bmp085_i2c_read_int(fd, 0xAC);
+	calibration->ac3 = (short)bmp085_i2c_read_int(fd, 0xAE);
+	calibration->ac4 = (unsigned short)bmp085_i2c_read_int(fd, 0xB0);
+	calibration->ac5 = (unsigned short)bmp085_i2c_read_int(fd, 0xB2);
+	calibration->ac6 = (unsigned short)bmp085_i2c_read_int(fd, 0xB4);
+	calibration->b1  = (short)bmp085_i2c_read_int(fd, 0xB6);
+	calibration->b2  = (short)bmp085_i2c_read_int(fd, 0xB8);
+	calibration->mb  = (short)bmp085_i2c_read_int(fd, 0xBA);
+	calibration->mc  = (short)bmp085_i2c_read_int(fd, 0xBC);
+	calibration->md  = (short)bmp085_i2c_read_int(fd, 0xBE);
+
+	PROBE1(bmp085, calibration_return, fd);
+}
+
+
 /**
  * Read two words from the BMP085 and supply it as a 16 bit integer
  * \param fd The I2C descriptor as an integer
@@ -288,13 +384,18 @@ static inline unsigned int bmp085_get_ut() {
 	// This requests a temperature reading
 	bmp085_i2c_write_byte(fd,0xF4,0x2E);
 
+	PROBE2(bmp085, start_temperature, fd, 5000);
+
 	// Wait at least 4.5ms
 	usleep(5000);
 
 	// Read the two byte result from address 0xF6
 	ut = bmp085_i2c_read_int(fd,0xF6);
 
+	PROBE2(bmp085, fetch_temperature, fd, ut);
+
 	// Close the i2c file
+	PROBE1(bmp085, close, fd);
 	close(fd);
 
 	return ut;
@@ -309,8 +410,6 @@ static inline unsigned int bmp085_get_ut() {
  */
 static inline unsigned int bmp085_get_up() {
 
-	__u8 values[3];
-
 	unsigned int up = 0;
 	int fd = bmb085_i2c_open(bmp085_i2c_address);
 
@@ -318,8 +417,32 @@ static inline unsigned int bmp085_get_up() {
 	// Request a pressure reading w/ oversampling setting
 	bmp085_i2c_write_byte(fd,0xF4,0x34 + (bmp085_oversampling<<6));
 
+	PROBE3(bmp085, start_pressure, fd, bmp085_oversampling, BMP085_UP_TIME(bmp085_oversampling));
+
 	// Wait for conversion, delay time dependent on oversampling setting
-	usleep((2 + (3<<bmp085_oversampling)) * 1000);
+	usleep(BMP085_UP_TIME(bmp085_oversampling));
+
+	up = bmp085_read_up(fd, bmp085_oversampling);
+
+	// Close the i2c file
+	PROBE1(bmp085, close, fd);
+	close(fd);
+
+	return up;
+}
+
+
+/**
+ * Read the result of a pressure conversion
+ * \param fd The I2C descriptor as an integer
+ * \param oversampling The over sampling the conversion was started with
+ * \return The raw value of the pressure as an unsigned integer
+ * \note Internal function
+ */
+static inline unsigned int bmp085_read_up(int fd, unsigned char oversampling) {
+
+	__u8 values[3];
+	unsigned int up;
 
 	// Read the three byte result from 0xF6
 	// 0xF6 = MSB, 0xF7 = LSB and 0xF8 = XLSB
@@ -332,10 +455,9 @@ static inline unsigned int bmp085_get_up() {
 
 	up = (((unsigned int) values[0] << 16)
 	   | ((unsigned int) values[1] << 8)
-	   | (unsigned int) values[2]) >> (8-bmp085_oversampling);
+	   | (unsigned int) values[2]) >> (8-oversampling);
 
-	// Close the i2c file
-	close(fd);
+	PROBE2(bmp085, fetch_pressure, fd, up);
 
 	return up;
 }
@@ -373,22 +495,38 @@ float bmp085_get_pressure(void) {
 	if(bmb085_calibration_parameter == 0)
 		bmp085_get_temperature();
 
+	return bmp085_calc_pressure(&bmb085_calibration, bmp085_oversampling, bmp085_get_up());
+}
+
+
+/**
+ * Compensate a raw pressure value
+ * \param calibration Calibration values, b5 of the temperature measurement
+ * just before
+ * \param oversampling The over sampling of the pressure conversion
+ * \param up The raw value of the pressure
+ * \return Value will be returned as float in units of mbar as pressure
+ */
+float bmp085_calc_pressure(const struct bmb085_calibration *calibration, unsigned char oversampling, unsigned int up) {
+
 	int x1, x2, x3, b3, b6, p;
 	unsigned int b4, b7;
 
-	b6 = bmb085_calibration.b5 - 4000;
+	PROBE1(bmp085, pressure_entry, up);
 
-	x1 = (bmb085_calibration.b2 * (b6 * b6)>>12)>>11;
-	x2 = (bmb085_calibration.ac2 * b6)>>11;
+	b6 = calibration->b5 - 4000;
+
+	x1 = (calibration->b2 * (b6 * b6)>>12)>>11;
+	x2 = (calibration->ac2 * b6)>>11;
 	x3 = x1 + x2;
-	b3 = (((((int)bmb085_calibration.ac1) * 4 + x3)<<bmp085_oversampling) + 2)>>2;
+	b3 = (((((int)calibration->ac1) * 4 + x3)<<oversampling) + 2)>>2;
 
-	x1 = (bmb085_calibration.ac3 * b6)>>13;
-	x2 = (bmb085_calibration.b1 * ((b6 * b6)>>12))>>16;
+	x1 = (calibration->ac3 * b6)>>13;
+	x2 = (calibration->b1 * ((b6 * b6)>>12))>>16;
 	x3 = ((x1 + x2) + 2)>>2;
-	b4 = (bmb085_calibration.ac4 * (unsigned int)(x3 + 32768))>>15;
+	b4 = (calibration->ac4 * (unsigned int)(x3 + 32768))>>15;
 
-	b7 = ((unsigned int)(bmp085_get_up() - b3) * (50000>>bmp085_oversampling));
+	b7 = ((unsigned int)(up - b3) * (50000>>oversampling));
 	if (b7 < 0x80000000)
 		p = (b7<<1)/b4;
 	else
@@ -399,6 +537,8 @@ float bmp085_get_pressure(void) {
 	x2 = (-7357 * p)>>16;
 	p += (x1 + x2 + 3791)>>4;
 
+	PROBE2(bmp085, pressure_return, up, p);
+
 	return (float)p/100.0f;
 }
 
@@ -410,20 +550,35 @@ float bmp085_get_pressure(void) {
  */
 float bmp085_get_temperature(void) {
 
-	float temperature;
-
 	if(bmb085_calibration_parameter == 0)
 		bmb085_get_calibration_parameter();
 
-	int x1, x2;
+	return bmp085_calc_temperature(&bmb085_calibration, bmp085_get_ut());
+}
+
+
+/**
+ * Compensate a raw temperature value
+ * \param calibration Calibration values, b5 is updated for the pressure
+ * compensation
+ * \param ut The raw value of the temperature
+ * \return Value will be returned as float in units of deg C as temperature
+ */
+float bmp085_calc_temperature(struct bmb085_calibration *calibration, unsigned int ut) {
+
+	int x1, x2, t;
+
+	PROBE1(bmp085, temperature_entry, ut);
 
-	x1 = (((int)bmp085_get_ut() - (int)bmb085_calibration.ac6) * (int)bmb085_calibration.ac5) >> 15;
-	x2 = ((int)bmb085_calibration.mc << 11)/(x1 + bmb085_calibration.md);
-	bmb085_calibration.b5 = x1 + x2;
+	x1 = (((int)ut - (int)calibration->ac6) * (int)calibration->ac5) >> 15;
+	x2 = ((int)calibration->mc << 11)/(x1 + calibration->md);
+	calibration->b5 = x1 + x2;
 
-	temperature = (float)((bmb085_calibration.b5 + 8)>>4) / 10.0f;
+	t = (calibration->b5 + 8)>>4;
 
-	return temperature;
+	PROBE2(bmp085, temperature_return, ut, t);
+
+	return (float)t / 10.0f;
 }
 
 
@@ -436,7 +591,17 @@ float bmp085_get_temperature(void) {
  */
 float bmp085_get_altitude(float pressure) {
 
-	return 44330.0f * (1.0f - powf(pressure/1013.25f, 0.1903f));
+	float altitude;
+
+	PROBE0(bmp085, altitude_entry);
+
+	altitude = 44330.0f * (1.0f - powf(pressure/1013.25f, 0.1903f));
+
+	// Probe arguments are integers: Pa and cm
+	if(PROBE_ENABLED(bmp085, altitude_return))
+		PROBE2(bmp085, altitude_return, (int)(pressure * 100.0f), (int)(altitude * 100.0f));
+
+	return altitude;
 }
 
 
@@ -460,4 +625,209 @@ struct bmp085_value bmp085_get_values(void) {
 }
 
 
+/**
+ * Open an i2c line on a given bus
+ * \note Internal function.
+ * \return The i2c descriptor as an integer
+ */
+static inline int bmp085_i2c_open_device(__u8 device, __u8 addr) {
+
+	int fd;
+	char fn[16];
+
+	PROBE2(bmp085, open_entry, device, addr);
+
+	sprintf(fn, "/dev/i2c-%d", device);
+
+	// Open port for reading and writing
+	if((fd = open(fn, O_RDWR)) < 0) {
+
+		printf("BMP085 error while open I2C device /dev/i2c-%d: %s\n", device, strerror(errno));
+		exit(1);
+	}
+
+	// Set the port options and set the address of the device
+	if(ioctl(fd, I2C_SLAVE, addr) < 0) {
+
+		printf("BMP085 error while open I2C slave 0x%x: %s\n", addr, strerror(errno));
+		close(fd);
+		exit(1);
+	}
+
+	PROBE3(bmp085, open_return, device, addr, fd);
+
+	return fd;
+}
+
+
+/**
+ * Open a sensor handle for the non-blocking API and read its calibration
+ * \param dev The handle
+ * \param i2c_device The number of the i2c device
+ * \param i2c_address The BMP085 i2c bus address
+ * \param oversampling Over sampling mode, see bmp085_setup()
+ * \return No return value.
+ */
+void bmp085_open(struct bmp085_device *dev, __u8 i2c_device, __u8 i2c_address, unsigned char oversampling) {
+
+	memset(dev, 0, sizeof(*dev));
+
+	dev->i2c_device   = i2c_device;
+	dev->i2c_address  = i2c_address;
+	dev->oversampling = oversampling;
+	dev->fd           = bmp085_i2c_open_device(i2c_device, i2c_address);
+
+	bmp085_read_calibration(dev->fd, &dev->calibration);
+}
+
+
+/**
+ * Close a sensor handle
+ * \return No return value.
+ */
+void bmp085_close(struct bmp085_device *dev) {
+
+	if(dev->fd >= 0) {
+
+		PROBE1(bmp085, close, dev->fd);
+		close(dev->fd);
+	}
+
+	dev->fd    = -1;
+	dev->phase = 0;
+}
+
+
+/**
+ * Time until the running conversion is complete
+ * \return The remaining micro seconds, 0 if the result is due and -1 if no
+ * conversion is running
+ */
+long bmp085_time_to_ready(struct bmp085_device *dev) {
+
+	struct timespec now;
+	long elapsed;
+
+	if(dev->phase == 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	elapsed = (now.tv_sec - dev->started.tv_sec) * 1000000L
+			+ (now.tv_nsec - dev->started.tv_nsec) / 1000L;
+
+	if(elapsed >= dev->due)
+		return 0;
+
+	return dev->due - elapsed;
+}
+
+
+/**
+ * Non-blocking read of temperature, pressure and altitude
+ * Every call does at most the bus transfers of one phase and never waits
+ * for a conversion: when idle the temperature conversion is started, when
+ * it is due UT is read and the pressure conversion started, when that is
+ * due UP is read and the value computed. Drive many sensors from one
+ * thread by calling this for each and sleeping for the smallest
+ * bmp085_time_to_ready() in between.
+ * \return 1 and fills value when a measurement completed, otherwise 0
+ */
+int bmp085_poll_value(struct bmp085_device *dev, struct bmp085_value *value) {
+
+	unsigned int up;
+
+	if(bmp085_time_to_ready(dev) > 0)
+		return 0;
+
+	switch(dev->phase) {
+
+	case 0:
+		bmp085_start_temperature(dev);
+		return 0;
+
+	case 1:
+		bmp085_fetch_temperature(dev);
+		bmp085_start_pressure(dev);
+		return 0;
+
+	default:
+		up = bmp085_fetch_pressure(dev);
+
+		value->temperature = bmp085_calc_temperature(&dev->calibration, dev->ut);
+		value->pressure    = bmp085_calc_pressure(&dev->calibration, dev->oversampling, up);
+		value->altitude    = bmp085_get_altitude(value->pressure);
+
+		return 1;
+	}
+}
+
+
+/**
+ * Start a temperature conversion, returns without waiting
+ * \return The conversion time in us
+ */
+long bmp085_start_temperature(struct bmp085_device *dev) {
+
+	// Request a temperature reading
+	bmp085_i2c_write_byte(dev->fd, 0xF4, 0x2E);
+
+	clock_gettime(CLOCK_MONOTONIC, &dev->started);
+
+	dev->due   = BMP085_UT_TIME;
+	dev->phase = 1;
+
+	PROBE2(bmp085, start_temperature, dev->fd, dev->due);
+
+	return dev->due;
+}
+
+
+/**
+ * Read the result of the temperature conversion, keeps it in dev->ut
+ * \return The raw value of the temperature
+ */
+unsigned int bmp085_fetch_temperature(struct bmp085_device *dev) {
+
+	dev->ut    = bmp085_i2c_read_int(dev->fd, 0xF6);
+	dev->phase = 0;
+
+	PROBE2(bmp085, fetch_temperature, dev->fd, dev->ut);
+
+	return dev->ut;
+}
+
+
+/**
+ * Start a pressure conversion w/ the over sampling of the handle,
+ * returns without waiting
+ * \return The conversion time in us
+ */
+long bmp085_start_pressure(struct bmp085_device *dev) {
+
+	bmp085_i2c_write_byte(dev->fd, 0xF4, 0x34 + (dev->oversampling<<6));
+
+	clock_gettime(CLOCK_MONOTONIC, &dev->started);
+
+	dev->due   = BMP085_UP_TIME(dev->oversampling);
+	dev->phase = 2;
+
+	PROBE3(bmp085, start_pressure, dev->fd, dev->oversampling, dev->due);
+
+	return dev->due;
+}
+
+
+/**
+ * Read the result of the pressure conversion
+ * \return The raw value of the pressure
+ */
+unsigned int bmp085_fetch_pressure(struct bmp085_device *dev) {
+
+	dev->phase = 0;
+
+	return bmp085_read_up(dev->fd, dev->oversampling);
+}
+
+
 #endif /* LIBBMP085_H_ */
@@ -0,0 +1,757 @@
+/**
+ * \mainpage
+ *
+ * libbmp280.h is a communication library for the BOSCH BMP280 Digital
+ * Pressure Sensor and the BME280 Combined Humidity and Pressure Sensor.
+ *
+ * The BMP180 is register compatible with the BMP085, use libbmp085.h for
+ * these parts.
+ *
+ * Unlike the BMP085 the BMP280 family supplies the complete measurement
+ * (pressure, temperature and on the BME280 humidity) in the data registers
+ * 0xF7..0xFE, so a compensated sample needs a single burst read. The
+ * trimming parameters are read in one burst (0x88..0xA1) plus one burst
+ * for the BME280 humidity parameters (0xE1..0xE7).
+ *
+ * From user space you will need the SMBus level access helper functions
+ * written by Simon G. Vogl, Frodo Looijaard and Jean Delvare.
+ *
+ * \copyright 2013 Knut Welzel (knut.welzels@googlemail.com)
+ *
+ */
+/*  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBBMP280_H_
+#define LIBBMP280_H_
+
+/*
+ * BMP280/BME280 chip identifiers (register 0xD0)
+ */
+#define BMP280_CHIP_ID_SAMPLE1 0x56  ///< BMP280 engineering sample
+#define BMP280_CHIP_ID_SAMPLE2 0x57  ///< BMP280 engineering sample
+#define BMP280_CHIP_ID         0x58  ///< BMP280 mass production
+#define BME280_CHIP_ID         0x60  ///< BME280
+
+/*
+ * BMP280/BME280 registers
+ */
+#define BMP280_REG_CALIB00     0x88  ///< First trimming register (dig_T1)
+#define BMP280_REG_CALIB25     0xA1  ///< dig_H1 (BME280 only)
+#define BMP280_REG_ID          0xD0
+#define BMP280_REG_RESET       0xE0
+#define BMP280_REG_CALIB26     0xE1  ///< dig_H2 .. dig_H6 (BME280 only)
+#define BMP280_REG_CTRL_HUM    0xF2
+#define BMP280_REG_STATUS      0xF3
+#define BMP280_REG_CTRL_MEAS   0xF4
+#define BMP280_REG_CONFIG      0xF5
+#define BMP280_REG_DATA        0xF7  ///< press_msb .. hum_lsb
+
+#define BMP280_STATUS_MEASURING 0x08
+
+/*
+ * BMP280 over sampling settings (osrs_t, osrs_p, osrs_h)
+ */
+#define BMP280_OVERSAMPLING_SKIP 0  ///< Measurement skipped
+#define BMP280_OVERSAMPLING_X1   1  ///< Ultra low power
+#define BMP280_OVERSAMPLING_X2   2  ///< Low power
+#define BMP280_OVERSAMPLING_X4   3  ///< Standard resolution
+#define BMP280_OVERSAMPLING_X8   4  ///< High resolution
+#define BMP280_OVERSAMPLING_X16  5  ///< Ultra high resolution
+
+/*
+ * BMP280 power modes
+ */
+#define BMP280_MODE_SLEEP  0  ///< No measurements are performed
+#define BMP280_MODE_FORCED 1  ///< One measurement per request
+#define BMP280_MODE_NORMAL 3  ///< Continuous measurements, t_standby apart
+
+
+struct bmp280_raw;
+
+void bmp280_setup(__u8 i2c_device, __u8 i2c_address, unsigned char oversampling, unsigned char mode);
+void bmp280_close(void);
+static inline int bmp280_i2c_open(__u8 addr);
+static inline void bmp280_init(void);
+static inline void bmp280_get_calibration_parameter(int fd);
+static inline void bmp280_i2c_read_block(int fd, __u8 reg_no, __u8 length, __u8 *values);
+static inline void bmp280_i2c_write_byte(int fd, __u8 reg_no, __u8 value);
+
+static inline void bmp280_get_raw(struct bmp280_raw *raw);
+static inline unsigned int bmp280_measurement_time(void);
+
+static inline int bmp280_compensate_temperature(int adc_t, int *t_fine);
+static inline unsigned int bmp280_compensate_pressure(int adc_p, int t_fine);
+static inline unsigned int bmp280_compensate_humidity(int adc_h, int t_fine);
+
+struct bmp280_value bmp280_get_values(void);
+float bmp280_get_pressure(void);
+float bmp280_get_temperature(void);
+float bmp280_get_humidity(void);
+float bmp280_get_altitude(float pressure);
+
+
+
+/* TYPE DEFINITIONS */
+
+/**
+ * \brief Measurement values
+ * @param  temperature - The temperature in deg C as float
+ * @param  pressure    - The pressure in mbar as float
+ * @param  humidity    - The relative humidity in %RH as float (BME280 only)
+ * @param  altitude    - The altitude in meter as float
+ */
+struct bmp280_value {
+	float temperature;
+	float pressure;
+	float humidity;
+	float altitude;
+};
+
+
+/**
+ * \brief Uncompensated values of one burst read
+ * \note adc_h is 0 on a BMP280.
+ */
+struct bmp280_raw {
+	int adc_p;
+	int adc_t;
+	int adc_h;
+};
+
+
+/**
+ * \brief Calibration values
+ * \brief These values are stored in the NVM of the BMP280/BME280 sensor.
+ */
+struct bmp280_calibration {
+	unsigned short int dig_t1;
+	short int dig_t2;
+	short int dig_t3;
+	unsigned short int dig_p1;
+	short int dig_p2;
+	short int dig_p3;
+	short int dig_p4;
+	short int dig_p5;
+	short int dig_p6;
+	short int dig_p7;
+	short int dig_p8;
+	short int dig_p9;
+	unsigned char dig_h1;
+	short int dig_h2;
+	unsigned char dig_h3;
+	short int dig_h4;
+	short int dig_h5;
+	signed char dig_h6;
+};
+
+struct bmp280_calibration bmp280_calibration;
+
+
+/* RUNTIME VARIABLES */
+
+/**
+ * BMP280 i2c device number
+ * \em 0: /dev/i2c-0
+ * \em 1: /dev/i2c-1
+ */
+__u8 bmp280_i2c_device = 1;
+
+
+/**
+ * BMP280 i2c bus address.
+ * \note The default address is 0x76 (SDO to GND), 0x77 with SDO to VDDIO.
+ */
+__u8 bmp280_i2c_address = 0x76;
+
+
+/**
+ * Over sampling of pressure, temperature and humidity
+ * \em BMP280_OVERSAMPLING_SKIP .. BMP280_OVERSAMPLING_X16
+ * \note The default value is BMP280_OVERSAMPLING_X1
+ */
+unsigned char bmp280_oversampling = BMP280_OVERSAMPLING_X1;
+
+
+/**
+ * Power mode
+ * \em forced: BMP280_MODE_FORCED, one conversion per bmp280_get_values()
+ * \em normal: BMP280_MODE_NORMAL, the sensor converts continuously and
+ *             bmp280_get_values() only reads the latest result
+ * \note The default value is BMP280_MODE_FORCED
+ */
+unsigned char bmp280_mode = BMP280_MODE_FORCED;
+
+
+/**
+ * Standby time between two conversions in normal mode (config t_sb)
+ * \note The default value is 0 (0.5 ms)
+ */
+unsigned char bmp280_standby = 0;
+
+
+/**
+ * IIR filter coefficient (config filter)
+ * \note The default value is 0 (filter off)
+ */
+unsigned char bmp280_filter = 0;
+
+
+/**
+ * Chip identifier read from register 0xD0
+ * \note Internal value, set on first run.
+ */
+unsigned char bmp280_chip_id = 0;
+
+
+/**
+ * The open i2c descriptor.
+ * \note Internal value, the line stays open between two readings and is
+ * closed by bmp280_close().
+ */
+int bmp280_i2c_fd = -1;
+
+
+
+/** FUNKTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "smbus.h"
+#include "libprobe.h"
+
+
+/* TRACE PROBES */
+
+PROBE_SEMAPHORE(bmp280, open_entry);
+PROBE_SEMAPHORE(bmp280, open_return);
+PROBE_SEMAPHORE(bmp280, close);
+PROBE_SEMAPHORE(bmp280, calibration_entry);
+PROBE_SEMAPHORE(bmp280, calibration_return);
+PROBE_SEMAPHORE(bmp280, start);
+PROBE_SEMAPHORE(bmp280, wait_return);
+PROBE_SEMAPHORE(bmp280, fetch);
+PROBE_SEMAPHORE(bmp280, temperature_entry);
+PROBE_SEMAPHORE(bmp280, temperature_return);
+PROBE_SEMAPHORE(bmp280, pressure_entry);
+PROBE_SEMAPHORE(bmp280, pressure_return);
+PROBE_SEMAPHORE(bmp280, humidity_entry);
+PROBE_SEMAPHORE(bmp280, humidity_return);
+
+
+
+/**
+ * Open a connection a i2C connection
+ * \note Internal function.
+ * @return The i2c descriptor as an integer
+ */
+static inline int bmp280_i2c_open(__u8 addr) {
+
+	int fd;
+	char fn[16];
+
+	PROBE2(bmp280, open_entry, bmp280_i2c_device, addr);
+
+	sprintf(fn, "/dev/i2c-%d", bmp280_i2c_device);
+
+	// Open port for reading and writing
+	if((fd = open(fn, O_RDWR)) < 0) {
+
+		printf("BMP280 error while open I2C device /dev/i2c-%d: %s\n", bmp280_i2c_device, strerror(errno));
+		exit(1);
+	}
+
+	// Set the port options and set the address of the device
+	if(ioctl(fd, I2C_SLAVE, addr) < 0) {
+
+		printf("BMP280 error while open I2C slave 0x%x: %s\n", addr, strerror(errno));
+		close(fd);
+		exit(1);
+	}
+
+	PROBE3(bmp280, open_return, bmp280_i2c_device, addr, fd);
+
+	return fd;
+}
+
+
+/**
+ * Setup the BMP280/BME280 sensor on first run.
+ * \param i2c_device The number of the i2c device<br>
+ * \em 0: /dev/i2c-0<br>
+ * \em 1: /dev/i2c-1
+ *
+ * \param i2c_address The BMP280 i2c bus address<br>
+ * default is 0x76
+ *
+ * \param oversampling Over sampling of all measurements.<br>
+ * See BMP280 data sheet chapter 3.4 "filter selection":<br>
+ * \li Ultra low power:       BMP280_OVERSAMPLING_X1<br>
+ * \li Low power:             BMP280_OVERSAMPLING_X2<br>
+ * \li Standard resolution:   BMP280_OVERSAMPLING_X4<br>
+ * \li High resolution:       BMP280_OVERSAMPLING_X8<br>
+ * \li Ultra high resolution: BMP280_OVERSAMPLING_X16
+ *
+ * \param mode BMP280_MODE_FORCED or BMP280_MODE_NORMAL
+ * \return No return value.
+ */
+void bmp280_setup(__u8 i2c_device, __u8 i2c_address, unsigned char oversampling, unsigned char mode) {
+
+	// A new bus or address needs a new line and new trimming values
+	bmp280_close();
+
+	bmp280_i2c_device   = i2c_device;
+	bmp280_i2c_address  = i2c_address;
+	bmp280_oversampling = oversampling;
+	bmp280_mode         = mode;
+}
+
+
+/**
+ * Close the i2c line, put a sensor in normal mode back to sleep.
+ * \return No return value.
+ */
+void bmp280_close(void) {
+
+	if(bmp280_i2c_fd < 0)
+		return;
+
+	if(bmp280_mode == BMP280_MODE_NORMAL)
+		i2c_smbus_write_byte_data(bmp280_i2c_fd, BMP280_REG_CTRL_MEAS, BMP280_MODE_SLEEP);
+
+	PROBE1(bmp280, close, bmp280_i2c_fd);
+	close(bmp280_i2c_fd);
+
+	bmp280_i2c_fd  = -1;
+	bmp280_chip_id = 0;
+}
+
+
+/**
+ * Open the line, identify the chip, read the trimming parameters and
+ * configure the measurement.
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp280_init(void) {
+
+	int fd;
+	__s32 id;
+	__u8 ctrl_meas;
+
+	fd = bmp280_i2c_open(bmp280_i2c_address);
+
+	if((id = i2c_smbus_read_byte_data(fd, BMP280_REG_ID)) < 0) {
+
+		perror("BMP280 error while read chip id");
+		close(fd);
+		exit(1);
+	}
+
+	if(id != BMP280_CHIP_ID && id != BME280_CHIP_ID
+	&& id != BMP280_CHIP_ID_SAMPLE1 && id != BMP280_CHIP_ID_SAMPLE2) {
+
+		printf("BMP280 error unknown chip id 0x%02x at 0x%x\n", id, bmp280_i2c_address);
+		close(fd);
+		exit(1);
+	}
+
+	bmp280_chip_id = (unsigned char)id;
+
+	bmp280_get_calibration_parameter(fd);
+
+	// Config is only writeable in sleep mode
+	bmp280_i2c_write_byte(fd, BMP280_REG_CTRL_MEAS, BMP280_MODE_SLEEP);
+	bmp280_i2c_write_byte(fd, BMP280_REG_CONFIG,
+			((bmp280_standby & 0x07)<<5) | ((bmp280_filter & 0x07)<<2));
+
+	// ctrl_hum becomes effective after the next write of ctrl_meas
+	if(bmp280_chip_id == BME280_CHIP_ID)
+		bmp280_i2c_write_byte(fd, BMP280_REG_CTRL_HUM, bmp280_oversampling & 0x07);
+
+	// In forced mode the conversion is triggered by bmp280_get_raw()
+	if(bmp280_mode == BMP280_MODE_NORMAL) {
+
+		ctrl_meas = ((bmp280_oversampling & 0x07)<<5)
+				  | ((bmp280_oversampling & 0x07)<<2)
+				  | BMP280_MODE_NORMAL;
+
+		bmp280_i2c_write_byte(fd, BMP280_REG_CTRL_MEAS, ctrl_meas);
+	}
+
+	bmp280_i2c_fd = fd;
+}
+
+
+/**
+ * Read the trimming parameters in one (BMP280) or two (BME280) bursts
+ * \param fd The I2C descriptor as an integer
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp280_get_calibration_parameter(int fd) {
+
+	__u8 c[26];
+	__u8 h[7];
+
+	PROBE1(bmp280, calibration_entry, fd);
+
+	// 0x88..0xA1: dig_T1..dig_P9, reserved, dig_H1 (all little endian)
+	bmp280_i2c_read_block(fd, BMP280_REG_CALIB00, sizeof(c), c);
+
+	bmp280_calibration.dig_t1 = (unsigned short)(c[1]<<8 | c[0]);
+	bmp280_calibration.dig_t2 = (short)(c[3]<<8 | c[2]);
+	bmp280_calibration.dig_t3 = (short)(c[5]<<8 | c[4]);
+	bmp280_calibration.dig_p1 = (unsigned short)(c[7]<<8 | c[6]);
+	bmp280_calibration.dig_p2 = (short)(c[9]<<8 | c[8]);
+	bmp280_calibration.dig_p3 = (short)(c[11]<<8 | c[10]);
+	bmp280_calibration.dig_p4 = (short)(c[13]<<8 | c[12]);
+	bmp280_calibration.dig_p5 = (short)(c[15]<<8 | c[14]);
+	bmp280_calibration.dig_p6 = (short)(c[17]<<8 | c[16]);
+	bmp280_calibration.dig_p7 = (short)(c[19]<<8 | c[18]);
+	bmp280_calibration.dig_p8 = (short)(c[21]<<8 | c[20]);
+	bmp280_calibration.dig_p9 = (short)(c[23]<<8 | c[22]);
+
+	if(bmp280_chip_id != BME280_CHIP_ID) {
+
+		PROBE1(bmp280, calibration_return, fd);
+		return;
+	}
+
+	bmp280_calibration.dig_h1 = c[25];
+
+	// 0xE1..0xE7: dig_H2..dig_H6, H4 and H5 share the nibbles of 0xE5
+	bmp280_i2c_read_block(fd, BMP280_REG_CALIB26, sizeof(h), h);
+
+	bmp280_calibration.dig_h2 = (short)(h[1]<<8 | h[0]);
+	bmp280_calibration.dig_h3 = h[2];
+	bmp280_calibration.dig_h4 = (short)(((signed char)h[3])*16 | (h[4] & 0x0F));
+	bmp280_calibration.dig_h5 = (short)(((signed char)h[5])*16 | (h[4]>>4));
+	bmp280_calibration.dig_h6 = (signed char)h[6];
+
+	PROBE1(bmp280, calibration_return, fd);
+}
+
+
+/**
+ * Read a block of registers
+ * \param fd The I2C descriptor as an integer
+ * \param reg_no The first register
+ * \param length Number of bytes to read
+ * \param values Buffer of at least length bytes
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp280_i2c_read_block(int fd, __u8 reg_no, __u8 length, __u8 *values) {
+
+	if(i2c_smbus_read_i2c_block_data(fd, reg_no, length, values) != length) {
+
+		perror("BMP280 error while read I2C block");
+		close(fd);
+		exit(1);
+	}
+}
+
+
+/**
+ * Write a byte to the BMP280
+ * \param fd The I2C descriptor as an intager
+ * \param reg_no The register address of the BMP280
+ * \param value The value to write into the register as a unsigned byte
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp280_i2c_write_byte(int fd, __u8 reg_no, __u8 value) {
+
+	if(i2c_smbus_write_byte_data(fd, reg_no, value) < 0) {
+
+		perror("BMP280 error while write I2C byte");
+		close(fd);
+		exit(1);
+	}
+}
+
+
+/**
+ * Maximum measurement time of one forced conversion.
+ * See BMP280 data sheet appendix B "measurement time".
+ * \return The time in micro seconds
+ * \note Internal function
+ */
+static inline unsigned int bmp280_measurement_time(void) {
+
+	unsigned int us = 1250;
+	unsigned int osrs = 0;
+
+	if(bmp280_oversampling != BMP280_OVERSAMPLING_SKIP)
+		osrs = 1<<(bmp280_oversampling - 1);
+
+	// Temperature, pressure and humidity use the same over sampling
+	us += 2300 * osrs;
+	us += 2300 * osrs + 575;
+
+	if(bmp280_chip_id == BME280_CHIP_ID)
+		us += 2300 * osrs + 575;
+
+	return us;
+}
+
+
+/**
+ * Get the uncompensated values of pressure, temperature and humidity
+ * with one burst read of the data registers.
+ * \param raw Output of the uncompensated values
+ * \return No return value.
+ * \note Internal function
+ */
+static inline void bmp280_get_raw(struct bmp280_raw *raw) {
+
+	__u8 d[8];
+	__u8 length;
+	__u8 ctrl_meas;
+	__s32 status;
+	int i;
+
+	if(bmp280_i2c_fd < 0)
+		bmp280_init();
+
+	if(bmp280_mode != BMP280_MODE_NORMAL) {
+
+		// Request one conversion, the sensor returns to sleep afterwards
+		ctrl_meas = ((bmp280_oversampling & 0x07)<<5)
+				  | ((bmp280_oversampling & 0x07)<<2)
+				  | BMP280_MODE_FORCED;
+
+		bmp280_i2c_write_byte(bmp280_i2c_fd, BMP280_REG_CTRL_MEAS, ctrl_meas);
+
+		PROBE3(bmp280, start, bmp280_i2c_fd, ctrl_meas, bmp280_measurement_time());
+
+		// Wait the maximum conversion time, then confirm by the status bit
+		usleep(bmp280_measurement_time());
+
+		for(i=0; i<10; i++) {
+
+			status = i2c_smbus_read_byte_data(bmp280_i2c_fd, BMP280_REG_STATUS);
+
+			if(status >= 0 && !(status & BMP280_STATUS_MEASURING))
+				break;
+
+			usleep(500);
+		}
+
+		PROBE3(bmp280, wait_return, bmp280_i2c_fd, status, i);
+	}
+
+	// 0xF7..0xFC pressure and temperature, 0xFD..0xFE humidity
+	length = (bmp280_chip_id == BME280_CHIP_ID) ? 8 : 6;
+
+	bmp280_i2c_read_block(bmp280_i2c_fd, BMP280_REG_DATA, length, d);
+
+	PROBE2(bmp280, fetch, bmp280_i2c_fd, length);
+
+	raw->adc_p = ((int)d[0]<<12) | ((int)d[1]<<4) | (d[2]>>4);
+	raw->adc_t = ((int)d[3]<<12) | ((int)d[4]<<4) | (d[5]>>4);
+	raw->adc_h = (length == 8) ? (((int)d[6]<<8) | d[7]) : 0;
+}
+
+
+/**
+ * Compensate the temperature (data sheet 32 bit integer formula)
+ * \param adc_t The uncompensated temperature
+ * \param t_fine Output of the fine temperature for pressure and humidity
+ * \return The temperature in 0.01 deg C
+ * \note Internal function
+ */
+static inline int bmp280_compensate_temperature(int adc_t, int *t_fine) {
+
+	int var1, var2;
+
+	PROBE1(bmp280, temperature_entry, adc_t);
+
+	var1 = ((((adc_t>>3) - ((int)bmp280_calibration.dig_t1<<1)))
+		 * ((int)bmp280_calibration.dig_t2)) >> 11;
+
+	var2 = (((((adc_t>>4) - ((int)bmp280_calibration.dig_t1))
+		 * ((adc_t>>4) - ((int)bmp280_calibration.dig_t1))) >> 12)
+		 * ((int)bmp280_calibration.dig_t3)) >> 14;
+
+	*t_fine = var1 + var2;
+
+	PROBE2(bmp280, temperature_return, adc_t, (*t_fine * 5 + 128) >> 8);
+
+	return (*t_fine * 5 + 128) >> 8;
+}
+
+
+/**
+ * Compensate the pressure (data sheet 64 bit integer formula)
+ * \param adc_p The uncompensated pressure
+ * \param t_fine The fine temperature of the same burst
+ * \return The pressure in Pa as Q24.8 fixed point
+ * \note Internal function
+ */
+static inline unsigned int bmp280_compensate_pressure(int adc_p, int t_fine) {
+
+	long long var1, var2, p;
+
+	PROBE1(bmp280, pressure_entry, adc_p);
+
+	var1 = ((long long)t_fine) - 128000;
+	var2 = var1 * var1 * (long long)bmp280_calibration.dig_p6;
+	var2 = var2 + ((var1 * (long long)bmp280_calibration.dig_p5)<<17);
+	var2 = var2 + (((long long)bmp280_calibration.dig_p4)<<35);
+	var1 = ((var1 * var1 * (long long)bmp280_calibration.dig_p3)>>8)
+		 + ((var1 * (long long)bmp280_calibration.dig_p2)<<12);
+	var1 = (((((long long)1)<<47) + var1)) * ((long long)bmp280_calibration.dig_p1)>>33;
+
+	// Avoid exception caused by division by zero
+	if(var1 == 0) {
+
+		PROBE2(bmp280, pressure_return, adc_p, 0);
+		return 0;
+	}
+
+	p = 1048576 - adc_p;
+	p = (((p<<31) - var2) * 3125) / var1;
+	var1 = (((long long)bmp280_calibration.dig_p9) * (p>>13) * (p>>13)) >> 25;
+	var2 = (((long long)bmp280_calibration.dig_p8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((long long)bmp280_calibration.dig_p7)<<4);
+
+	PROBE2(bmp280, pressure_return, adc_p, (unsigned int)p);
+
+	return (unsigned int)p;
+}
+
+
+/**
+ * Compensate the humidity (data sheet 32 bit integer formula, BME280 only)
+ * \param adc_h The uncompensated humidity
+ * \param t_fine The fine temperature of the same burst
+ * \return The humidity in %RH as Q22.10 fixed point
+ * \note Internal function
+ */
+static inline unsigned int bmp280_compensate_humidity(int adc_h, int t_fine) {
+
+	int v;
+
+	PROBE1(bmp280, humidity_entry, adc_h);
+
+	v = t_fine - ((int)76800);
+
+	v = (((((adc_h << 14) - (((int)bmp280_calibration.dig_h4) << 20)
+		- (((int)bmp280_calibration.dig_h5) * v)) + ((int)16384)) >> 15)
+		* (((((((v * ((int)bmp280_calibration.dig_h6)) >> 10)
+		* (((v * ((int)bmp280_calibration.dig_h3)) >> 11) + ((int)32768))) >> 10)
+		+ ((int)2097152)) * ((int)bmp280_calibration.dig_h2) + 8192) >> 14));
+
+	v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int)bmp280_calibration.dig_h1)) >> 4));
+
+	v = (v < 0 ? 0 : v);
+	v = (v > 419430400 ? 419430400 : v);
+
+	PROBE2(bmp280, humidity_return, adc_h, (unsigned int)(v>>12));
+
+	return (unsigned int)(v>>12);
+}
+
+
+/**
+ * Get temperature, pressure, humidity and altitude of one burst read.
+ * \return Values will be returned as the struct bmp280_value
+ */
+struct bmp280_value bmp280_get_values(void) {
+
+	struct bmp280_raw raw;
+	struct bmp280_value value;
+	int t_fine;
+
+	bmp280_get_raw(&raw);
+
+	value.temperature = (float)bmp280_compensate_temperature(raw.adc_t, &t_fine) / 100.0f;
+	value.pressure    = (float)bmp280_compensate_pressure(raw.adc_p, t_fine) / 25600.0f;
+	value.humidity    = 0.0f;
+
+	if(bmp280_chip_id == BME280_CHIP_ID)
+		value.humidity = (float)bmp280_compensate_humidity(raw.adc_h, t_fine) / 1024.0f;
+
+	value.altitude = bmp280_get_altitude(value.pressure);
+
+	return value;
+}
+
+
+/**
+ * Get the pressure.
+ * \return Value will be returned as float in mbar
+ */
+float bmp280_get_pressure(void) {
+
+	return bmp280_get_values().pressure;
+}
+
+
+/**
+ * Get the temperature.
+ * \return Value will be returned as float in deg C
+ */
+float bmp280_get_temperature(void) {
+
+	return bmp280_get_values().temperature;
+}
+
+
+/**
+ * Get the humidity.
+ * \return Value will be returned as float in %RH, 0 on a BMP280
+ */
+float bmp280_get_humidity(void) {
+
+	return bmp280_get_values().humidity;
+}
+
+
+/**
+ * Get altitude
+ * \note On some soft float compilers, the calculation goes wrong
+ * (e.g. Raspberry PI or Beagle needs hard float)
+ * \return Value will be returned as float in units of meter as altitude
+ */
+float bmp280_get_altitude(float pressure) {
+
+	return 44330.0f * (1.0f - powf(pressure/1013.25f, 0.1903f));
+}
+
+
+#endif /* LIBBMP280_H_ */
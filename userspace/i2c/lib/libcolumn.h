@@ -0,0 +1,563 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libcolumn.h keeps recent samples in memory column by column for fast
+ *  range queries, e.g. the mean and max pressure between two times or
+ *  the number of humidity samples above 80 %RH.
+ *
+ *  Samples go into chunks of COL_CHUNK rows: one array of timestamps and
+ *  one float array per quantity (struct of arrays), so a scan of one
+ *  quantity reads only its own values. Every chunk keeps a zone map:
+ *  first and last time, and min, max and sum of each column. A query
+ *  skips the chunks outside its time or value range, answers the chunks
+ *  completely inside from the zone map and scans only the rest, with
+ *  vector kernels for sum, min, max and count in a range.
+ *
+ *  The chunks are a ring of fixed size supplied by the caller, the newest
+ *  chunk replaces the oldest.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBCOLUMN_H_
+#define LIBCOLUMN_H_
+
+#define COL_CHUNK   1024   ///< Rows of a chunk
+#define COL_COLUMNS 4      ///< Most columns of a store
+
+/*
+ * Kernels use GCC vector extensions like hih6130_decode_frames(), which
+ * map to SSE/AVX on x86 and NEON on ARM. Other compilers use the scalar
+ * loops.
+ */
+#if defined(__GNUC__) && (__GNUC__ >= 9 || defined(__clang__))
+#define COL_VECTOR 4
+typedef float col_vf32 __attribute__((vector_size(16)));
+typedef int col_vs32 __attribute__((vector_size(16)));
+#endif
+
+
+/** FUNCTION DEFINITONS **/
+
+struct col_store;
+struct col_chunk;
+struct col_result;
+
+void col_init(struct col_store *store, struct col_chunk *chunk, int chunks, int columns);
+void col_append(struct col_store *store, long long time, const float *values);
+unsigned long col_rows(const struct col_store *store);
+int col_aggregate(const struct col_store *store, int column, long long from, long long to, struct col_result *result);
+unsigned long col_count_where(const struct col_store *store, int column, long long from, long long to, float low, float high);
+
+static inline const struct col_chunk *col_chunk_at(const struct col_store *store, long long number);
+static inline int col_lower_bound(const struct col_chunk *chunk, long long time);
+static inline int col_upper_bound(const struct col_chunk *chunk, long long time);
+static inline void col_scan(const float *value, int count, double *sum, float *min, float *max);
+static inline int col_count_range(const float *value, int count, float low, float high);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A chunk of rows
+ * 	time:  timestamps, not decreasing
+ * 	value: columns
+ * 	count: rows used
+ * 	first: time of the first row
+ * 	last:  time of the last row
+ * 	min, max, sum: zone map by column
+ */
+struct col_chunk {
+	long long time[COL_CHUNK];
+	float value[COL_COLUMNS][COL_CHUNK] __attribute__((aligned(16)));
+	int count;
+	long long first;
+	long long last;
+	float min[COL_COLUMNS];
+	float max[COL_COLUMNS];
+	double sum[COL_COLUMNS];
+};
+
+
+/**
+ * A store
+ * 	chunk:   ring of chunks, chunk n in slot n % chunks
+ * 	started: chunks started, the newest is number started - 1
+ */
+struct col_store {
+	struct col_chunk *chunk;
+	int chunks;
+	int columns;
+	long long started;
+};
+
+
+/**
+ * Aggregate of a column over a time range
+ */
+struct col_result {
+	unsigned long count;
+	double sum;
+	float mean;
+	float min;
+	float max;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/**
+ * Initialize a store
+ * \param chunk Array of chunks, chunks * COL_CHUNK rows are kept
+ * \param columns Values per row, at most COL_COLUMNS
+ */
+void col_init(struct col_store *store, struct col_chunk *chunk, int chunks, int columns) {
+
+	if(chunks < 1 || columns < 1 || columns > COL_COLUMNS) {
+
+		printf("Error while init column store: %d chunks of %d columns (max %d)\n", chunks, columns, COL_COLUMNS);
+		exit(1);
+	}
+
+	store->chunk   = chunk;
+	store->chunks  = chunks;
+	store->columns = columns;
+	store->started = 0;
+}
+
+
+/**
+ * Append a row, times not decreasing
+ * \param values One value per column
+ */
+void col_append(struct col_store *store, long long time, const float *values) {
+
+	struct col_chunk *chunk;
+	int row, i;
+
+	chunk = store->started ? &store->chunk[(store->started - 1) % store->chunks] : NULL;
+
+	if(chunk == NULL || chunk->count == COL_CHUNK) {
+
+		chunk = &store->chunk[store->started % store->chunks];
+		store->started++;
+
+		chunk->count = 0;
+		chunk->first = time;
+
+		for(i=0; i<store->columns; i++) {
+
+			chunk->min[i] = values[i];
+			chunk->max[i] = values[i];
+			chunk->sum[i] = 0;
+		}
+	}
+
+	row = chunk->count++;
+
+	chunk->time[row] = time;
+	chunk->last      = time;
+
+	for(i=0; i<store->columns; i++) {
+
+		chunk->value[i][row] = values[i];
+		chunk->sum[i]       += values[i];
+
+		if(values[i] < chunk->min[i])
+			chunk->min[i] = values[i];
+
+		if(values[i] > chunk->max[i])
+			chunk->max[i] = values[i];
+	}
+}
+
+
+/**
+ * Number of rows kept
+ */
+unsigned long col_rows(const struct col_store *store) {
+
+	long long oldest;
+	unsigned long rows = 0;
+
+	oldest = store->started > store->chunks ? store->started - store->chunks : 0;
+
+	for(; oldest<store->started; oldest++)
+		rows += col_chunk_at(store, oldest)->count;
+
+	return rows;
+}
+
+
+/**
+ * Count, sum, mean, min and max of a column with from <= time <= to
+ * \return 0 if there is no row in the range
+ */
+int col_aggregate(const struct col_store *store, int column, long long from, long long to, struct col_result *result) {
+
+	const struct col_chunk *chunk;
+	long long number;
+	int begin, end;
+	double sum;
+	float min, max;
+
+	if(column < 0 || column >= store->columns) {
+
+		printf("Error while aggregate column store: column %d of %d columns\n", column, store->columns);
+		exit(1);
+	}
+
+	memset(result, 0, sizeof(*result));
+
+	result->min = INFINITY;
+	result->max = -INFINITY;
+
+	number = store->started > store->chunks ? store->started - store->chunks : 0;
+
+	for(; number<store->started; number++) {
+
+		chunk = col_chunk_at(store, number);
+
+		// Zone map: skip, or take the whole chunk without a scan
+		if(chunk->last < from)
+			continue;
+
+		if(chunk->first > to)
+			break;
+
+		if(chunk->first >= from && chunk->last <= to) {
+
+			result->count += chunk->count;
+			result->sum   += chunk->sum[column];
+
+			if(chunk->min[column] < result->min)
+				result->min = chunk->min[column];
+
+			if(chunk->max[column] > result->max)
+				result->max = chunk->max[column];
+
+			continue;
+		}
+
+		begin = col_lower_bound(chunk, from);
+		end   = col_upper_bound(chunk, to);
+
+		if(begin >= end)
+			continue;
+
+		col_scan(&chunk->value[column][begin], end - begin, &sum, &min, &max);
+
+		result->count += end - begin;
+		result->sum   += sum;
+
+		if(min < result->min)
+			result->min = min;
+
+		if(max > result->max)
+			result->max = max;
+	}
+
+	if(result->count == 0) {
+
+		result->min = 0;
+		result->max = 0;
+		return 0;
+	}
+
+	result->mean = (float)(result->sum / result->count);
+
+	return 1;
+}
+
+
+/**
+ * Number of rows with from <= time <= to and low <= value <= high
+ * Use -INFINITY or INFINITY for an open side.
+ */
+unsigned long col_count_where(const struct col_store *store, int column, long long from, long long to, float low, float high) {
+
+	const struct col_chunk *chunk;
+	unsigned long count = 0;
+	long long number;
+	int begin, end;
+
+	if(column < 0 || column >= store->columns) {
+
+		printf("Error while count column store: column %d of %d columns\n", column, store->columns);
+		exit(1);
+	}
+
+	number = store->started > store->chunks ? store->started - store->chunks : 0;
+
+	for(; number<store->started; number++) {
+
+		chunk = col_chunk_at(store, number);
+
+		if(chunk->last < from)
+			continue;
+
+		if(chunk->first > to)
+			break;
+
+		// Zone map: no value in the range
+		if(chunk->max[column] < low || chunk->min[column] > high)
+			continue;
+
+		begin = col_lower_bound(chunk, from);
+		end   = col_upper_bound(chunk, to);
+
+		if(begin >= end)
+			continue;
+
+		// Zone map: all values in the range
+		if(chunk->min[column] >= low && chunk->max[column] <= high && begin == 0 && end == chunk->count)
+			count += chunk->count;
+		else
+			count += col_count_range(&chunk->value[column][begin], end - begin, low, high);
+	}
+
+	return count;
+}
+
+
+/**
+ * Chunk of a number (internal function)
+ */
+static inline const struct col_chunk *col_chunk_at(const struct col_store *store, long long number) {
+
+	return &store->chunk[number % store->chunks];
+}
+
+
+/**
+ * First row of a chunk at or after time (internal function)
+ */
+static inline int col_lower_bound(const struct col_chunk *chunk, long long time) {
+
+	int low = 0, high = chunk->count, middle;
+
+	while(low < high) {
+
+		middle = (low + high) / 2;
+
+		if(chunk->time[middle] < time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+
+/**
+ * First row of a chunk after time, count if there is none (internal
+ * function)
+ */
+static inline int col_upper_bound(const struct col_chunk *chunk, long long time) {
+
+	int low = 0, high = chunk->count, middle;
+
+	while(low < high) {
+
+		middle = (low + high) / 2;
+
+		if(chunk->time[middle] <= time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+
+/**
+ * Sum, min and max of count values, count > 0 (internal function)
+ * Partial sums are float in the lanes, each holds at most COL_CHUNK /
+ * COL_VECTOR values.
+ */
+static inline void col_scan(const float *value, int count, double *sum, float *min, float *max) {
+
+	float lane_min, lane_max;
+	double total = 0;
+	int i = 0, j;
+#ifdef COL_VECTOR
+	col_vf32 v, s, lo, hi;
+	col_vs32 mask;
+#endif
+
+	lane_min = value[0];
+	lane_max = value[0];
+
+#ifdef COL_VECTOR
+	if(count >= COL_VECTOR) {
+
+		memcpy(&lo, value, sizeof(lo));
+		hi = lo;
+		s  = lo - lo;
+
+		for(; i + COL_VECTOR <= count; i += COL_VECTOR) {
+
+			memcpy(&v, &value[i], sizeof(v));
+
+			s += v;
+
+			// Select by mask, C has no ?: on vectors
+			mask = v < lo;
+			lo   = (col_vf32)(((col_vs32)v & mask) | ((col_vs32)lo & ~mask));
+			mask = v > hi;
+			hi   = (col_vf32)(((col_vs32)v & mask) | ((col_vs32)hi & ~mask));
+		}
+
+		for(j=0; j<COL_VECTOR; j++) {
+
+			total += s[j];
+
+			if(lo[j] < lane_min)
+				lane_min = lo[j];
+
+			if(hi[j] > lane_max)
+				lane_max = hi[j];
+		}
+	}
+#endif
+
+	for(; i<count; i++) {
+
+		total += value[i];
+
+		if(value[i] < lane_min)
+			lane_min = value[i];
+
+		if(value[i] > lane_max)
+			lane_max = value[i];
+	}
+
+	*sum = total;
+	*min = lane_min;
+	*max = lane_max;
+}
+
+
+/**
+ * Number of values with low <= value <= high (internal function)
+ */
+static inline int col_count_range(const float *value, int count, float low, float high) {
+
+	int i = 0, j, result = 0;
+
+#ifdef COL_VECTOR
+	col_vf32 v;
+	col_vs32 hits = { 0 };
+
+	for(; i + COL_VECTOR <= count; i += COL_VECTOR) {
+
+		memcpy(&v, &value[i], sizeof(v));
+
+		// A true lane is -1
+		hits -= (v >= low) & (v <= high);
+	}
+
+	for(j=0; j<COL_VECTOR; j++)
+		result += hits[j];
+#else
+	(void)j;
+#endif
+
+	for(; i<count; i++)
+		result += value[i] >= low && value[i] <= high;
+
+	return result;
+}
+
+
+#endif /* LIBCOLUMN_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBCOLUMN_BMP085_)
+#define LIBCOLUMN_BMP085_
+
+#define COL_BMP085_TEMPERATURE 0   ///< Columns of a BMP085 store
+#define COL_BMP085_PRESSURE    1
+#define COL_BMP085_ALTITUDE    2
+
+/**
+ * Append a BMP085 sample to a store of 3 columns
+ */
+static inline void col_append_bmp085(struct col_store *store, long long time, const struct bmp085_value *value) {
+
+	float values[3];
+
+	values[COL_BMP085_TEMPERATURE] = value->temperature;
+	values[COL_BMP085_PRESSURE]    = value->pressure;
+	values[COL_BMP085_ALTITUDE]    = value->altitude;
+
+	col_append(store, time, values);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBCOLUMN_HIH6130_)
+#define LIBCOLUMN_HIH6130_
+
+#define COL_HIH6130_HUMIDITY    0   ///< Columns of a HIH6130 store
+#define COL_HIH6130_TEMPERATURE 1
+
+/**
+ * Append a HIH6130 sample to a store of 2 columns, stale samples are
+ * left out
+ */
+static inline void col_append_hih6130(struct col_store *store, long long time, const struct hih6130_value *value) {
+
+	float values[2];
+
+	if(value->status != HIH6130_STATUS_NORMAL)
+		return;
+
+	values[COL_HIH6130_HUMIDITY]    = value->humidity;
+	values[COL_HIH6130_TEMPERATURE] = value->temperature;
+
+	col_append(store, time, values);
+}
+
+#endif
@@ -0,0 +1,527 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libfilter.h is a sliding median and Hampel filter for sample streams,
+ *  e.g. to keep a single bad pressure reading out of a control loop.
+ *
+ *  The last window samples are kept sorted in an indexable skiplist: a
+ *  skiplist whose links also count the elements they skip, so the k-th
+ *  smallest is found in O(log window) like an insert or a removal. A
+ *  sample costs one removal, one insert and the median lookup.
+ *
+ *  The Hampel filter replaces a sample by the median when it is further
+ *  than threshold * 1.4826 * MAD from it, 1.4826 * MAD being a robust
+ *  estimate of the standard deviation. The MAD, the median of the
+ *  absolute deviations from the median, is the k-th smallest of two
+ *  sorted sequences (the samples below and above the median), found by
+ *  binary search in O(log^2 window).
+ *
+ *  filter_init() filters float values, filter_init_int() integer (fixed
+ *  point) readings such as the raw UP of a BMP085 with integer median
+ *  and MAD. Memory is fixed and supplied by the caller: window + 1 nodes
+ *  of 40 bytes and a ring of window keys.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBFILTER_H_
+#define LIBFILTER_H_
+
+#define FILTER_LEVELS     8        ///< Skiplist levels, links skip 4^level elements on average
+#define FILTER_MAX_WINDOW 65534    ///< Largest window, links are 16 bit
+#define FILTER_NIL        0xFFFF   ///< End of a skiplist level
+#define FILTER_MAD_SCALE  1.4826   ///< MAD to standard deviation of a normal distribution
+
+
+/** FUNCTION DEFINITONS **/
+
+struct filter;
+struct filter_node;
+
+void filter_init(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold);
+void filter_init_int(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold);
+float filter_update(struct filter *filter, float value);
+int filter_update_int(struct filter *filter, int value);
+float filter_median(const struct filter *filter);
+int filter_median_int(const struct filter *filter);
+double filter_mad(const struct filter *filter);
+
+static inline void filter_setup(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold, unsigned char fixed);
+static inline int filter_push(struct filter *filter, unsigned int key);
+static inline void filter_insert(struct filter *filter, unsigned int key);
+static inline void filter_remove(struct filter *filter, unsigned int key);
+static inline unsigned int filter_at(const struct filter *filter, int rank);
+static inline double filter_value(const struct filter *filter, unsigned int key);
+static inline double filter_middle(const struct filter *filter);
+static inline double filter_deviation(const struct filter *filter, double median, int split, int k);
+static inline unsigned int filter_key_float(float value);
+static inline float filter_float_key(unsigned int key);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Skiplist node, node 0 is the head
+ * 	key:   sample as unsigned key with the order of the values
+ * 	level: levels the node is linked in
+ * 	next:  next node by level
+ * 	width: elements the link skips + 1
+ */
+struct filter_node {
+	unsigned int key;
+	unsigned char level;
+	unsigned short next[FILTER_LEVELS];
+	unsigned short width[FILTER_LEVELS];
+};
+
+
+/**
+ * A filter
+ * 	ring:      keys of the window in arrival order
+ * 	size:      samples in the window
+ * 	oldest:    ring position of the oldest sample
+ * 	used:      nodes taken so far, a removal frees spare
+ * 	threshold: outlier threshold in standard deviations, 0 for the median
+ * 	           only
+ * 	random:    xorshift state for the node levels
+ * 	rejected:  samples replaced by the median
+ */
+struct filter {
+	struct filter_node *node;
+	unsigned int *ring;
+	int window;
+	int size;
+	int oldest;
+	int used;
+	int spare;
+	float threshold;
+	unsigned char fixed;
+	unsigned int random;
+	unsigned long samples;
+	unsigned long rejected;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/**
+ * Initialize a filter of float values
+ * \param node Array of window + 1 nodes
+ * \param ring Array of window keys
+ * \param threshold Outlier threshold in standard deviations (3 is the
+ * usual choice), 0 for a plain sliding median
+ */
+void filter_init(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold) {
+
+	filter_setup(filter, node, ring, window, threshold, 0);
+}
+
+
+/**
+ * Initialize a filter of integer values, arguments as filter_init()
+ */
+void filter_init_int(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold) {
+
+	filter_setup(filter, node, ring, window, threshold, 1);
+}
+
+
+/**
+ * Add a float sample
+ * \return The sample, or the median if it is an outlier
+ */
+float filter_update(struct filter *filter, float value) {
+
+	if(filter_push(filter, filter_key_float(value)))
+		return filter_median(filter);
+
+	return value;
+}
+
+
+/**
+ * Add an integer sample
+ * \return The sample, or the median if it is an outlier
+ */
+int filter_update_int(struct filter *filter, int value) {
+
+	if(filter_push(filter, (unsigned int)value ^ 0x80000000u))
+		return filter_median_int(filter);
+
+	return value;
+}
+
+
+/**
+ * Median of the window, the mean of the middle two for an even size
+ */
+float filter_median(const struct filter *filter) {
+
+	return (float)filter_middle(filter);
+}
+
+
+/**
+ * Median of the window, rounded down for an even size
+ */
+int filter_median_int(const struct filter *filter) {
+
+	return (int)floor(filter_middle(filter));
+}
+
+
+/**
+ * Median absolute deviation from the median of the window
+ */
+double filter_mad(const struct filter *filter) {
+
+	double median, mad;
+	int n = filter->size;
+
+	if(n == 0)
+		return 0;
+
+	median = filter->fixed ? floor(filter_middle(filter)) : filter_middle(filter);
+	mad    = filter_deviation(filter, median, n / 2, (n - 1) / 2);
+
+	if(n % 2 == 0)
+		mad = (mad + filter_deviation(filter, median, n / 2, n / 2)) / 2;
+
+	return filter->fixed ? floor(mad) : mad;
+}
+
+
+/**
+ * Common part of the init functions (internal function)
+ */
+static inline void filter_setup(struct filter *filter, struct filter_node *node, unsigned int *ring, int window, float threshold, unsigned char fixed) {
+
+	int level;
+
+	if(window < 1 || window > FILTER_MAX_WINDOW) {
+
+		printf("Error while init filter: window %d not in 1..%d\n", window, FILTER_MAX_WINDOW);
+		exit(1);
+	}
+
+	memset(filter, 0, sizeof(*filter));
+
+	filter->node      = node;
+	filter->ring      = ring;
+	filter->window    = window;
+	filter->used      = 1;
+	filter->spare     = -1;
+	filter->threshold = threshold;
+	filter->fixed     = fixed;
+	filter->random    = 2463534242u;
+
+	// Empty list: the head links to the end, one step past the last element
+	node[0].level = FILTER_LEVELS;
+
+	for(level=0; level<FILTER_LEVELS; level++) {
+
+		node[0].next[level]  = FILTER_NIL;
+		node[0].width[level] = 1;
+	}
+}
+
+
+/**
+ * Slide the window by a key (internal function)
+ * \return 1 if the sample is an outlier
+ */
+static inline int filter_push(struct filter *filter, unsigned int key) {
+
+	double value, median, mad;
+
+	filter->samples++;
+
+	if(filter->size == filter->window) {
+
+		filter_remove(filter, filter->ring[filter->oldest]);
+
+		filter->ring[filter->oldest] = key;
+		filter->oldest = (filter->oldest + 1) % filter->window;
+	}
+	else {
+
+		filter->ring[filter->size] = key;
+		filter->size++;
+	}
+
+	filter_insert(filter, key);
+
+	if(filter->threshold <= 0 || filter->size < 3)
+		return 0;
+
+	value  = filter_value(filter, key);
+	median = filter->fixed ? floor(filter_middle(filter)) : filter_middle(filter);
+
+	// The MAD is only needed for a sample away from the median
+	if(value == median)
+		return 0;
+
+	mad = filter_mad(filter);
+
+	if(fabs(value - median) <= filter->threshold * FILTER_MAD_SCALE * mad)
+		return 0;
+
+	filter->rejected++;
+
+	return 1;
+}
+
+
+/**
+ * Insert a key, equal keys after the present ones (internal function)
+ */
+static inline void filter_insert(struct filter *filter, unsigned int key) {
+
+	struct filter_node *node = filter->node;
+	unsigned short chain[FILTER_LEVELS];
+	int steps[FILTER_LEVELS];
+	int level, height, current, fresh, total;
+
+	current = 0;
+	total   = 0;
+
+	for(level=FILTER_LEVELS-1; level>=0; level--) {
+
+		while(node[current].next[level] != FILTER_NIL && node[node[current].next[level]].key <= key) {
+
+			total  += node[current].width[level];
+			current = node[current].next[level];
+		}
+
+		chain[level] = current;
+		steps[level] = total;
+	}
+
+	// Level with probability 4^-level
+	filter->random ^= filter->random << 13;
+	filter->random ^= filter->random >> 17;
+	filter->random ^= filter->random << 5;
+
+	for(height=1; height<FILTER_LEVELS && ((filter->random >> (2 * height)) & 3) == 0; height++);
+
+	if(filter->spare >= 0) {
+
+		fresh = filter->spare;
+		filter->spare = -1;
+	}
+	else {
+
+		fresh = filter->used++;
+	}
+
+	node[fresh].key   = key;
+	node[fresh].level = height;
+
+	for(level=0; level<height; level++) {
+
+		node[fresh].next[level]  = node[chain[level]].next[level];
+		node[fresh].width[level] = node[chain[level]].width[level] - (total - steps[level]);
+
+		node[chain[level]].next[level]  = fresh;
+		node[chain[level]].width[level] = total - steps[level] + 1;
+	}
+
+	for(; level<FILTER_LEVELS; level++)
+		node[chain[level]].width[level]++;
+}
+
+
+/**
+ * Remove one element of a key (internal function)
+ */
+static inline void filter_remove(struct filter *filter, unsigned int key) {
+
+	struct filter_node *node = filter->node;
+	unsigned short chain[FILTER_LEVELS];
+	int level, current, target;
+
+	current = 0;
+
+	for(level=FILTER_LEVELS-1; level>=0; level--) {
+
+		while(node[current].next[level] != FILTER_NIL && node[node[current].next[level]].key < key)
+			current = node[current].next[level];
+
+		chain[level] = current;
+	}
+
+	// The first element of the key, it is linked after chain on all its levels
+	target = node[chain[0]].next[0];
+
+	for(level=0; level<node[target].level; level++) {
+
+		node[chain[level]].width[level] += node[target].width[level] - 1;
+		node[chain[level]].next[level]   = node[target].next[level];
+	}
+
+	for(; level<FILTER_LEVELS; level++)
+		node[chain[level]].width[level]--;
+
+	filter->spare = target;
+}
+
+
+/**
+ * Key of rank 0..size-1 (internal function)
+ */
+static inline unsigned int filter_at(const struct filter *filter, int rank) {
+
+	const struct filter_node *node = filter->node;
+	int level, current = 0;
+
+	rank++;
+
+	for(level=FILTER_LEVELS-1; level>=0; level--) {
+
+		while(node[current].width[level] <= rank) {
+
+			rank   -= node[current].width[level];
+			current = node[current].next[level];
+		}
+	}
+
+	return node[current].key;
+}
+
+
+/**
+ * Value of a key (internal function)
+ */
+static inline double filter_value(const struct filter *filter, unsigned int key) {
+
+	if(filter->fixed)
+		return (double)(int)(key ^ 0x80000000u);
+
+	return (double)filter_float_key(key);
+}
+
+
+/**
+ * Median of the window, exact (internal function)
+ */
+static inline double filter_middle(const struct filter *filter) {
+
+	int n = filter->size;
+
+	if(n == 0)
+		return 0;
+
+	if(n % 2)
+		return filter_value(filter, filter_at(filter, n / 2));
+
+	return (filter_value(filter, filter_at(filter, n / 2 - 1)) + filter_value(filter, filter_at(filter, n / 2))) / 2;
+}
+
+
+/**
+ * k-th smallest absolute deviation from the median (internal function)
+ * Ranks below split are not above the median, their deviations grow
+ * downwards (a), the others grow upwards (b). Binary search for the
+ * number i of deviations taken from a.
+ */
+static inline double filter_deviation(const struct filter *filter, double median, int split, int k) {
+
+	int low, high, i, j;
+	double a_last, a_next, b_last, b_next;
+
+	#define FILTER_A(index) (median - filter_value(filter, filter_at(filter, split - 1 - (index))))
+	#define FILTER_B(index) (filter_value(filter, filter_at(filter, split + (index))) - median)
+
+	low  = k + 1 - (filter->size - split);
+	high = k + 1 < split ? k + 1 : split;
+
+	if(low < 0)
+		low = 0;
+
+	for(;;) {
+
+		i = (low + high) / 2;
+		j = k + 1 - i;
+
+		a_last = i > 0 ? FILTER_A(i - 1) : -HUGE_VAL;
+		a_next = i < split ? FILTER_A(i) : HUGE_VAL;
+		b_last = j > 0 ? FILTER_B(j - 1) : -HUGE_VAL;
+		b_next = j < filter->size - split ? FILTER_B(j) : HUGE_VAL;
+
+		if(a_last > b_next)
+			high = i - 1;
+		else if(b_last > a_next)
+			low = i + 1;
+		else
+			return a_last > b_last ? a_last : b_last;
+	}
+
+	#undef FILTER_A
+	#undef FILTER_B
+}
+
+
+/**
+ * Float as unsigned key of the same order (internal function)
+ */
+static inline unsigned int filter_key_float(float value) {
+
+	unsigned int bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+
+/**
+ * Inverse of filter_key_float() (internal function)
+ */
+static inline float filter_float_key(unsigned int key) {
+
+	unsigned int bits;
+	float value;
+
+	bits = (key & 0x80000000u) ? key & 0x7FFFFFFFu : ~key;
+
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+
+#endif /* LIBFILTER_H_ */
@@ -0,0 +1,337 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libflight.h coalesces concurrent reads of the same sensor.
+ *
+ *  If several threads call bmp085_get_values() or hih6130_get_value() at
+ *  about the same time, every call runs its own conversion and the bus
+ *  serialises them, so the last caller waits for all of them. Reading
+ *  through a struct flight instead, only the first caller measures; the
+ *  callers arriving while that conversion is in flight wait for it and
+ *  all get its result. A result not older than the freshness window is
+ *  returned right away. The number of conversions follows the sampling
+ *  rate, not the number of consumers.
+ *
+ *  Note that a caller joining a conversion in flight gets a sample that
+ *  was started before its call, at most one conversion time earlier. Use
+ *  a window of 0 if only that may be reused.
+ *
+ *  One struct flight covers one device; all quantities of a device come
+ *  from the same conversion (the BMP085 pressure needs the temperature
+ *  anyway). Adapters for the BMP085 and the HIH6130 are defined when
+ *  their headers are included first.
+ *
+ *  Link with -lpthread.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBFLIGHT_H_
+#define LIBFLIGHT_H_
+
+#include <time.h>
+#include <pthread.h>
+
+#define FLIGHT_MAX_VALUE 64  ///< Largest sample struct in bytes
+
+
+/** FUNCTION DEFINITONS **/
+
+struct flight;
+
+void flight_init(struct flight *flight, int (*measure)(void *dev, void *value), void *dev, size_t size, long window);
+void flight_destroy(struct flight *flight);
+int flight_get(struct flight *flight, void *value);
+
+static inline long flight_age(const struct timespec *since);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Shared reads of one device
+ * 	measure:     blocking measurement into value, returns < 0 on error
+ * 	dev:         passed to measure(), may be NULL for the global API
+ * 	size:        bytes of the sample struct
+ * 	window:      us a result is served without a new conversion
+ * 	inflight:    a conversion is running
+ * 	generation:  incremented with every finished conversion
+ * 	time:        CLOCK_MONOTONIC time the last conversion finished
+ * 	valid:       value holds a result
+ * 	result:      return value of the last measure()
+ * 	value:       last result, aligned for any sample struct
+ * 	requests:    flight_get() calls
+ * 	conversions: measure() calls
+ * 	joined:      requests that waited for a conversion of another caller
+ * 	cached:      requests served from the window
+ */
+struct flight {
+	pthread_mutex_t lock;
+	pthread_cond_t landed;
+	int (*measure)(void *dev, void *value);
+	void *dev;
+	size_t size;
+	long window;
+	unsigned char inflight;
+	unsigned long generation;
+	struct timespec time;
+	unsigned char valid;
+	int result;
+	unsigned char value[FLIGHT_MAX_VALUE] __attribute__((aligned));
+	unsigned long requests;
+	unsigned long conversions;
+	unsigned long joined;
+	unsigned long cached;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Set up shared reads of a device
+ * \param measure Blocking measurement, e.g. flight_hih6130_measure
+ * \param size Size of the sample struct, at most FLIGHT_MAX_VALUE
+ * \param window Freshness window in us, 0 only shares conversions in flight
+ */
+void flight_init(struct flight *flight, int (*measure)(void *dev, void *value), void *dev, size_t size, long window) {
+
+	if(size > FLIGHT_MAX_VALUE) {
+
+		printf("Error while set up flight: sample of %zu bytes, at most %d are possible\n", size, FLIGHT_MAX_VALUE);
+		exit(1);
+	}
+
+	memset(flight, 0, sizeof(*flight));
+
+	pthread_mutex_init(&flight->lock, NULL);
+	pthread_cond_init(&flight->landed, NULL);
+
+	flight->measure = measure;
+	flight->dev     = dev;
+	flight->size    = size;
+	flight->window  = window;
+}
+
+
+/**
+ * Release the lock and condition of a flight
+ */
+void flight_destroy(struct flight *flight) {
+
+	pthread_cond_destroy(&flight->landed);
+	pthread_mutex_destroy(&flight->lock);
+}
+
+
+/**
+ * Read a device, sharing the conversion with concurrent callers
+ * \param value Receives the sample
+ * \return The return value of measure() for the sample
+ */
+int flight_get(struct flight *flight, void *value) {
+
+	// measure() stores a sample struct here, aligned for any type
+	unsigned char sample[FLIGHT_MAX_VALUE] __attribute__((aligned));
+	unsigned long generation;
+	int result;
+
+	pthread_mutex_lock(&flight->lock);
+
+	flight->requests++;
+
+	// Fresh enough, no conversion at all
+	if(flight->valid && !flight->inflight && flight_age(&flight->time) <= flight->window) {
+
+		flight->cached++;
+		goto copy;
+	}
+
+	// Join the conversion in flight
+	if(flight->inflight) {
+
+		generation = flight->generation;
+		flight->joined++;
+
+		while(flight->generation == generation)
+			pthread_cond_wait(&flight->landed, &flight->lock);
+
+		goto copy;
+	}
+
+	// Lead a new conversion, without holding the lock on the bus
+	flight->inflight = 1;
+	flight->conversions++;
+
+	pthread_mutex_unlock(&flight->lock);
+
+	result = flight->measure(flight->dev, sample);
+
+	pthread_mutex_lock(&flight->lock);
+
+	memcpy(flight->value, sample, flight->size);
+	clock_gettime(CLOCK_MONOTONIC, &flight->time);
+
+	flight->result   = result;
+	flight->valid    = 1;
+	flight->inflight = 0;
+	flight->generation++;
+
+	pthread_cond_broadcast(&flight->landed);
+
+copy:
+	memcpy(value, flight->value, flight->size);
+	result = flight->result;
+
+	pthread_mutex_unlock(&flight->lock);
+
+	return result;
+}
+
+
+/**
+ * Micro seconds elapsed since a CLOCK_MONOTONIC time (internal function)
+ */
+static inline long flight_age(const struct timespec *since) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - since->tv_sec) * 1000000L
+		 + (now.tv_nsec - since->tv_nsec) / 1000L;
+}
+
+
+#endif /* LIBFLIGHT_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. dev is NULL for the global API of the driver or a handle.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBFLIGHT_BMP085_)
+#define LIBFLIGHT_BMP085_
+
+/**
+ * measure() of a BMP085, dev is NULL or a struct bmp085_device
+ */
+static inline int flight_bmp085_measure(void *dev, void *value) {
+
+	struct bmp085_device *handle = dev;
+	long wait;
+
+	if(handle == NULL) {
+
+		*(struct bmp085_value *)value = bmp085_get_values();
+		return 0;
+	}
+
+	while(!bmp085_poll_value(handle, (struct bmp085_value *)value)) {
+
+		if((wait = bmp085_time_to_ready(handle)) > 0)
+			usleep(wait);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Shared reads of a BMP085, dev is NULL for the global API
+ */
+static inline void flight_init_bmp085(struct flight *flight, struct bmp085_device *dev, long window) {
+
+	flight_init(flight, flight_bmp085_measure, dev, sizeof(struct bmp085_value), window);
+}
+
+
+/**
+ * Get temperature, pressure and altitude through a flight
+ */
+static inline struct bmp085_value flight_bmp085_get(struct flight *flight) {
+
+	struct bmp085_value value;
+
+	flight_get(flight, &value);
+
+	return value;
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBFLIGHT_HIH6130_)
+#define LIBFLIGHT_HIH6130_
+
+/**
+ * measure() of a HIH6130, dev is NULL or a struct hih6130_device
+ * \return The status bits of the sample
+ */
+static inline int flight_hih6130_measure(void *dev, void *value) {
+
+	struct hih6130_value *sample = value;
+
+	if(dev == NULL)
+		*sample = hih6130_get_value();
+	else
+		*sample = hih6130_read_value((struct hih6130_device *)dev);
+
+	return sample->status;
+}
+
+
+/**
+ * Shared reads of a HIH6130, dev is NULL for the global API
+ */
+static inline void flight_init_hih6130(struct flight *flight, struct hih6130_device *dev, long window) {
+
+	flight_init(flight, flight_hih6130_measure, dev, sizeof(struct hih6130_value), window);
+}
+
+
+/**
+ * Get temperature and humidity through a flight
+ */
+static inline struct hih6130_value flight_hih6130_get(struct flight *flight) {
+
+	struct hih6130_value value;
+
+	flight_get(flight, &value);
+
+	return value;
+}
+
+#endif
@@ -38,6 +38,8 @@
 #ifndef HIH6130_H_
 #define HIH6130_H_
 
+#include <time.h>
+
 #define HIH6130_STATUS_NORMAL  0
 #define HIH6130_STATUS_STALE   1
 #define HIH6130_STATUS_COMMAND 2
@@ -47,9 +49,50 @@
 #define HIH6130_ALARM_LOW_ON   0x1A
 #define HIH6130_ALARM_LOW_OFF  0x1B
 
+#define HIH6130_CMD_START_CM   0xA0  ///< Enter command mode (within 10 ms after power on)
+#define HIH6130_CMD_START_NOM  0x80  ///< Leave command mode
+#define HIH6130_CMD_WRITE      0x40  ///< Added to an EEPROM register to write it
+#define HIH6130_EEPROM_WRITE_TIME 12000 ///< EEPROM write time in us
+
+#define HIH6130_ALARM_HIGH     0x01  ///< High alarm bit of struct hih6130_alarm
+#define HIH6130_ALARM_LOW      0x02  ///< Low alarm bit of struct hih6130_alarm
+
+#define HIH6130_MEASUREMENT_TIME 37000  ///< Measurement cycle in us (typ. 36.65 ms)
+#define HIH6130_MEASUREMENT_DEV  2000   ///< Initial deviation of the measurement cycle in us
+#define HIH6130_POLL_MIN_STEP    250    ///< Shortest wait in us between two polls
+#define HIH6130_POLL_MAX_STEP    5000   ///< Longest wait in us between two polls
+#define HIH6130_POLL_TIMEOUT     100000 ///< Polling gives up this many us after the request
+
+#define HIH6130_CENTI_RH_MUL 40005 ///< 10000/16382 in Q16, raw humidity to 0.01 %RH
+#define HIH6130_CENTI_C_MUL  66008 ///< 16500/16382 in Q16, raw temperature to 0.01 deg C
+
+/*
+ * Batch decoding uses GCC vector extensions, which map to SSE2/AVX on x86
+ * and NEON on ARM. Other compilers and big endian hosts use the scalar
+ * functions. The float results are bit exact with hih6130_calc_*() as long
+ * as the compiler does not contract the temperature formula into a fused
+ * multiply-add differently for both (-ffp-contract=off on FMA targets).
+ */
+#if defined(__GNUC__) && (__GNUC__ >= 9 || defined(__clang__)) \
+ && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HIH6130_VECTOR 4
+typedef unsigned int hih6130_vu32 __attribute__((vector_size(16)));
+typedef int hih6130_vs32 __attribute__((vector_size(16)));
+typedef float hih6130_vf32 __attribute__((vector_size(16)));
+typedef short hih6130_vs16 __attribute__((vector_size(8)));
+typedef unsigned char hih6130_vu8 __attribute__((vector_size(4)));
+#endif
+
 /** FUNCTION DEFINITONS **/
 
+struct hih6130_value;
+struct hih6130_device;
+struct hih6130_cache;
+struct hih6130_model;
+struct hih6130_alarm;
+
 static inline int hih_i2c_open(__u8 addr);
+static inline int hih_i2c_open_device(__u8 device, __u8 addr);
 
 struct hih6130_value hih6130_get_value(void);
 float hih6130_get_humidity(void);
@@ -61,13 +104,47 @@ float hih6130_get_command(unsigned char register_no);
 void hih6130_set_command(unsigned char register_no, double humidity);
 
 unsigned char hih6130_get_data(__u8 *data, int length);
+unsigned char hih6130_read_frame(int fd, __u8 *data, int length);
 
-float hih6130_calc_temperature(__u8 *data);
-float hih6130_calc_humidity(__u8 *data);
+float hih6130_calc_temperature(const __u8 *data);
+float hih6130_calc_humidity(const __u8 *data);
+short hih6130_calc_temperature_centi(const __u8 *data);
+short hih6130_calc_humidity_centi(const __u8 *data);
+
+void hih6130_decode_frames(const __u8 *frames, int count, unsigned char *status, float *humidity, float *temperature);
+void hih6130_decode_frames_centi(const __u8 *frames, int count, unsigned char *status, short *humidity, short *temperature);
 void hih6130_calc_hex_humidity(float humidity, __u8 *data);
 
 unsigned char hih6130_calc_status(int fd, int stausbit);
 
+void hih6130_open(struct hih6130_device *dev, __u8 i2c_device, __u8 i2c_address, unsigned char pipelined);
+void hih6130_close(struct hih6130_device *dev);
+void hih6130_request_measurement(struct hih6130_device *dev);
+unsigned char hih6130_fetch_frame(struct hih6130_device *dev, __u8 *data, int length);
+long hih6130_time_to_ready(struct hih6130_device *dev);
+int hih6130_poll_value(struct hih6130_device *dev, struct hih6130_value *value);
+struct hih6130_value hih6130_read_value(struct hih6130_device *dev);
+
+struct hih6130_value hih6130_get_cached_value(struct hih6130_device *dev, long max_age);
+float hih6130_get_cached_humidity(struct hih6130_device *dev, long max_age);
+float hih6130_get_cached_temperature(struct hih6130_device *dev, long max_age);
+
+static inline long long hih6130_elapsed(const struct timespec *since);
+static inline int hih6130_cache_lookup(struct hih6130_cache *cache, long max_age, struct hih6130_value *value);
+static inline void hih6130_cache_store(struct hih6130_cache *cache, const struct hih6130_value *value);
+
+void hih6130_alarm_program(struct hih6130_device *dev, float high_on, float high_off, float low_on, float low_off);
+void hih6130_alarm_init(struct hih6130_alarm *alarm, struct hih6130_device *dev,
+		float high_on, float high_off, float low_on, float low_off, int high_fd, int low_fd);
+int hih6130_alarm_wait(struct hih6130_alarm *alarm, int timeout, struct hih6130_value *value);
+static inline unsigned char hih6130_alarm_state(const struct hih6130_alarm *alarm, unsigned char state, float humidity);
+
+static inline unsigned char hih6130_wait_frame(struct hih6130_device *dev, __u8 *data, int length);
+static inline void hih6130_model_init(struct hih6130_model *model);
+static inline long hih6130_model_first_poll(const struct hih6130_model *model);
+static inline long hih6130_model_step(const struct hih6130_model *model);
+static inline void hih6130_model_learn(struct hih6130_model *model, long last_stale, long scheduled, long fetched);
+
 
 /** TYPE DEFINITIONS **/
 
@@ -78,6 +155,105 @@ struct hih6130_value {
 };
 
 
+/**
+ * Last published sample of a sensor
+ * 	value:  last fresh (status normal) sample
+ * 	time:   CLOCK_MONOTONIC time the sample was fetched
+ * 	valid:  value holds a sample
+ * 	hits:   getter calls served from the cache
+ * 	misses: getter calls that needed a new measurement
+ * 	stale:  stale frames that were neither decoded nor published
+ */
+struct hih6130_cache {
+	struct hih6130_value value;
+	struct timespec time;
+	unsigned char valid;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long stale;
+};
+
+
+/**
+ * Learned conversion time of a sensor
+ * 	mean:     EWMA (1/8) of the conversion time in us
+ * 	dev:      EWMA (1/4) of the absolute deviation from mean in us
+ * 	samples:  conversions the model learned from
+ * 	fetches:  completed measurements
+ * 	polls:    frame reads of all measurements (polls/fetches per sample)
+ * 	timeouts: measurements given up after HIH6130_POLL_TIMEOUT
+ */
+struct hih6130_model {
+	long mean;
+	long dev;
+	unsigned long samples;
+	unsigned long fetches;
+	unsigned long polls;
+	unsigned long timeouts;
+};
+
+
+/**
+ * Handle of one sensor for the split request/fetch API
+ * 	fd:        open i2c line, addressed to the sensor
+ * 	pipelined: send the next measurement request right after each fetch
+ * 	pending:   a measurement request is outstanding
+ * 	requested: CLOCK_MONOTONIC time of the last measurement request
+ * 	cache:     last published sample and cache counters
+ * 	model:     learned conversion time
+ * 	next_poll: us after the request when the frame is read next
+ * 	last_stale: us after the request of the last stale read, -1 if none
+ */
+struct hih6130_device {
+	int fd;
+	__u8 i2c_device;
+	__u8 i2c_address;
+	unsigned char pipelined;
+	unsigned char pending;
+	struct timespec requested;
+	struct hih6130_cache cache;
+	struct hih6130_model model;
+	long next_poll;
+	long last_stale;
+};
+
+
+
+/**
+ * Humidity threshold subscription
+ * 	dev:       sensor, read to confirm an alarm edge and for the emulation
+ * 	high_on:   high alarm is set above this humidity (%RH)
+ * 	high_off:  high alarm is cleared below this humidity
+ * 	low_on:    low alarm is set below this humidity
+ * 	low_off:   low alarm is cleared above this humidity
+ * 	high_fd:   pollable fd of the AL_H output (GPIO line events), -1 if
+ * 	           not wired
+ * 	low_fd:    pollable fd of the AL_L output, -1 if not wired
+ * 	interval:  sampling interval in us of the emulation, or interval of
+ * 	           the measurement requests that update wired outputs
+ * 	state:     active alarms, HIH6130_ALARM_HIGH | HIH6130_ALARM_LOW
+ * 	wakeups:   returns of hih6130_alarm_wait() with a changed state
+ * 	events:    edges seen on the alarm outputs
+ * 	samples:   sensor reads done on behalf of the subscription
+ * 	requests:  measurement requests sent to update wired outputs
+ */
+struct hih6130_alarm {
+	struct hih6130_device *dev;
+	float high_on;
+	float high_off;
+	float low_on;
+	float low_off;
+	int high_fd;
+	int low_fd;
+	long interval;
+	unsigned char state;
+	unsigned long wakeups;
+	unsigned long events;
+	unsigned long samples;
+	unsigned long requests;
+};
+
+
 
 /** RUNTIME VARIABLES **/
 
@@ -96,15 +272,55 @@ __u8 hih6130_i2c_device = 1;
 __u8 hih6130_i2c_address = 0x27;
 
 
+/**
+ * Maximum age in us of a cached sample served by hih6130_get_humidity()
+ * and hih6130_get_temperature()
+ * 	default is 0 (every call measures)
+ */
+long hih6130_max_age = 0;
+
+
+/**
+ * Sample cache of the hih6130_get_*() functions
+ */
+struct hih6130_cache hih6130_cache;
+
+
+/**
+ * Learned conversion time of the hih6130_get_*() functions
+ */
+struct hih6130_model hih6130_model = { .mean = HIH6130_MEASUREMENT_TIME, .dev = HIH6130_MEASUREMENT_DEV };
+
+
 
 /** FUNCTIONS **/
 
 #include <stdlib.h>
+#include <math.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 #include "smbus.h"
+#include "libprobe.h"
+
+
+/* TRACE PROBES */
+
+PROBE_SEMAPHORE(hih6130, open_entry);
+PROBE_SEMAPHORE(hih6130, open_return);
+PROBE_SEMAPHORE(hih6130, close);
+PROBE_SEMAPHORE(hih6130, request);
+PROBE_SEMAPHORE(hih6130, read_entry);
+PROBE_SEMAPHORE(hih6130, read_return);
+PROBE_SEMAPHORE(hih6130, fetch);
+PROBE_SEMAPHORE(hih6130, wait_entry);
+PROBE_SEMAPHORE(hih6130, wait_return);
+PROBE_SEMAPHORE(hih6130, humidity_entry);
+PROBE_SEMAPHORE(hih6130, humidity_return);
+PROBE_SEMAPHORE(hih6130, temperature_entry);
+PROBE_SEMAPHORE(hih6130, temperature_return);
 
 
 //
@@ -112,10 +328,21 @@ __u8 hih6130_i2c_address = 0x27;
 //
 static inline int hih_i2c_open(__u8 addr) {
 
+	return hih_i2c_open_device(hih6130_i2c_device, addr);
+}
+
+
+//
+// Open a connection on a given i2C device - Returns a file id
+//
+static inline int hih_i2c_open_device(__u8 device, __u8 addr) {
+
 	int fd;
-	char fn[10];
+	char fn[16];
+
+	PROBE2(hih6130, open_entry, device, addr);
 
-	sprintf(fn, "/dev/i2c-%d", hih6130_i2c_device);
+	sprintf(fn, "/dev/i2c-%d", device);
 
 	// Open port for reading and writing
 	if((fd = open(fn, O_RDWR)) < 0) {
@@ -132,6 +359,8 @@ static inline int hih_i2c_open(__u8 addr) {
 		exit(1);
 	}
 
+	PROBE3(hih6130, open_return, device, addr, fd);
+
 	return fd;
 }
 
@@ -139,6 +368,7 @@ static inline int hih_i2c_open(__u8 addr) {
 /**
  * Get temperature and humidity
  * Values will be returned as struct hih6130_value
+ * (A stale frame returns the last fresh values, NAN before the first one)
  */
 struct hih6130_value hih6130_get_value(void) {
 
@@ -148,12 +378,31 @@ struct hih6130_value hih6130_get_value(void) {
 	// Get the status data
 	value.status = hih6130_get_data(data, sizeof(data));
 
+	// A stale frame repeats the last measurement, it is never decoded:
+	// return the published one, or no values if there is none yet
+	if(value.status == HIH6130_STATUS_STALE) {
+
+		hih6130_cache.stale++;
+
+		if(hih6130_cache.valid)
+			value = hih6130_cache.value;
+		else
+			value.humidity = value.temperature = NAN;
+
+		value.status = HIH6130_STATUS_STALE;
+
+		return value;
+	}
+
 	// Calculate humidity
 	value.humidity = hih6130_calc_humidity(data);
 
 	// Calculate temperature
 	value.temperature = hih6130_calc_temperature(data);
 
+	if(value.status == HIH6130_STATUS_NORMAL)
+		hih6130_cache_store(&hih6130_cache, &value);
+
 	return value;
 }
 
@@ -161,28 +410,35 @@ struct hih6130_value hih6130_get_value(void) {
 /**
  * Get humidity
  * Values will be returned as float in 0.1 Rh
+ * (Served from the last sample if it is younger than hih6130_max_age)
  */
 float hih6130_get_humidity() {
 
-	__u8 data[2];
+	struct hih6130_value value;
 
-	// Get the first two byte of data register
-	hih6130_get_data(data, sizeof(data));
+	if(hih6130_cache_lookup(&hih6130_cache, hih6130_max_age, &value))
+		return value.humidity;
 
-	// Calculate the humidity
-	return hih6130_calc_humidity(data);
+	// Get temperature and humidity data
+	value = hih6130_get_value();
+
+	// Return the humidity data
+	return value.humidity;
 }
 
 
 /**
  * Get humidity
  * Values will be returned as float in 0.1�C
- * (This function also acquire the humidity data but will not return these)
+ * (Served from the last sample if it is younger than hih6130_max_age)
  */
 float hih6130_get_temperature() {
 
 	struct hih6130_value value;
 
+	if(hih6130_cache_lookup(&hih6130_cache, hih6130_max_age, &value))
+		return value.temperature;
+
 	// Get temperature and humidity data
 	value = hih6130_get_value();
 
@@ -205,6 +461,7 @@ unsigned char hih6130_get_status() {
 	// Get sensor status
 	status = hih6130_calc_status(fd, HIH6130_STATUS_NORMAL);
 
+	PROBE1(hih6130, close, fd);
 	close(fd);
 
 	return status;
@@ -213,96 +470,281 @@ unsigned char hih6130_get_status() {
 
 /**
  * Get temperature and humidity data (internal function)
+ * Sends a measurement request and fetches the data frame when the learned
+ * conversion time has passed. The status bits are part of the frame, so a
+ * sample costs one write and one read; the read is repeated only while the
+ * sensor still reports stale data.
  */
 unsigned char hih6130_get_data(__u8 *data, int length) {
 
-	int fd;
+	struct hih6130_device dev;
 	unsigned char status;
 
-	// Open I2C connection
-	fd = hih_i2c_open(hih6130_i2c_address);
+	memset(&dev, 0, sizeof(dev));
 
-	// Get sensor status
-	status = hih6130_calc_status(fd, HIH6130_STATUS_NORMAL);
+	// Open I2C connection
+	dev.fd    = hih_i2c_open(hih6130_i2c_address);
+	dev.model = hih6130_model;
 
-	// Get values if status "Normal Operation" or "Stale Data"
-	if(status <= 1) {
+	// Measurement request and data fetch
+	hih6130_request_measurement(&dev);
+	status = hih6130_wait_frame(&dev, data, length);
 
-		// Read i2c values
-		if(i2c_smbus_read_i2c_block_data(fd, 0x00, length, data) < 0) {
+	hih6130_model = dev.model;
 
-			perror("Error while read I2C block:");
-			close(fd);
-			exit(1);
-		}
-	}
-	else {
+	if(status == HIH6130_STATUS_COMMAND) {
 
 		puts("HIH6130 is in Command Mode!");
-		memset(&data[0], 0, sizeof(data));
+		memset(&data[0], 0, length);
 	}
 
 	// Close line
-	close(fd);
+	PROBE1(hih6130, close, dev.fd);
+	close(dev.fd);
 
 	return status;
 }
 
 
+/**
+ * Read a data frame in one transaction (internal function)
+ * The HIH6130 answers a plain read with status and humidity (2 bytes) or
+ * status, humidity and temperature (4 bytes). Returns the status bits.
+ */
+unsigned char hih6130_read_frame(int fd, __u8 *data, int length) {
+
+	PROBE2(hih6130, read_entry, fd, length);
+
+	if(read(fd, data, length) != length) {
+
+		perror("Error while read HIH6130 data frame:");
+		close(fd);
+		exit(1);
+	}
+
+	PROBE3(hih6130, read_return, fd, length, data[0]>>6);
+
+	return data[0]>>6;
+}
+
+
 /**
  * Calculate the temperature (internal function)
  */
-float hih6130_calc_temperature(__u8 *data) {
+float hih6130_calc_temperature(const __u8 *data) {
 
 	int raw_temp;
+	float temperature;
 
 	// Combine high and low byte, delete last two bits (14bit)
 	raw_temp = (((int)data[2] << 8) + (int)data[3]) >> 2;
 
+	PROBE1(hih6130, temperature_entry, raw_temp);
+
 	// Calculate and return the temperature
-	return ((float)raw_temp) / 16382.0f * 165.0f - 40.0f;
+	temperature = ((float)raw_temp) / 16382.0f * 165.0f - 40.0f;
+
+	// Probe arguments are integers: 0.01 deg C
+	if(PROBE_ENABLED(hih6130, temperature_return))
+		PROBE2(hih6130, temperature_return, raw_temp, (int)(temperature * 100.0f));
+
+	return temperature;
 }
 
 
 /**
  * Calculate the humidity (internal function)
  */
-float hih6130_calc_humidity(__u8 *data) {
+float hih6130_calc_humidity(const __u8 *data) {
 
 	int raw_humy;
+	float humidity;
 
-	// Clear the status bits
-	data[0] &= ~((0x01<<0x07) | (0x01<<0x06));
+	// Combine high and low byte without the status bits
+	raw_humy = (((int)data[0] & 0x3F) << 8) + (int)data[1];
 
-	// Combine high and low byte
-	raw_humy = ((int)data[0] << 8) + (int)data[1];
+	PROBE1(hih6130, humidity_entry, raw_humy);
 
 	// Calculate and return the humidity
-	return ((float)raw_humy) / 163.82f;
+	humidity = ((float)raw_humy) / 163.82f;
+
+	// Probe arguments are integers: 0.01 %RH
+	if(PROBE_ENABLED(hih6130, humidity_return))
+		PROBE2(hih6130, humidity_return, raw_humy, (int)(humidity * 100.0f));
+
+	return humidity;
+}
+
+
+/**
+ * Calculate the temperature in 0.01 deg C with integer arithmetic
+ */
+short hih6130_calc_temperature_centi(const __u8 *data) {
+
+	int raw_temp;
+
+	raw_temp = (((int)data[2] << 8) + (int)data[3]) >> 2;
+
+	return (short)(((raw_temp * HIH6130_CENTI_C_MUL + 0x8000) >> 16) - 4000);
+}
+
+
+/**
+ * Calculate the humidity in 0.01 %RH with integer arithmetic
+ */
+short hih6130_calc_humidity_centi(const __u8 *data) {
+
+	int raw_humy;
+
+	raw_humy = (((int)data[0] & 0x3F) << 8) + (int)data[1];
+
+	return (short)((raw_humy * HIH6130_CENTI_RH_MUL + 0x8000) >> 16);
+}
+
+
+/**
+ * Decode an array of raw 4 byte frames into status, humidity (%RH) and
+ * temperature (deg C) arrays. The frames are not modified. Any output
+ * array may be NULL if the quantity is not needed.
+ */
+void hih6130_decode_frames(const __u8 *frames, int count, unsigned char *status, float *humidity, float *temperature) {
+
+	int i = 0;
+
+#ifdef HIH6130_VECTOR
+	hih6130_vu32 w, rh, rt;
+	hih6130_vf32 fh, ft;
+	hih6130_vu8 st;
+
+	for(; i + HIH6130_VECTOR <= count; i += HIH6130_VECTOR) {
+
+		// One lane per frame: byte 0 in the lowest bits
+		memcpy(&w, &frames[i*4], sizeof(w));
+
+		rh = ((w & 0x3F) << 8) | ((w >> 8) & 0xFF);
+		rt = (((w >> 16) & 0xFF) << 6) | (w >> 26);
+
+		if(status) {
+
+			st = __builtin_convertvector((w >> 6) & 0x03, hih6130_vu8);
+			memcpy(&status[i], &st, sizeof(st));
+		}
+
+		if(humidity) {
+
+			fh = __builtin_convertvector((hih6130_vs32)rh, hih6130_vf32) / 163.82f;
+			memcpy(&humidity[i], &fh, sizeof(fh));
+		}
+
+		if(temperature) {
+
+			ft = __builtin_convertvector((hih6130_vs32)rt, hih6130_vf32) / 16382.0f * 165.0f - 40.0f;
+			memcpy(&temperature[i], &ft, sizeof(ft));
+		}
+	}
+#endif
+
+	for(; i<count; i++) {
+
+		if(status)
+			status[i] = frames[i*4]>>6;
+
+		if(humidity)
+			humidity[i] = hih6130_calc_humidity(&frames[i*4]);
+
+		if(temperature)
+			temperature[i] = hih6130_calc_temperature(&frames[i*4]);
+	}
+}
+
+
+/**
+ * Decode an array of raw 4 byte frames into status, humidity (0.01 %RH)
+ * and temperature (0.01 deg C) arrays without floating point. The frames
+ * are not modified. Any output array may be NULL.
+ */
+void hih6130_decode_frames_centi(const __u8 *frames, int count, unsigned char *status, short *humidity, short *temperature) {
+
+	int i = 0;
+
+#ifdef HIH6130_VECTOR
+	hih6130_vu32 w;
+	hih6130_vs32 rh, rt;
+	hih6130_vs16 ch, ct;
+	hih6130_vu8 st;
+
+	for(; i + HIH6130_VECTOR <= count; i += HIH6130_VECTOR) {
+
+		memcpy(&w, &frames[i*4], sizeof(w));
+
+		rh = (hih6130_vs32)(((w & 0x3F) << 8) | ((w >> 8) & 0xFF));
+		rt = (hih6130_vs32)((((w >> 16) & 0xFF) << 6) | (w >> 26));
+
+		if(status) {
+
+			st = __builtin_convertvector((w >> 6) & 0x03, hih6130_vu8);
+			memcpy(&status[i], &st, sizeof(st));
+		}
+
+		if(humidity) {
+
+			ch = __builtin_convertvector((rh * HIH6130_CENTI_RH_MUL + 0x8000) >> 16, hih6130_vs16);
+			memcpy(&humidity[i], &ch, sizeof(ch));
+		}
+
+		if(temperature) {
+
+			ct = __builtin_convertvector(((rt * HIH6130_CENTI_C_MUL + 0x8000) >> 16) - 4000, hih6130_vs16);
+			memcpy(&temperature[i], &ct, sizeof(ct));
+		}
+	}
+#endif
+
+	for(; i<count; i++) {
+
+		if(status)
+			status[i] = frames[i*4]>>6;
+
+		if(humidity)
+			humidity[i] = hih6130_calc_humidity_centi(&frames[i*4]);
+
+		if(temperature)
+			temperature[i] = hih6130_calc_temperature_centi(&frames[i*4]);
+	}
 }
 
 
 /**
  * calculate status (internal function)
+ * Requests a measurement and polls the status byte on the learned
+ * schedule until it is no longer stale. If that is not the status
+ * stausbit waits for (e.g. in command mode), the status byte is polled
+ * up to 10 more times in 5 ms steps. Returns the last status.
  */
-unsigned char hih6130_calc_status(fd, stausbit) {
+unsigned char hih6130_calc_status(int fd, int stausbit) {
 
+	struct hih6130_device dev;
+	unsigned char status;
+	__u8 data[1];
 	int i;
-	__s32 status = 4;
 
-	i2c_smbus_write_byte(fd, 0x00);
+	memset(&dev, 0, sizeof(dev));
 
-	for(i=0; i<10; i++) {
+	dev.fd    = fd;
+	dev.model = hih6130_model;
 
-		status = (i2c_smbus_read_byte(fd)>>6);
+	hih6130_request_measurement(&dev);
+	status = hih6130_wait_frame(&dev, data, sizeof(data));
 
-		if(status == stausbit)
-			break;
-		else
-			usleep(5000);
+	hih6130_model = dev.model;
+
+	for(i=0; i<10 && status != stausbit; i++) {
+
+		usleep(5000);
+		status = hih6130_read_frame(fd, data, sizeof(data));
 	}
 
-	return (unsigned char)status;
+	return status;
 }
 
 
@@ -333,6 +775,7 @@ float hih6130_get_command(unsigned char register_no) {
 	// Read data
 	i2c_smbus_read_i2c_block_data(fd, 0x81, sizeof(data), data);
 
+	PROBE1(hih6130, close, fd);
 	close(fd);
 
 	return hih6130_calc_humidity(data);
@@ -351,11 +794,19 @@ void hih6130_set_command(unsigned char register_no, double humidity) {
 	fd = hih6130_perform_command(register_no);
 
 	// Set write register
-	register_no += 0x40;
+	register_no += HIH6130_CMD_WRITE;
 
 	// Write level into register
-	i2c_smbus_read_i2c_block_data(fd, register_no, sizeof(data), data);
+	if(i2c_smbus_write_i2c_block_data(fd, register_no, sizeof(data), data) < 0) {
 
+		perror("Error while write HIH6130 EEPROM:");
+		close(fd);
+		exit(1);
+	}
+
+	usleep(HIH6130_EEPROM_WRITE_TIME);
+
+	PROBE1(hih6130, close, fd);
 	close(fd);
 }
 
@@ -382,4 +833,636 @@ int hih6130_perform_command(unsigned char register_no) {
 }
 
 
+/**
+ * Open a sensor handle for the split request/fetch API
+ * In pipelined mode the first measurement request is sent here and every
+ * fetch of a fresh frame immediately starts the next measurement, so the
+ * sensor converts while the application handles the previous sample.
+ */
+void hih6130_open(struct hih6130_device *dev, __u8 i2c_device, __u8 i2c_address, unsigned char pipelined) {
+
+	memset(dev, 0, sizeof(*dev));
+
+	dev->i2c_device  = i2c_device;
+	dev->i2c_address = i2c_address;
+	dev->pipelined   = pipelined;
+	dev->fd          = hih_i2c_open_device(i2c_device, i2c_address);
+
+	hih6130_model_init(&dev->model);
+
+	if(pipelined)
+		hih6130_request_measurement(dev);
+}
+
+
+/**
+ * Close a sensor handle
+ */
+void hih6130_close(struct hih6130_device *dev) {
+
+	if(dev->fd >= 0) {
+
+		PROBE1(hih6130, close, dev->fd);
+		close(dev->fd);
+	}
+
+	dev->fd      = -1;
+	dev->pending = 0;
+}
+
+
+/**
+ * Send a measurement request, returns without waiting for the conversion
+ */
+void hih6130_request_measurement(struct hih6130_device *dev) {
+
+	if(i2c_smbus_write_byte(dev->fd, 0x00) < 0) {
+
+		perror("Error while request HIH6130 measurement:");
+		close(dev->fd);
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &dev->requested);
+
+	PROBE1(hih6130, request, dev->fd);
+
+	dev->pending    = 1;
+	dev->next_poll  = hih6130_model_first_poll(&dev->model);
+	dev->last_stale = -1;
+}
+
+
+/**
+ * Fetch the data frame with a single read, returns the status bits
+ * A fresh frame completes the outstanding request and, if it was read on
+ * schedule, trains the conversion time model; in pipelined mode the next
+ * measurement is requested right away. A stale frame leaves the request
+ * outstanding and schedules the next poll, until HIH6130_POLL_TIMEOUT.
+ */
+unsigned char hih6130_fetch_frame(struct hih6130_device *dev, __u8 *data, int length) {
+
+	unsigned char status;
+	long long fetched;
+
+	fetched = hih6130_elapsed(&dev->requested);
+	status  = hih6130_read_frame(dev->fd, data, length);
+
+	PROBE3(hih6130, fetch, dev->fd, status, fetched);
+
+	dev->model.polls++;
+
+	// Nothing outstanding, nothing to learn
+	if(!dev->pending)
+		return status;
+
+	if(status == HIH6130_STATUS_STALE) {
+
+		dev->last_stale = fetched;
+		dev->next_poll  = fetched + hih6130_model_step(&dev->model);
+
+		if(fetched >= HIH6130_POLL_TIMEOUT) {
+
+			dev->model.timeouts++;
+			dev->pending = 0;
+		}
+
+		return status;
+	}
+
+	dev->model.fetches++;
+	dev->pending = 0;
+
+	if(status != HIH6130_STATUS_NORMAL)
+		return status;
+
+	// A late poll only says the conversion ended some time before
+	if(fetched <= dev->next_poll + hih6130_model_step(&dev->model))
+		hih6130_model_learn(&dev->model, dev->last_stale, dev->next_poll, fetched);
+
+	if(dev->pipelined)
+		hih6130_request_measurement(dev);
+
+	return status;
+}
+
+
+/**
+ * Time until the outstanding measurement is expected to be complete
+ * Returns the remaining micro seconds, 0 if the frame is due and -1 if no
+ * measurement is outstanding.
+ */
+long hih6130_time_to_ready(struct hih6130_device *dev) {
+
+	long long elapsed;
+
+	if(!dev->pending)
+		return -1;
+
+	elapsed = hih6130_elapsed(&dev->requested);
+
+	if(elapsed >= dev->next_poll)
+		return 0;
+
+	return dev->next_poll - elapsed;
+}
+
+
+/**
+ * Non-blocking read of temperature and humidity
+ * Returns 1 and fills value when a fresh frame was fetched, 0 if the
+ * measurement is not yet due or the sensor still reports stale data.
+ * Without pipelining a new measurement is requested when none is
+ * outstanding. Drive many sensors from one thread by calling this for each
+ * and sleeping for the smallest hih6130_time_to_ready() in between.
+ */
+int hih6130_poll_value(struct hih6130_device *dev, struct hih6130_value *value) {
+
+	__u8 data[4];
+
+	if(!dev->pending) {
+
+		hih6130_request_measurement(dev);
+		return 0;
+	}
+
+	if(hih6130_time_to_ready(dev) > 0)
+		return 0;
+
+	value->status = hih6130_fetch_frame(dev, data, sizeof(data));
+
+	// Stale frames are neither decoded nor published
+	if(value->status == HIH6130_STATUS_STALE)
+		dev->cache.stale++;
+
+	if(value->status != HIH6130_STATUS_NORMAL)
+		return 0;
+
+	value->humidity    = hih6130_calc_humidity(data);
+	value->temperature = hih6130_calc_temperature(data);
+
+	hih6130_cache_store(&dev->cache, value);
+
+	return 1;
+}
+
+
+/**
+ * Blocking read of temperature and humidity on a sensor handle
+ * Waits only for the remainder of the outstanding conversion, which is
+ * nothing in pipelined mode if the caller samples slower than the sensor.
+ * A stale frame returns the last fresh values, NAN before the first one.
+ */
+struct hih6130_value hih6130_read_value(struct hih6130_device *dev) {
+
+	__u8 data[4];
+	struct hih6130_value value;
+
+	if(!dev->pending)
+		hih6130_request_measurement(dev);
+
+	value.status = hih6130_wait_frame(dev, data, sizeof(data));
+
+	// A stale frame repeats the last measurement, it is never decoded:
+	// return the published one, or no values if there is none yet
+	if(value.status == HIH6130_STATUS_STALE) {
+
+		dev->cache.stale++;
+
+		if(dev->cache.valid)
+			value = dev->cache.value;
+		else
+			value.humidity = value.temperature = NAN;
+
+		value.status = HIH6130_STATUS_STALE;
+
+		return value;
+	}
+
+	value.humidity    = hih6130_calc_humidity(data);
+	value.temperature = hih6130_calc_temperature(data);
+
+	if(value.status == HIH6130_STATUS_NORMAL)
+		hih6130_cache_store(&dev->cache, &value);
+
+	return value;
+}
+
+
+/**
+ * Get temperature and humidity on a sensor handle
+ * The last sample is returned if it is not older than max_age micro
+ * seconds, otherwise a new one is read. A max_age of 0 always reads.
+ */
+struct hih6130_value hih6130_get_cached_value(struct hih6130_device *dev, long max_age) {
+
+	struct hih6130_value value;
+
+	if(hih6130_cache_lookup(&dev->cache, max_age, &value))
+		return value;
+
+	return hih6130_read_value(dev);
+}
+
+
+/**
+ * Get humidity on a sensor handle, see hih6130_get_cached_value()
+ */
+float hih6130_get_cached_humidity(struct hih6130_device *dev, long max_age) {
+
+	return hih6130_get_cached_value(dev, max_age).humidity;
+}
+
+
+/**
+ * Get temperature on a sensor handle, see hih6130_get_cached_value()
+ */
+float hih6130_get_cached_temperature(struct hih6130_device *dev, long max_age) {
+
+	return hih6130_get_cached_value(dev, max_age).temperature;
+}
+
+
+/**
+ * Micro seconds elapsed since a CLOCK_MONOTONIC time (internal function)
+ * 64 bit, a 32 bit long overflows after 35 minutes.
+ */
+static inline long long hih6130_elapsed(const struct timespec *since) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - since->tv_sec) * 1000000LL
+		 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+
+/**
+ * Look up a sample not older than max_age micro seconds (internal function)
+ * Returns 1 on a hit, 0 on a miss; a max_age of 0 disables the cache.
+ */
+static inline int hih6130_cache_lookup(struct hih6130_cache *cache, long max_age, struct hih6130_value *value) {
+
+	if(max_age > 0 && cache->valid && hih6130_elapsed(&cache->time) <= max_age) {
+
+		cache->hits++;
+		*value = cache->value;
+
+		return 1;
+	}
+
+	cache->misses++;
+
+	return 0;
+}
+
+
+/**
+ * Publish a fresh sample (internal function)
+ */
+static inline void hih6130_cache_store(struct hih6130_cache *cache, const struct hih6130_value *value) {
+
+	cache->value = *value;
+	cache->valid = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &cache->time);
+}
+
+
+/**
+ * Poll the outstanding measurement until it is no longer stale
+ * (internal function)
+ */
+static inline unsigned char hih6130_wait_frame(struct hih6130_device *dev, __u8 *data, int length) {
+
+	unsigned char status;
+	long wait;
+	int polls = 0;
+
+	PROBE1(hih6130, wait_entry, dev->fd);
+
+	do {
+
+		if((wait = hih6130_time_to_ready(dev)) > 0)
+			usleep(wait);
+
+		status = hih6130_fetch_frame(dev, data, length);
+		polls++;
+
+	} while(status == HIH6130_STATUS_STALE && dev->pending);
+
+	PROBE3(hih6130, wait_return, dev->fd, status, polls);
+
+	return status;
+}
+
+
+/**
+ * Start a model with the data sheet measurement cycle (internal function)
+ */
+static inline void hih6130_model_init(struct hih6130_model *model) {
+
+	memset(model, 0, sizeof(*model));
+
+	model->mean = HIH6130_MEASUREMENT_TIME;
+	model->dev  = HIH6130_MEASUREMENT_DEV;
+}
+
+
+/**
+ * First poll, just after the predicted completion (internal function)
+ */
+static inline long hih6130_model_first_poll(const struct hih6130_model *model) {
+
+	return model->mean + model->dev / 2;
+}
+
+
+/**
+ * Wait between two polls, shrinks with the deviation (internal function)
+ */
+static inline long hih6130_model_step(const struct hih6130_model *model) {
+
+	long step = model->dev / 2;
+
+	if(step < HIH6130_POLL_MIN_STEP)
+		return HIH6130_POLL_MIN_STEP;
+
+	if(step > HIH6130_POLL_MAX_STEP)
+		return HIH6130_POLL_MAX_STEP;
+
+	return step;
+}
+
+
+/**
+ * Learn from one conversion (internal function)
+ * The conversion ended between the last stale and the fresh poll. If the
+ * first poll was already fresh it ended some time before the scheduled
+ * poll; assuming one step earlier lets the prediction walk down to the
+ * real conversion time, independent of how late the sleep woke up.
+ */
+static inline void hih6130_model_learn(struct hih6130_model *model, long last_stale, long scheduled, long fetched) {
+
+	long sample, err;
+
+	if(last_stale >= 0)
+		sample = (last_stale + fetched) / 2;
+	else
+		sample = (fetched < scheduled ? fetched : scheduled) - hih6130_model_step(model);
+
+	err = sample - model->mean;
+
+	model->mean += err / 8;
+	model->dev  += (labs(err) - model->dev) / 4;
+
+	model->samples++;
+}
+
+
+/**
+ * Program the four alarm thresholds (%RH) into the EEPROM
+ * The sensor only accepts command mode within 10 ms after power on, so
+ * power cycle it right before this call (or program it once at board
+ * bring-up). The sensor is put back into normal mode afterwards, an
+ * outstanding measurement of the handle is requested again.
+ */
+void hih6130_alarm_program(struct hih6130_device *dev, float high_on, float high_off, float low_on, float low_off) {
+
+	int fd = dev->fd, i;
+	__u8 zero[2];
+	__u8 data[2];
+	const unsigned char reg[4] = { HIH6130_ALARM_HIGH_ON, HIH6130_ALARM_HIGH_OFF,
+								   HIH6130_ALARM_LOW_ON,  HIH6130_ALARM_LOW_OFF };
+	const float level[4] = { high_on, high_off, low_on, low_off };
+
+	memset(&zero[0], 0, sizeof(zero));
+
+	// Set to command mode
+	if(i2c_smbus_write_i2c_block_data(fd, HIH6130_CMD_START_CM, sizeof(zero), zero) < 0) {
+
+		perror("Error while enter HIH6130 command mode:");
+		close(fd);
+		exit(1);
+	}
+
+	for(i=0; i<4; i++) {
+
+		hih6130_calc_hex_humidity(level[i], data);
+
+		if(i2c_smbus_write_i2c_block_data(fd, reg[i] + HIH6130_CMD_WRITE, sizeof(data), data) < 0) {
+
+			perror("Error while write HIH6130 EEPROM:");
+			close(fd);
+			exit(1);
+		}
+
+		usleep(HIH6130_EEPROM_WRITE_TIME);
+	}
+
+	// Back to normal operation
+	i2c_smbus_write_i2c_block_data(fd, HIH6130_CMD_START_NOM, sizeof(zero), zero);
+
+	// Command mode dropped the measurement in progress
+	dev->pending = 0;
+
+	if(dev->pipelined)
+		hih6130_request_measurement(dev);
+}
+
+
+/**
+ * Set up a threshold subscription
+ * The thresholds must match the ones programmed with
+ * hih6130_alarm_program() when the alarm outputs are wired; they are used
+ * to decide which alarm changed when an output fires. With high_fd and
+ * low_fd both -1 the alarm is emulated in software with the same
+ * hysteresis. Either way the sensor measures every alarm->interval us
+ * (default 1 s). The initial state is taken from one reading.
+ */
+void hih6130_alarm_init(struct hih6130_alarm *alarm, struct hih6130_device *dev,
+		float high_on, float high_off, float low_on, float low_off, int high_fd, int low_fd) {
+
+	struct hih6130_value value;
+
+	memset(alarm, 0, sizeof(*alarm));
+
+	alarm->dev      = dev;
+	alarm->high_on  = high_on;
+	alarm->high_off = high_off;
+	alarm->low_on   = low_on;
+	alarm->low_off  = low_off;
+	alarm->high_fd  = high_fd;
+	alarm->low_fd   = low_fd;
+	alarm->interval = 1000000;
+
+	value = hih6130_read_value(dev);
+	alarm->samples++;
+
+	alarm->state = hih6130_alarm_state(alarm, 0, value.humidity);
+}
+
+
+/**
+ * Wait until an alarm is set or cleared
+ * The sensor sleeps between measurements and only updates its alarm
+ * outputs after a measurement request. With wired outputs a request is
+ * sent every alarm->interval us and the thread sleeps in poll(); the
+ * frame is only read after an edge. The emulation reads a sample every
+ * alarm->interval us but only returns on a crossing.
+ * \param timeout in ms, -1 waits forever
+ * \param value receives the reading that confirmed the change, may be NULL
+ * \return Bit mask of the alarms that changed, 0 on timeout, -1 if poll()
+ *         fails; a signal does not end the wait
+ */
+int hih6130_alarm_wait(struct hih6130_alarm *alarm, int timeout, struct hih6130_value *value) {
+
+	struct pollfd pfd[2];
+	struct hih6130_value sample;
+	struct timespec start, requested;
+	unsigned char state, changed;
+	char buf[64];
+	long left, wait;
+	int nfds = 0, ready, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// The first measurement request goes out right away
+	requested = start;
+	requested.tv_sec -= alarm->interval / 1000000 + 1;
+
+	if(alarm->high_fd >= 0) {
+
+		pfd[nfds].fd     = alarm->high_fd;
+		pfd[nfds].events = POLLIN | POLLPRI;
+		nfds++;
+	}
+
+	if(alarm->low_fd >= 0) {
+
+		pfd[nfds].fd     = alarm->low_fd;
+		pfd[nfds].events = POLLIN | POLLPRI;
+		nfds++;
+	}
+
+	for(;;) {
+
+		left = -1;
+
+		if(timeout >= 0) {
+
+			left = timeout - hih6130_elapsed(&start) / 1000;
+
+			if(left < 0)
+				return 0;
+		}
+
+		if(nfds > 0) {
+
+			// Measurement request, the outputs follow its result
+			wait = (alarm->interval - hih6130_elapsed(&requested)) / 1000;
+
+			if(wait <= 0) {
+
+				hih6130_request_measurement(alarm->dev);
+				alarm->requests++;
+
+				requested = alarm->dev->requested;
+				wait      = alarm->interval / 1000;
+			}
+
+			if(left >= 0 && left < wait)
+				wait = left;
+
+			// Sleep until an alarm output has an edge or the next request is due
+			if((ready = poll(pfd, nfds, (int)wait)) < 0) {
+
+				if(errno == EINTR)
+					continue;
+
+				return -1;
+			}
+
+			if(ready == 0)
+				continue;
+
+			// Consume the line event (or eventfd counter)
+			for(i=0; i<nfds; i++) {
+
+				if(pfd[i].revents & (POLLIN | POLLPRI)) {
+
+					if(read(pfd[i].fd, buf, sizeof(buf)) < 0 && errno != EAGAIN) {
+
+						perror("Error while read HIH6130 alarm event:");
+						exit(1);
+					}
+
+					alarm->events++;
+				}
+			}
+		}
+		else {
+
+			// Emulation: sample every interval, sleep in between
+			if(left >= 0 && left * 1000 < alarm->interval) {
+
+				usleep(left * 1000);
+				return 0;
+			}
+
+			usleep(alarm->interval);
+		}
+
+		sample = hih6130_read_value(alarm->dev);
+		alarm->samples++;
+
+		if(sample.status != HIH6130_STATUS_NORMAL)
+			continue;
+
+		state   = hih6130_alarm_state(alarm, alarm->state, sample.humidity);
+		changed = state ^ alarm->state;
+
+		// Only alarms that are wired can be reported in hardware mode
+		if(alarm->high_fd < 0 && nfds > 0)
+			changed &= ~HIH6130_ALARM_HIGH;
+
+		if(alarm->low_fd < 0 && nfds > 0)
+			changed &= ~HIH6130_ALARM_LOW;
+
+		alarm->state ^= changed;
+
+		if(changed) {
+
+			alarm->wakeups++;
+
+			if(value)
+				*value = sample;
+
+			return changed;
+		}
+	}
+}
+
+
+/**
+ * Alarm state after a reading, with the hysteresis of the sensor
+ * (internal function)
+ */
+static inline unsigned char hih6130_alarm_state(const struct hih6130_alarm *alarm, unsigned char state, float humidity) {
+
+	if(humidity > alarm->high_on)
+		state |= HIH6130_ALARM_HIGH;
+	else if(humidity < alarm->high_off)
+		state &= ~HIH6130_ALARM_HIGH;
+
+	if(humidity < alarm->low_on)
+		state |= HIH6130_ALARM_LOW;
+	else if(humidity > alarm->low_off)
+		state &= ~HIH6130_ALARM_LOW;
+
+	return state;
+}
+
+
 #endif /* HIH6130_H_ */
@@ -0,0 +1,723 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libmetrics.h serves sensor values, counters and histograms in the
+ *  Prometheus text format over HTTP on a Unix socket or a localhost TCP
+ *  port, so monitoring never has to touch the bus.
+ *
+ *  The page is rendered into a fixed buffer once, when the metrics are
+ *  added: every sample line ends in a value field of fixed width. Setting
+ *  a metric only stores a number; a scrape formats the fields whose
+ *  number changed since the last scrape in place and sends the buffer
+ *  with one writev(). Neither side allocates memory.
+ *
+ *  metrics_set(), metrics_inc() and metrics_observe() are safe from any
+ *  thread. metrics_serve() handles the connections and must be called
+ *  from one thread only, e.g. in a loop of its own.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBMETRICS_H_
+#define LIBMETRICS_H_
+
+#define METRICS_BUFFER  16384  ///< Size of the rendered page
+#define METRICS_FIELDS  256    ///< Most sample lines
+#define METRICS_CLIENTS 16     ///< Most open connections
+#define METRICS_CLIENT_TIMEOUT 1000  ///< ms a connection has to send its request
+#define METRICS_WIDTH   20     ///< Width of the value field of a line
+
+#define METRICS_GAUGE     0
+#define METRICS_COUNTER   1
+#define METRICS_HISTOGRAM 2
+
+
+/** FUNCTION DEFINITONS **/
+
+struct metrics;
+
+void metrics_init(struct metrics *metrics);
+int metrics_add(struct metrics *metrics, const char *name, const char *labels, const char *help, int type);
+int metrics_add_histogram(struct metrics *metrics, const char *name, const char *labels, const char *help, const double *bounds, int count);
+void metrics_set(struct metrics *metrics, int index, double value);
+void metrics_inc(struct metrics *metrics, int index, double delta);
+void metrics_observe(struct metrics *metrics, int index, double value);
+void metrics_listen_unix(struct metrics *metrics, const char *path);
+void metrics_listen_tcp(struct metrics *metrics, int port);
+void metrics_serve(struct metrics *metrics, int timeout);
+void metrics_close(struct metrics *metrics);
+
+static inline void metrics_header(struct metrics *metrics, const char *name, const char *help, int type);
+static inline int metrics_line(struct metrics *metrics, const char *name, const char *suffix, const char *labels, const char *extra);
+static inline void metrics_append(struct metrics *metrics, const char *text);
+static inline void metrics_render(struct metrics *metrics);
+static inline void metrics_respond(struct metrics *metrics, int client);
+static inline void metrics_add_double(double *target, double delta);
+static inline long long metrics_now(void);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A sample line
+ * 	offset:   position of the value field in the page
+ * 	value:    current value
+ * 	rendered: value in the page
+ * 	bounds:   histogram: upper bounds of the buckets, the fields of a
+ * 	          histogram are bucket 0..count-1, +Inf, sum and count
+ */
+struct metrics_field {
+	int offset;
+	int count;
+	const double *bounds;
+	double value;
+	double rendered;
+};
+
+
+/**
+ * An exporter
+ * 	page:     rendered page
+ * 	length:   used length of page
+ * 	listen:   listening socket, -1 if none
+ * 	name:     name of the last header
+ * 	client:   open connections, -1 for a free entry
+ * 	deadline: CLOCK_MONOTONIC time in ms a connection is closed at
+ * 	scrapes:  pages sent
+ */
+struct metrics {
+	char page[METRICS_BUFFER];
+	int length;
+	struct metrics_field field[METRICS_FIELDS];
+	int fields;
+	char name[64];
+	int listen;
+	int client[METRICS_CLIENTS];
+	long long deadline[METRICS_CLIENTS];
+	unsigned long scrapes;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/**
+ * Initialize an exporter without metrics
+ */
+void metrics_init(struct metrics *metrics) {
+
+	int i;
+
+	metrics->length = 0;
+	metrics->fields = 0;
+	metrics->listen = -1;
+	metrics->scrapes = 0;
+
+	memset(metrics->name, 0, sizeof(metrics->name));
+
+	for(i=0; i<METRICS_CLIENTS; i++)
+		metrics->client[i] = -1;
+}
+
+
+/**
+ * Add a gauge or counter
+ * Lines of the same name are added one after another, the first one
+ * gives help and type.
+ * \param labels Label list without braces, e.g. "bus=\"1\"", or NULL
+ * \return Index for metrics_set()
+ */
+int metrics_add(struct metrics *metrics, const char *name, const char *labels, const char *help, int type) {
+
+	int index;
+
+	metrics_header(metrics, name, help, type);
+
+	index = metrics_line(metrics, name, "", labels, NULL);
+
+	metrics->field[index].value    = 0;
+	metrics->field[index].rendered = NAN;
+
+	return index;
+}
+
+
+/**
+ * Add a histogram
+ * \param bounds Upper bounds of the buckets, ascending; the array is used
+ * for the lifetime of the exporter
+ * \return Index for metrics_observe()
+ */
+int metrics_add_histogram(struct metrics *metrics, const char *name, const char *labels, const char *help, const double *bounds, int count) {
+
+	char bound[40];
+	int index, i;
+
+	metrics_header(metrics, name, help, METRICS_HISTOGRAM);
+
+	for(i=0; i<=count; i++) {
+
+		if(i < count)
+			snprintf(bound, sizeof(bound), "le=\"%g\"", bounds[i]);
+		else
+			snprintf(bound, sizeof(bound), "le=\"+Inf\"");
+
+		metrics_line(metrics, name, "_bucket", labels, bound);
+	}
+
+	metrics_line(metrics, name, "_sum", labels, NULL);
+	metrics_line(metrics, name, "_count", labels, NULL);
+
+	index = metrics->fields - count - 3;
+
+	metrics->field[index].bounds = bounds;
+	metrics->field[index].count  = count;
+
+	for(i=index; i<metrics->fields; i++) {
+
+		metrics->field[i].value    = 0;
+		metrics->field[i].rendered = NAN;
+	}
+
+	return index;
+}
+
+
+/**
+ * Set a gauge or counter
+ */
+void metrics_set(struct metrics *metrics, int index, double value) {
+
+	__atomic_store(&metrics->field[index].value, &value, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Add to a gauge or counter
+ */
+void metrics_inc(struct metrics *metrics, int index, double delta) {
+
+	metrics_add_double(&metrics->field[index].value, delta);
+}
+
+
+/**
+ * Count a value in a histogram
+ */
+void metrics_observe(struct metrics *metrics, int index, double value) {
+
+	struct metrics_field *field = &metrics->field[index];
+	int i;
+
+	// Buckets are cumulative
+	for(i=0; i<field->count; i++) {
+
+		if(value <= field->bounds[i])
+			metrics_add_double(&field[i].value, 1);
+	}
+
+	metrics_add_double(&field[field->count].value, 1);
+	metrics_add_double(&field[field->count + 1].value, value);
+	metrics_add_double(&field[field->count + 2].value, 1);
+}
+
+
+/**
+ * Serve on a Unix socket, an old socket file is replaced
+ */
+void metrics_listen_unix(struct metrics *metrics, const char *path) {
+
+	struct sockaddr_un address;
+
+	memset(&address, 0, sizeof(address));
+
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+	unlink(path);
+
+	if((metrics->listen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	|| bind(metrics->listen, (struct sockaddr *)&address, sizeof(address)) < 0
+	|| listen(metrics->listen, METRICS_CLIENTS) < 0) {
+
+		printf("Error while listen on %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+}
+
+
+/**
+ * Serve on a TCP port of 127.0.0.1
+ */
+void metrics_listen_tcp(struct metrics *metrics, int port) {
+
+	struct sockaddr_in address;
+	int on = 1;
+
+	memset(&address, 0, sizeof(address));
+
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if((metrics->listen = socket(AF_INET, SOCK_STREAM, 0)) < 0
+	|| setsockopt(metrics->listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+	|| bind(metrics->listen, (struct sockaddr *)&address, sizeof(address)) < 0
+	|| listen(metrics->listen, METRICS_CLIENTS) < 0) {
+
+		printf("Error while listen on port %d: %s\n", port, strerror(errno));
+		exit(1);
+	}
+}
+
+
+/**
+ * Accept connections and answer the requests that are ready
+ * A connection without a complete request after METRICS_CLIENT_TIMEOUT
+ * ms is closed, idle clients cannot take all entries.
+ * \param timeout Longest wait in ms, -1 to wait for a connection
+ */
+void metrics_serve(struct metrics *metrics, int timeout) {
+
+	struct pollfd poll_fd[METRICS_CLIENTS + 1];
+	long long now, left;
+	int count, i, client;
+
+	count = 0;
+	now   = metrics_now();
+
+	poll_fd[count].fd     = metrics->listen;
+	poll_fd[count].events = POLLIN;
+	count++;
+
+	for(i=0; i<METRICS_CLIENTS; i++) {
+
+		if(metrics->client[i] < 0)
+			continue;
+
+		left = metrics->deadline[i] - now;
+
+		if(left <= 0) {
+
+			close(metrics->client[i]);
+			metrics->client[i] = -1;
+			continue;
+		}
+
+		// Wake up in time to close it
+		if(timeout < 0 || left < timeout)
+			timeout = (int)left;
+
+		poll_fd[count].fd     = metrics->client[i];
+		poll_fd[count].events = POLLIN;
+		count++;
+	}
+
+	if(poll(poll_fd, count, timeout) <= 0)
+		return;
+
+	for(i=1; i<count; i++) {
+
+		if(poll_fd[i].revents)
+			metrics_respond(metrics, poll_fd[i].fd);
+	}
+
+	if(poll_fd[0].revents & POLLIN) {
+
+		if((client = accept(metrics->listen, NULL, NULL)) < 0)
+			return;
+
+		fcntl(client, F_SETFL, O_NONBLOCK);
+
+		for(i=0; i<METRICS_CLIENTS && metrics->client[i] >= 0; i++);
+
+		// All entries busy: refuse
+		if(i == METRICS_CLIENTS) {
+
+			close(client);
+			return;
+		}
+
+		metrics->client[i]   = client;
+		metrics->deadline[i] = metrics_now() + METRICS_CLIENT_TIMEOUT;
+	}
+}
+
+
+/**
+ * Close the listening socket and the connections
+ */
+void metrics_close(struct metrics *metrics) {
+
+	int i;
+
+	for(i=0; i<METRICS_CLIENTS; i++) {
+
+		if(metrics->client[i] >= 0)
+			close(metrics->client[i]);
+
+		metrics->client[i] = -1;
+	}
+
+	if(metrics->listen >= 0)
+		close(metrics->listen);
+
+	metrics->listen = -1;
+}
+
+
+/**
+ * HELP and TYPE lines, once per name (internal function)
+ */
+static inline void metrics_header(struct metrics *metrics, const char *name, const char *help, int type) {
+
+	static const char *types[] = { "gauge", "counter", "histogram" };
+	char line[256];
+
+	// Same name as the line before: the header is there
+	if(!strncmp(metrics->name, name, sizeof(metrics->name)))
+		return;
+
+	strncpy(metrics->name, name, sizeof(metrics->name) - 1);
+
+	snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help ? help : name, name, types[type]);
+
+	metrics_append(metrics, line);
+}
+
+
+/**
+ * Add a sample line with an empty value field (internal function)
+ * \return Index of the field
+ */
+static inline int metrics_line(struct metrics *metrics, const char *name, const char *suffix, const char *labels, const char *extra) {
+
+	struct metrics_field *field;
+	char line[256];
+	int length;
+
+	if(metrics->fields == METRICS_FIELDS) {
+
+		printf("Error while add metric %s: more than %d lines\n", name, METRICS_FIELDS);
+		exit(1);
+	}
+
+	length = snprintf(line, sizeof(line), "%s%s", name, suffix);
+
+	if((labels && *labels) || extra) {
+
+		length += snprintf(line + length, sizeof(line) - length, "{%s%s%s}",
+						   labels ? labels : "", labels && *labels && extra ? "," : "", extra ? extra : "");
+	}
+
+	snprintf(line + length, sizeof(line) - length, " %*s\n", METRICS_WIDTH, "0");
+
+	field = &metrics->field[metrics->fields];
+
+	memset(field, 0, sizeof(*field));
+
+	field->offset = metrics->length + length + 1;
+
+	metrics_append(metrics, line);
+
+	return metrics->fields++;
+}
+
+
+/**
+ * Append text to the page (internal function)
+ */
+static inline void metrics_append(struct metrics *metrics, const char *text) {
+
+	int length = strlen(text);
+
+	if(metrics->length + length >= METRICS_BUFFER) {
+
+		printf("Error while add metric: page larger than %d bytes\n", METRICS_BUFFER);
+		exit(1);
+	}
+
+	memcpy(metrics->page + metrics->length, text, length + 1);
+	metrics->length += length;
+}
+
+
+/**
+ * Format the changed values into the page (internal function)
+ * Values right aligned in the field, Prometheus accepts the blanks.
+ */
+static inline void metrics_render(struct metrics *metrics) {
+
+	struct metrics_field *field;
+	char text[METRICS_WIDTH + 8];
+	double value;
+	int i, length;
+
+	for(i=0; i<metrics->fields; i++) {
+
+		field = &metrics->field[i];
+
+		__atomic_load(&field->value, &value, __ATOMIC_RELAXED);
+
+		if(value == field->rendered)
+			continue;
+
+		// Integers in full, others with the precision of a float reading
+		if(value == floor(value) && fabs(value) < 1e15)
+			length = snprintf(text, sizeof(text), "%*.0f", METRICS_WIDTH, value);
+		else
+			length = snprintf(text, sizeof(text), "%*.7g", METRICS_WIDTH, value);
+
+		if(length > METRICS_WIDTH)
+			length = snprintf(text, sizeof(text), "%*.*e", METRICS_WIDTH, METRICS_WIDTH - 8, value);
+
+		memcpy(metrics->page + field->offset, text, METRICS_WIDTH);
+
+		field->rendered = value;
+	}
+}
+
+
+/**
+ * Answer the request of a connection and close it (internal function)
+ */
+static inline void metrics_respond(struct metrics *metrics, int client) {
+
+	char request[1024], header[160];
+	struct iovec part[2];
+	ssize_t length;
+	int i;
+
+	length = read(client, request, sizeof(request));
+
+	// Wait for the rest of a request that is not complete yet
+	if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+
+	if(length > 0) {
+
+		metrics_render(metrics);
+
+		part[0].iov_base = header;
+		part[0].iov_len  = snprintf(header, sizeof(header),
+									"HTTP/1.0 200 OK\r\n"
+									"Content-Type: text/plain; version=0.0.4\r\n"
+									"Content-Length: %d\r\n"
+									"Connection: close\r\n\r\n", metrics->length);
+		part[1].iov_base = metrics->page;
+		part[1].iov_len  = metrics->length;
+
+		// The page fits into the socket buffer, a slow client is cut off
+		if(writev(client, part, 2) == (ssize_t)(part[0].iov_len + part[1].iov_len))
+			metrics->scrapes++;
+	}
+
+	close(client);
+
+	for(i=0; i<METRICS_CLIENTS; i++) {
+
+		if(metrics->client[i] == client)
+			metrics->client[i] = -1;
+	}
+}
+
+
+/**
+ * Atomic add to a double (internal function)
+ */
+static inline void metrics_add_double(double *target, double delta) {
+
+	double expected, desired;
+
+	__atomic_load(target, &expected, __ATOMIC_RELAXED);
+
+	do {
+
+		desired = expected + delta;
+
+	} while(!__atomic_compare_exchange(target, &expected, &desired, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * CLOCK_MONOTONIC in ms (internal function)
+ */
+static inline long long metrics_now(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+
+#endif /* LIBMETRICS_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBMETRICS_BMP085_)
+#define LIBMETRICS_BMP085_
+
+/**
+ * Add the gauges of a BMP085: temperature, pressure, altitude
+ * \return Index for metrics_set_bmp085()
+ */
+static inline int metrics_add_bmp085(struct metrics *metrics, const char *labels) {
+
+	int index;
+
+	index = metrics_add(metrics, "bmp085_temperature_celsius", labels, "BMP085 temperature", METRICS_GAUGE);
+	metrics_add(metrics, "bmp085_pressure_hpa", labels, "BMP085 pressure", METRICS_GAUGE);
+	metrics_add(metrics, "bmp085_altitude_meters", labels, "BMP085 altitude", METRICS_GAUGE);
+
+	return index;
+}
+
+
+/**
+ * Set the gauges of a BMP085
+ */
+static inline void metrics_set_bmp085(struct metrics *metrics, int index, const struct bmp085_value *value) {
+
+	metrics_set(metrics, index, value->temperature);
+	metrics_set(metrics, index + 1, value->pressure);
+	metrics_set(metrics, index + 2, value->altitude);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBMETRICS_HIH6130_)
+#define LIBMETRICS_HIH6130_
+
+/**
+ * Add the gauges of a HIH6130: humidity, temperature, status
+ * \return Index for metrics_set_hih6130()
+ */
+static inline int metrics_add_hih6130(struct metrics *metrics, const char *labels) {
+
+	int index;
+
+	index = metrics_add(metrics, "hih6130_humidity_percent", labels, "HIH6130 relative humidity", METRICS_GAUGE);
+	metrics_add(metrics, "hih6130_temperature_celsius", labels, "HIH6130 temperature", METRICS_GAUGE);
+	metrics_add(metrics, "hih6130_status", labels, "HIH6130 status bits", METRICS_GAUGE);
+
+	return index;
+}
+
+
+/**
+ * Set the gauges of a HIH6130
+ */
+static inline void metrics_set_hih6130(struct metrics *metrics, int index, const struct hih6130_value *value) {
+
+	metrics_set(metrics, index, value->humidity);
+	metrics_set(metrics, index + 1, value->temperature);
+	metrics_set(metrics, index + 2, value->status);
+}
+
+#endif
+
+
+#if defined(LIBSCHED_H_) && !defined(LIBMETRICS_SCHED_)
+#define LIBMETRICS_SCHED_
+
+/**
+ * Add the counters of a scheduler: transfers and load by bus, deadline
+ * misses by class
+ * \return Index for metrics_set_sched()
+ */
+static inline int metrics_add_sched(struct metrics *metrics) {
+
+	char labels[32];
+	int index, i;
+
+	index = metrics->fields;
+
+	for(i=0; i<SCHED_MAX_BUS; i++) {
+
+		snprintf(labels, sizeof(labels), "bus=\"%d\"", i);
+		metrics_add(metrics, "i2c_bus_transfers_total", labels, "Sensor transfers by i2c bus", METRICS_COUNTER);
+	}
+
+	for(i=0; i<SCHED_MAX_BUS; i++) {
+
+		snprintf(labels, sizeof(labels), "bus=\"%d\"", i);
+		metrics_add(metrics, "i2c_bus_load_ratio", labels, "Share of the cycle an i2c bus is busy", METRICS_GAUGE);
+	}
+
+	for(i=0; i<SCHED_CLASSES; i++) {
+
+		snprintf(labels, sizeof(labels), "class=\"%d\"", i);
+		metrics_add(metrics, "sched_deadline_misses_total", labels, "Samples completed after their deadline", METRICS_COUNTER);
+	}
+
+	return index;
+}
+
+
+/**
+ * Set the counters of a scheduler
+ */
+static inline void metrics_set_sched(struct metrics *metrics, int index, const struct sched *sched) {
+
+	int i;
+
+	for(i=0; i<SCHED_MAX_BUS; i++) {
+
+		metrics_set(metrics, index + i, sched->bus[i].transfers);
+		metrics_set(metrics, index + SCHED_MAX_BUS + i, sched_bus_load(sched, i));
+	}
+
+	for(i=0; i<SCHED_CLASSES; i++)
+		metrics_set(metrics, index + 2 * SCHED_MAX_BUS + i, sched->class[i].misses);
+}
+
+#endif
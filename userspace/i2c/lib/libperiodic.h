@@ -0,0 +1,396 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libperiodic.h paces a sampling loop on absolute CLOCK_MONOTONIC
+ *  deadlines.
+ *
+ *  A loop of "read sensor; usleep(period)" drifts by the conversion and
+ *  processing time every round and the sleep itself is stretched by the
+ *  timer slack. Here sample n is due at start + n * period, independent
+ *  of how long the work took, and the wait is either a timerfd armed on
+ *  the absolute deadline (pollable, fits into an event loop) or
+ *  clock_nanosleep() with TIMER_ABSTIME.
+ *
+ *  A deadline that has passed by more than one period is handled by the
+ *  policy: PERIODIC_SKIP drops the missed samples and continues with the
+ *  latest due one, PERIODIC_CATCH_UP returns immediately for every missed
+ *  sample until the loop has caught up.
+ *
+ *  The lateness of every wakeup against its deadline is recorded in a
+ *  histogram with power of two buckets. periodic_jitter_bound() gives the
+ *  bound a sample's timestamp is accurate to, e.g. for 99.9 % of the
+ *  samples; use the deadline returned by periodic_wait() as timestamp.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBPERIODIC_H_
+#define LIBPERIODIC_H_
+
+#include <time.h>
+
+#define PERIODIC_SKIP      0x00  ///< Drop missed samples
+#define PERIODIC_CATCH_UP  0x01  ///< Deliver missed samples without waiting
+#define PERIODIC_NANOSLEEP 0x02  ///< Wait with clock_nanosleep() instead of a timerfd
+
+#define PERIODIC_SLACK_DEFAULT -1  ///< Leave the timer slack of the thread as it is
+
+/*
+ * Jitter histogram: bucket 0 counts wakeups less than 1 us late, bucket n
+ * counts [2^(n-1), 2^n) us, the last bucket everything above
+ */
+#define PERIODIC_BUCKETS 24
+
+
+/** FUNCTION DEFINITONS **/
+
+struct periodic;
+
+void periodic_init(struct periodic *periodic, long period, int flags, long slack);
+void periodic_close(struct periodic *periodic);
+long periodic_wait(struct periodic *periodic, struct timespec *deadline);
+long long periodic_jitter_bound(const struct periodic *periodic, double quantile);
+void periodic_report(const struct periodic *periodic);
+
+static inline long long periodic_ns(const struct timespec *time);
+static inline void periodic_arm(struct periodic *periodic);
+static inline void periodic_sleep_until(struct periodic *periodic, long long deadline);
+static inline void periodic_record(struct periodic *periodic, long long late);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A periodic loop, times in ns of CLOCK_MONOTONIC
+ * 	fd:        timerfd, -1 with PERIODIC_NANOSLEEP
+ * 	flags:     PERIODIC_SKIP or PERIODIC_CATCH_UP, | PERIODIC_NANOSLEEP
+ * 	period:    period
+ * 	start:     deadline of sample 0
+ * 	index:     number of the current sample
+ * 	samples:   periodic_wait() returns
+ * 	skipped:   samples dropped by PERIODIC_SKIP
+ * 	caught_up: samples delivered late by PERIODIC_CATCH_UP
+ * 	late_max:  latest wakeup
+ * 	late_sum:  sum of the lateness of all wakeups
+ * 	histogram: wakeups by lateness, see PERIODIC_BUCKETS
+ */
+struct periodic {
+	int fd;
+	int flags;
+	long long period;
+	long long start;
+	long long index;
+	unsigned long samples;
+	unsigned long skipped;
+	unsigned long caught_up;
+	long long late_max;
+	long long late_sum;
+	unsigned long histogram[PERIODIC_BUCKETS];
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+
+/**
+ * Set up a periodic loop, the first sample is due one period from now
+ * \param period Period in us
+ * \param flags PERIODIC_SKIP or PERIODIC_CATCH_UP, optionally
+ * | PERIODIC_NANOSLEEP
+ * \param slack Timer slack of the calling thread in ns (prctl
+ * PR_SET_TIMERSLACK, the kernel default is 50 us), applies to
+ * clock_nanosleep() and poll() but not to timerfd expiry;
+ * PERIODIC_SLACK_DEFAULT leaves it unchanged
+ */
+void periodic_init(struct periodic *periodic, long period, int flags, long slack) {
+
+	struct timespec now;
+
+	memset(periodic, 0, sizeof(*periodic));
+
+	periodic->fd     = -1;
+	periodic->flags  = flags;
+	periodic->period = (long long)period * 1000LL;
+
+	if(slack >= 0 && prctl(PR_SET_TIMERSLACK, slack > 0 ? slack : 1, 0, 0, 0) < 0) {
+
+		perror("Error while set timer slack:");
+		exit(1);
+	}
+
+	if(!(flags & PERIODIC_NANOSLEEP)) {
+
+		if((periodic->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) {
+
+			perror("Error while create timerfd:");
+			exit(1);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	periodic->start = periodic_ns(&now);
+
+	periodic_arm(periodic);
+}
+
+
+/**
+ * Close the timerfd of a periodic loop
+ */
+void periodic_close(struct periodic *periodic) {
+
+	if(periodic->fd >= 0)
+		close(periodic->fd);
+
+	periodic->fd = -1;
+}
+
+
+/**
+ * Wait for the next sample
+ * With a timerfd the loop may also wait in poll() on periodic->fd, it is
+ * armed on the next deadline and readable once that has passed.
+ * \param deadline Receives the deadline of the sample, may be NULL
+ * \return Number of samples skipped before this one, 0 normally
+ */
+long periodic_wait(struct periodic *periodic, struct timespec *deadline) {
+
+	struct timespec now;
+	long long due, late, missed = 0;
+
+	periodic->index++;
+	due = periodic->start + periodic->index * periodic->period;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	late = periodic_ns(&now) - due;
+
+	if(late < 0) {
+
+		periodic_sleep_until(periodic, due);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = periodic_ns(&now) - due;
+	}
+	else if(late >= periodic->period) {
+
+		// A whole period or more behind
+		if(periodic->flags & PERIODIC_CATCH_UP) {
+
+			periodic->caught_up++;
+		}
+		else {
+
+			missed = late / periodic->period;
+
+			periodic->index   += missed;
+			periodic->skipped += missed;
+
+			due  += missed * periodic->period;
+			late -= missed * periodic->period;
+		}
+	}
+
+	periodic_record(periodic, late);
+	periodic_arm(periodic);
+
+	if(deadline) {
+
+		deadline->tv_sec  = due / 1000000000LL;
+		deadline->tv_nsec = due % 1000000000LL;
+	}
+
+	return (long)missed;
+}
+
+
+/**
+ * Bound of the wakeup lateness for a share of the samples
+ * \param quantile e.g. 0.999 for 99.9 % of the samples
+ * \return Upper edge of the histogram bucket in ns, the exact maximum if
+ * the quantile reaches the last sample
+ */
+long long periodic_jitter_bound(const struct periodic *periodic, double quantile) {
+
+	unsigned long count = 0, limit;
+	int i;
+
+	if(periodic->samples == 0)
+		return 0;
+
+	limit = (unsigned long)(quantile * (double)periodic->samples + 0.5);
+
+	if(limit >= periodic->samples)
+		return periodic->late_max;
+
+	for(i=0; i<PERIODIC_BUCKETS-1; i++) {
+
+		count += periodic->histogram[i];
+
+		if(count >= limit)
+			return (1LL << i) * 1000LL;
+	}
+
+	return periodic->late_max;
+}
+
+
+/**
+ * Print the jitter histogram and the miss counters
+ */
+void periodic_report(const struct periodic *periodic) {
+
+	int i;
+
+	printf("%lu samples, %lu skipped, %lu caught up, late avg %lld ns, max %lld ns\n",
+			periodic->samples, periodic->skipped, periodic->caught_up,
+			periodic->samples ? periodic->late_sum / (long long)periodic->samples : 0LL,
+			periodic->late_max);
+
+	for(i=0; i<PERIODIC_BUCKETS; i++) {
+
+		if(periodic->histogram[i] == 0)
+			continue;
+
+		if(i == 0)
+			printf("  < %8ld us: %lu\n", 1L, periodic->histogram[i]);
+		else if(i == PERIODIC_BUCKETS-1)
+			printf("  >=%8ld us: %lu\n", 1L << (i-1), periodic->histogram[i]);
+		else
+			printf("  < %8ld us: %lu\n", 1L << i, periodic->histogram[i]);
+	}
+
+	printf("99.9%% of the samples within %lld ns\n", periodic_jitter_bound(periodic, 0.999));
+}
+
+
+/**
+ * CLOCK_MONOTONIC time in ns (internal function)
+ */
+static inline long long periodic_ns(const struct timespec *time) {
+
+	return (long long)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+
+/**
+ * Arm the timerfd on the deadline of the next sample (internal function)
+ * Setting the timer also clears expirations that were not read.
+ */
+static inline void periodic_arm(struct periodic *periodic) {
+
+	struct itimerspec timer;
+	long long due;
+
+	if(periodic->fd < 0)
+		return;
+
+	memset(&timer, 0, sizeof(timer));
+
+	due = periodic->start + (periodic->index + 1) * periodic->period;
+
+	timer.it_value.tv_sec  = due / 1000000000LL;
+	timer.it_value.tv_nsec = due % 1000000000LL;
+
+	if(timerfd_settime(periodic->fd, TFD_TIMER_ABSTIME, &timer, NULL) < 0) {
+
+		perror("Error while arm timerfd:");
+		exit(1);
+	}
+}
+
+
+/**
+ * Sleep until an absolute CLOCK_MONOTONIC time in ns (internal function)
+ * The timerfd is already armed on it by periodic_arm().
+ */
+static inline void periodic_sleep_until(struct periodic *periodic, long long deadline) {
+
+	struct timespec until;
+	unsigned long long expirations;
+	int error;
+
+	if(periodic->fd < 0) {
+
+		until.tv_sec  = deadline / 1000000000LL;
+		until.tv_nsec = deadline % 1000000000LL;
+
+		// Absolute deadline, an interrupted sleep is simply restarted
+		do {
+			error = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+		} while(error == EINTR);
+
+		return;
+	}
+
+	while(read(periodic->fd, &expirations, sizeof(expirations)) < 0) {
+
+		if(errno != EINTR) {
+
+			perror("Error while read timerfd:");
+			exit(1);
+		}
+	}
+}
+
+
+/**
+ * Add the lateness of a wakeup in ns to the statistics (internal function)
+ */
+static inline void periodic_record(struct periodic *periodic, long long late) {
+
+	long long us = late / 1000LL;
+	int bucket = 0;
+
+	while(us > 0 && bucket < PERIODIC_BUCKETS-1) {
+
+		us >>= 1;
+		bucket++;
+	}
+
+	periodic->histogram[bucket]++;
+	periodic->samples++;
+	periodic->late_sum += late;
+
+	if(late > periodic->late_max)
+		periodic->late_max = late;
+}
+
+
+#endif /* LIBPERIODIC_H_ */
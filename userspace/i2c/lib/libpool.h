@@ -0,0 +1,540 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libpool.h is a worker pool for gateways with several i2c adapters.
+ *
+ *  A job is split into the bus side, transfer(), which must be
+ *  serialised per adapter, and the CPU side, process() (compensation,
+ *  decoding, publishing), which can run anywhere. Every bus has its own
+ *  job queue and is owned by at most one worker at a time, so transfers
+ *  of one adapter never overlap while all adapters work in parallel.
+ *
+ *  Each worker has a home bus (worker n serves bus n % buses first) and
+ *  a local deque for the CPU side of the jobs it transferred. A worker
+ *  keeps its bus busy and pushes the finished transfers to its deque;
+ *  workers without a free bus with work steal the oldest entries from the
+ *  deques of the others. With fewer workers than buses a worker also
+ *  serves foreign buses that have work and no owner.
+ *
+ *  Link with -lpthread.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBPOOL_H_
+#define LIBPOOL_H_
+
+#include <pthread.h>
+
+#define POOL_MAX_BUS     8    ///< Highest i2c bus number + 1
+#define POOL_MAX_WORKERS 16   ///< Maximum number of worker threads
+#define POOL_DEQUE       256  ///< CPU side entries per worker, processed inline if full
+
+
+/** FUNCTION DEFINITONS **/
+
+struct pool;
+struct pool_job;
+
+void pool_start(struct pool *pool, int workers);
+void pool_stop(struct pool *pool);
+void pool_submit(struct pool *pool, struct pool_job *job);
+void pool_wait(struct pool *pool);
+void pool_report(const struct pool *pool);
+
+static void *pool_worker_main(void *argument);
+static inline struct pool_job *pool_take_transfer(struct pool *pool, int bus);
+static inline void pool_transfer(struct pool *pool, struct pool_job *job, int worker);
+static inline void pool_process(struct pool *pool, struct pool_job *job);
+static inline struct pool_job *pool_deque_pop(struct pool *pool, int worker);
+static inline struct pool_job *pool_deque_steal(struct pool *pool, int victim);
+static inline void pool_notify(struct pool *pool);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A job, owned by the caller until process() has returned
+ * 	bus:      i2c bus number of the sensor
+ * 	dev:      driver handle
+ * 	value:    sample storage
+ * 	transfer: bus side, runs with the bus owned; result is stored
+ * 	process:  CPU side, runs on any worker after transfer(), may be NULL;
+ * 	          may submit the job again
+ * 	user:     free for the caller
+ * 	result:   return value of transfer()
+ * 	next:     queue link (internal)
+ */
+struct pool_job {
+	int bus;
+	void *dev;
+	void *value;
+	int (*transfer)(struct pool_job *job);
+	void (*process)(struct pool_job *job);
+	void *user;
+	int result;
+	struct pool_job *next;
+};
+
+
+/**
+ * Queue and statistics of one bus
+ * 	owned:     a worker is transferring on the bus
+ * 	transfers: transfer() calls
+ * 	busy_ns:   time spent in transfer()
+ */
+struct pool_bus {
+	pthread_mutex_t lock;
+	struct pool_job *head;
+	struct pool_job *tail;
+	unsigned char owned;
+	unsigned long transfers;
+	long long busy_ns;
+};
+
+
+/**
+ * One worker thread
+ * 	home:        bus served first
+ * 	deque:       CPU side of own transfers, owner pops from bottom, thieves
+ * 	             take from top
+ * 	transferred: transfers done
+ * 	processed:   process() calls done
+ * 	stolen:      process() calls taken from other workers
+ */
+struct pool_worker {
+	pthread_t thread;
+	struct pool *pool;
+	int index;
+	int home;
+	pthread_mutex_t lock;
+	struct pool_job *deque[POOL_DEQUE];
+	unsigned int top;
+	unsigned int bottom;
+	unsigned long transferred;
+	unsigned long processed;
+	unsigned long stolen;
+};
+
+
+/**
+ * The pool
+ * 	bus:     queues by bus number
+ * 	buses:   bus numbers in use are < buses (set by pool_submit())
+ * 	worker:  worker threads
+ * 	lock:    guards sequence, pending and stop; wake and done use it
+ * 	sequence: incremented on new work, lets idle workers sleep safely
+ * 	pending: submitted jobs not yet processed
+ */
+struct pool {
+	struct pool_bus bus[POOL_MAX_BUS];
+	int buses;
+	struct pool_worker worker[POOL_MAX_WORKERS];
+	int workers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	unsigned long sequence;
+	long pending;
+	unsigned char stop;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/**
+ * Start a pool with a number of workers
+ * Use one worker per bus to keep every bus busy plus about one per CPU
+ * for the CPU side: a worker blocked in a transfer can not process, so
+ * with exactly one worker per bus the CPU side waits until a bus runs out
+ * of work.
+ */
+void pool_start(struct pool *pool, int workers) {
+
+	int i;
+
+	if(workers < 1 || workers > POOL_MAX_WORKERS) {
+
+		printf("Error while start pool: %d workers, 1..%d are possible\n", workers, POOL_MAX_WORKERS);
+		exit(1);
+	}
+
+	memset(pool, 0, sizeof(*pool));
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for(i=0; i<POOL_MAX_BUS; i++)
+		pthread_mutex_init(&pool->bus[i].lock, NULL);
+
+	pool->workers = workers;
+
+	for(i=0; i<workers; i++) {
+
+		pool->worker[i].pool  = pool;
+		pool->worker[i].index = i;
+		pool->worker[i].home  = i % POOL_MAX_BUS;
+
+		pthread_mutex_init(&pool->worker[i].lock, NULL);
+	}
+
+	for(i=0; i<workers; i++) {
+
+		if(pthread_create(&pool->worker[i].thread, NULL, pool_worker_main, &pool->worker[i]) != 0) {
+
+			perror("Error while start pool worker:");
+			exit(1);
+		}
+	}
+}
+
+
+/**
+ * Stop the workers after the queued jobs are done
+ */
+void pool_stop(struct pool *pool) {
+
+	int i;
+
+	pool_wait(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i=0; i<pool->workers; i++)
+		pthread_join(pool->worker[i].thread, NULL);
+}
+
+
+/**
+ * Queue a job on its bus, may be called from process()
+ */
+void pool_submit(struct pool *pool, struct pool_job *job) {
+
+	struct pool_bus *bus;
+
+	if(job->bus < 0 || job->bus >= POOL_MAX_BUS) {
+
+		printf("Error while submit pool job: bus %d out of range\n", job->bus);
+		exit(1);
+	}
+
+	bus = &pool->bus[job->bus];
+	job->next = NULL;
+
+	pthread_mutex_lock(&bus->lock);
+
+	if(bus->tail)
+		bus->tail->next = job;
+	else
+		bus->head = job;
+
+	bus->tail = job;
+
+	pthread_mutex_unlock(&bus->lock);
+
+	pthread_mutex_lock(&pool->lock);
+
+	if(job->bus >= pool->buses)
+		pool->buses = job->bus + 1;
+
+	pool->pending++;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	pool_notify(pool);
+}
+
+
+/**
+ * Wait until every submitted job is processed
+ */
+void pool_wait(struct pool *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+
+	while(pool->pending > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Print the load of every bus and the work of every worker
+ */
+void pool_report(const struct pool *pool) {
+
+	int i;
+
+	for(i=0; i<pool->buses; i++) {
+
+		if(pool->bus[i].transfers == 0)
+			continue;
+
+		printf("bus %d:    %lu transfers, %lld us busy\n", i,
+				pool->bus[i].transfers, pool->bus[i].busy_ns / 1000LL);
+	}
+
+	for(i=0; i<pool->workers; i++) {
+
+		printf("worker %d: %lu transfers, %lu processed, %lu stolen\n", i,
+				pool->worker[i].transferred, pool->worker[i].processed, pool->worker[i].stolen);
+	}
+}
+
+
+/**
+ * Worker thread (internal function)
+ */
+static void *pool_worker_main(void *argument) {
+
+	struct pool_worker *self = argument;
+	struct pool *pool = self->pool;
+	struct pool_job *job;
+	unsigned long sequence;
+	int i, bus, buses;
+
+	for(;;) {
+
+		pthread_mutex_lock(&pool->lock);
+
+		if(pool->stop) {
+
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		sequence = pool->sequence;
+		buses    = pool->buses;
+
+		pthread_mutex_unlock(&pool->lock);
+
+		// Keep a bus busy: home bus first, then any free bus with work
+		job = NULL;
+
+		for(i=0; i<buses && job == NULL; i++) {
+
+			bus = (self->home + i) % buses;
+			job = pool_take_transfer(pool, bus);
+		}
+
+		if(job) {
+
+			pool_transfer(pool, job, self->index);
+			continue;
+		}
+
+		// CPU side of own transfers, newest first while it is cache hot
+		if((job = pool_deque_pop(pool, self->index)) != NULL) {
+
+			pool_process(pool, job);
+			self->processed++;
+			continue;
+		}
+
+		// Steal the oldest CPU side work of busy workers
+		for(i=1; i<pool->workers && job == NULL; i++)
+			job = pool_deque_steal(pool, (self->index + i) % pool->workers);
+
+		if(job) {
+
+			pool_process(pool, job);
+			self->processed++;
+			self->stolen++;
+			continue;
+		}
+
+		// Nothing to do, sleep until new work was announced
+		pthread_mutex_lock(&pool->lock);
+
+		while(!pool->stop && pool->sequence == sequence)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Take the next job of a bus and own the bus, NULL if the bus is owned or
+ * has no work (internal function)
+ */
+static inline struct pool_job *pool_take_transfer(struct pool *pool, int bus) {
+
+	struct pool_bus *queue = &pool->bus[bus];
+	struct pool_job *job = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if(!queue->owned && queue->head) {
+
+		job = queue->head;
+		queue->head = job->next;
+
+		if(queue->head == NULL)
+			queue->tail = NULL;
+
+		queue->owned = 1;
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return job;
+}
+
+
+/**
+ * Run the bus side of a job and queue its CPU side on the worker
+ * (internal function)
+ */
+static inline void pool_transfer(struct pool *pool, struct pool_job *job, int worker) {
+
+	struct pool_worker *self = &pool->worker[worker];
+	struct pool_bus *queue = &pool->bus[job->bus];
+	struct timespec start, end;
+	unsigned char full;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	job->result = job->transfer(job);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	pthread_mutex_lock(&queue->lock);
+
+	queue->owned = 0;
+	queue->transfers++;
+	queue->busy_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	self->transferred++;
+
+	pthread_mutex_lock(&self->lock);
+
+	full = self->bottom - self->top >= POOL_DEQUE;
+
+	if(!full)
+		self->deque[self->bottom++ % POOL_DEQUE] = job;
+
+	pthread_mutex_unlock(&self->lock);
+
+	if(full) {
+
+		pool_process(pool, job);
+		self->processed++;
+	}
+
+	// The bus is free again and there may be work to steal
+	pool_notify(pool);
+}
+
+
+/**
+ * Run the CPU side of a job and book it as done (internal function)
+ */
+static inline void pool_process(struct pool *pool, struct pool_job *job) {
+
+	if(job->process)
+		job->process(job);
+
+	pthread_mutex_lock(&pool->lock);
+
+	if(--pool->pending == 0)
+		pthread_cond_broadcast(&pool->done);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Pop the newest entry of the own deque (internal function)
+ */
+static inline struct pool_job *pool_deque_pop(struct pool *pool, int worker) {
+
+	struct pool_worker *self = &pool->worker[worker];
+	struct pool_job *job = NULL;
+
+	pthread_mutex_lock(&self->lock);
+
+	if(self->bottom != self->top)
+		job = self->deque[--self->bottom % POOL_DEQUE];
+
+	pthread_mutex_unlock(&self->lock);
+
+	return job;
+}
+
+
+/**
+ * Take the oldest entry of another worker's deque (internal function)
+ */
+static inline struct pool_job *pool_deque_steal(struct pool *pool, int victim) {
+
+	struct pool_worker *other = &pool->worker[victim];
+	struct pool_job *job = NULL;
+
+	pthread_mutex_lock(&other->lock);
+
+	if(other->bottom != other->top)
+		job = other->deque[other->top++ % POOL_DEQUE];
+
+	pthread_mutex_unlock(&other->lock);
+
+	return job;
+}
+
+
+/**
+ * Announce new work to sleeping workers (internal function)
+ */
+static inline void pool_notify(struct pool *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->sequence++;
+	pthread_cond_broadcast(&pool->wake);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+#endif /* LIBPOOL_H_ */
@@ -0,0 +1,94 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libprobe.h defines static tracepoints (USDT) for the SMBus layer and
+ *  the sensor drivers, for bpftrace and perf.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBPROBE_H_
+#define LIBPROBE_H_
+
+/*
+ * The probes use <sys/sdt.h> of SystemTap (package systemtap-sdt-dev or
+ * systemtap-sdt-devel). Without it, or built with -DPROBE_DISABLE, they
+ * compile to nothing.
+ *
+ * A probe site is a nop and its arguments are registers or stack slots.
+ * Each probe has a semaphore, which the tracer increments while it is
+ * attached. PROBE_ENABLED() reads it, so arguments that cost something to
+ * compute are only computed while tracing. Every probe of a translation
+ * unit needs its PROBE_SEMAPHORE(), also the ones that are never guarded.
+ *
+ * List the probes of a binary:
+ * 	readelf -n ./bmp085 | grep -A2 stapsdt
+ * 	bpftrace -l 'usdt:./bmp085:*'
+ *
+ * The scripts in userspace/i2c/trace compute the latency of each phase.
+ */
+#if !defined(PROBE_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define PROBE_SDT 1
+#endif
+#endif
+
+
+#ifdef PROBE_SDT
+
+#define PROBE_SEMAPHORE(provider, name) \
+	unsigned short provider##_##name##_semaphore __attribute__((unused, section(".probes")))
+
+#define PROBE_ENABLED(provider, name) __builtin_expect(provider##_##name##_semaphore, 0)
+
+#define PROBE0(provider, name)                      DTRACE_PROBE(provider, name)
+#define PROBE1(provider, name, a1)                  DTRACE_PROBE1(provider, name, a1)
+#define PROBE2(provider, name, a1, a2)              DTRACE_PROBE2(provider, name, a1, a2)
+#define PROBE3(provider, name, a1, a2, a3)          DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define PROBE4(provider, name, a1, a2, a3, a4)      DTRACE_PROBE4(provider, name, a1, a2, a3, a4)
+#define PROBE5(provider, name, a1, a2, a3, a4, a5)  DTRACE_PROBE5(provider, name, a1, a2, a3, a4, a5)
+
+#else
+
+#define PROBE_SEMAPHORE(provider, name) struct probe_##provider##_##name
+
+#define PROBE_ENABLED(provider, name) 0
+
+#define PROBE0(provider, name)                      do {} while(0)
+#define PROBE1(provider, name, a1)                  do {} while(0)
+#define PROBE2(provider, name, a1, a2)              do {} while(0)
+#define PROBE3(provider, name, a1, a2, a3)          do {} while(0)
+#define PROBE4(provider, name, a1, a2, a3, a4)      do {} while(0)
+#define PROBE5(provider, name, a1, a2, a3, a4, a5)  do {} while(0)
+
+#endif
+
+
+#endif /* LIBPROBE_H_ */
@@ -0,0 +1,453 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libpsychro.h derives dew point, frost point, vapour pressure and
+ *  absolute humidity from temperature and relative humidity, e.g. from
+ *  struct hih6130_value or struct bmp280_value.
+ *
+ *  All quantities use the Magnus formula with the WMO coefficients
+ *  (Sonntag 1990), relative humidity over water:
+ *
+ *    a     = 17.62 * T / (243.12 + T)
+ *    gamma = ln(RH / 100) + a
+ *    e     = 6.112 hPa * RH / 100 * exp(a)
+ *    Td    = 243.12 * gamma / (17.62 - gamma)
+ *    Tf    = 272.62 * gamma / (22.46 - gamma)
+ *    AH    = 216.68 * e / (273.15 + T)
+ *
+ *  The formula itself is within 0.35 deg C of the Hyland-Wexler
+ *  equations between -45 and 60 deg C.
+ *
+ *  ln() and exp() are replaced by short polynomial approximations, there
+ *  are no libm calls. Compared with the same formula evaluated in double
+ *  precision with libm, for -40..85 deg C and 0.5..100 %RH:
+ *
+ *    float:   dew/frost point < 0.0001 deg C,
+ *             vapour pressure and absolute humidity < 0.0002 % relative
+ *    integer: dew/frost point < 0.0051 deg C, absolute humidity
+ *             < 0.0051 g/m3, vapour pressure < 0.51 Pa (mostly the
+ *             rounding to the output unit)
+ *
+ *  The integer functions only use 32/64 bit integer arithmetic for soft
+ *  float targets. They take and return centi units like
+ *  hih6130_decode_frames_centi(): 0.01 deg C, 0.01 %RH, 0.01 hPa (= Pa)
+ *  and 0.01 g/m3.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBPSYCHRO_H_
+#define LIBPSYCHRO_H_
+
+#define PSYCHRO_MIN_RH        0.01f  ///< Lower limit of RH, ln(0) is undefined
+#define PSYCHRO_MIN_RH_CENTI  1      ///< Lower limit of RH in 0.01 %RH
+
+/*
+ * Q30 constants of the integer functions
+ */
+#define PSYCHRO_Q30_ONE       (1LL<<30)
+#define PSYCHRO_Q30_LN2       744261118LL     ///< ln(2)
+#define PSYCHRO_Q30_LOG2E_M1  475340181LL     ///< log2(e) - 1
+#define PSYCHRO_Q30_LN10000   9889527671LL    ///< ln(10000), 100 %RH in 0.01 %RH
+#define PSYCHRO_Q30_B_WATER   18919330939LL   ///< 17.62
+#define PSYCHRO_Q30_B_ICE     24116241367LL   ///< 22.46
+
+
+/** FUNCTION DEFINITONS **/
+
+float psychro_vapour_pressure(float temperature, float humidity);
+float psychro_dew_point(float temperature, float humidity);
+float psychro_frost_point(float temperature, float humidity);
+float psychro_absolute_humidity(float temperature, float humidity);
+void psychro_batch(const float *temperature, const float *humidity, int count,
+		float *dew_point, float *frost_point, float *absolute_humidity, float *vapour_pressure);
+
+int psychro_vapour_pressure_centi(int temperature, int humidity);
+int psychro_dew_point_centi(int temperature, int humidity);
+int psychro_frost_point_centi(int temperature, int humidity);
+int psychro_absolute_humidity_centi(int temperature, int humidity);
+void psychro_batch_centi(const short *temperature, const short *humidity, int count,
+		int *dew_point, int *frost_point, int *absolute_humidity, int *vapour_pressure);
+
+static inline float psychro_fast_ln(float x);
+static inline float psychro_fast_exp(float x);
+static inline float psychro_gamma(float temperature, float humidity, float *a);
+
+static inline long long psychro_ln_q30(int n);
+static inline long long psychro_exp_q30(long long x);
+static inline long long psychro_gamma_q30(int temperature, int humidity, long long *a);
+static inline long long psychro_vapour_pressure_q10(int temperature, int humidity);
+
+
+
+/** FUNCTIONS **/
+
+/**
+ * Natural logarithm, absolute error < 3e-8 plus float rounding
+ * \note Internal function, x must be a positive normal number
+ */
+static inline float psychro_fast_ln(float x) {
+
+	union { float f; int i; } u;
+	float m, s, s2;
+	int e;
+
+	// x = m * 2^e with m in [sqrt(1/2), sqrt(2))
+	u.f = x;
+	e   = ((u.i >> 23) & 0xFF) - 127;
+	u.i = (u.i & 0x007FFFFF) | 0x3F800000;
+	m   = u.f;
+
+	if(m > 1.41421356f) {
+
+		m *= 0.5f;
+		e++;
+	}
+
+	// ln(m) = 2 atanh(s), |s| < 0.172
+	s  = (m - 1.0f) / (m + 1.0f);
+	s2 = s * s;
+
+	return (float)e * 0.69314718f
+		 + 2.0f * s * (1.0f + s2 * (0.33333333f + s2 * (0.2f + s2 * 0.14285714f)));
+}
+
+
+/**
+ * Exponential function, relative error < 1.1e-7 plus float rounding
+ * \note Internal function, |x| < 87
+ */
+static inline float psychro_fast_exp(float x) {
+
+	union { float f; int i; } u;
+	float y, f;
+	int n;
+
+	// e^x = 2^n * 2^f with f in [0, 1)
+	y = x * 1.44269504f;
+	n = (int)y;
+
+	if((float)n > y)
+		n--;
+
+	f = y - (float)n;
+
+	u.i = (n + 127) << 23;
+
+	return u.f * (0.99999990f + f * (0.69315449f + f * (0.24014182f
+		 + f * (0.05586034f + f * (0.00894959f + f * 0.00189375f)))));
+}
+
+
+/**
+ * gamma = ln(RH / 100) + a of the Magnus formula
+ * \note Internal function
+ */
+static inline float psychro_gamma(float temperature, float humidity, float *a) {
+
+	if(humidity < PSYCHRO_MIN_RH)
+		humidity = PSYCHRO_MIN_RH;
+
+	*a = 17.62f * temperature / (243.12f + temperature);
+
+	return psychro_fast_ln(humidity * 0.01f) + *a;
+}
+
+
+/**
+ * Get the water vapour pressure
+ * \param temperature in deg C
+ * \param humidity in %RH
+ * \return Vapour pressure in hPa
+ */
+float psychro_vapour_pressure(float temperature, float humidity) {
+
+	float a = 17.62f * temperature / (243.12f + temperature);
+
+	return 0.06112f * humidity * psychro_fast_exp(a);
+}
+
+
+/**
+ * Get the dew point
+ * \param temperature in deg C
+ * \param humidity in %RH
+ * \return Dew point in deg C
+ */
+float psychro_dew_point(float temperature, float humidity) {
+
+	float a, gamma;
+
+	gamma = psychro_gamma(temperature, humidity, &a);
+
+	return 243.12f * gamma / (17.62f - gamma);
+}
+
+
+/**
+ * Get the frost point (saturation over ice)
+ * \param temperature in deg C
+ * \param humidity in %RH (over water, as measured by the sensors)
+ * \return Frost point in deg C
+ */
+float psychro_frost_point(float temperature, float humidity) {
+
+	float a, gamma;
+
+	gamma = psychro_gamma(temperature, humidity, &a);
+
+	return 272.62f * gamma / (22.46f - gamma);
+}
+
+
+/**
+ * Get the absolute humidity
+ * \param temperature in deg C
+ * \param humidity in %RH
+ * \return Absolute humidity in g/m3
+ */
+float psychro_absolute_humidity(float temperature, float humidity) {
+
+	return 216.68f * psychro_vapour_pressure(temperature, humidity) / (273.15f + temperature);
+}
+
+
+/**
+ * Derive dew point, frost point, absolute humidity and vapour pressure for
+ * arrays of samples. Any output array may be NULL if the quantity is not
+ * needed. The loop has no calls and no branches on the data, so the
+ * compiler can vectorise it.
+ */
+void psychro_batch(const float *temperature, const float *humidity, int count,
+		float *dew_point, float *frost_point, float *absolute_humidity, float *vapour_pressure) {
+
+	float a, gamma, e;
+	int i;
+
+	for(i=0; i<count; i++) {
+
+		gamma = psychro_gamma(temperature[i], humidity[i], &a);
+
+		if(dew_point)
+			dew_point[i] = 243.12f * gamma / (17.62f - gamma);
+
+		if(frost_point)
+			frost_point[i] = 272.62f * gamma / (22.46f - gamma);
+
+		if(absolute_humidity || vapour_pressure) {
+
+			e = 0.06112f * humidity[i] * psychro_fast_exp(a);
+
+			if(vapour_pressure)
+				vapour_pressure[i] = e;
+
+			if(absolute_humidity)
+				absolute_humidity[i] = 216.68f * e / (273.15f + temperature[i]);
+		}
+	}
+}
+
+
+/**
+ * Natural logarithm of a positive integer in Q30
+ * \note Internal function, absolute error < 1e-7
+ */
+static inline long long psychro_ln_q30(int n) {
+
+	long long m, s, s2, term, sum;
+	int e = 0, k;
+
+	// n = m * 2^e with m in [1, 2)
+	while((n >> e) > 1)
+		e++;
+
+	m = ((long long)n << 30) >> e;
+
+	// ln(m) = 2 atanh(s), s in [0, 1/3)
+	s    = ((m - PSYCHRO_Q30_ONE) << 30) / (m + PSYCHRO_Q30_ONE);
+	s2   = (s * s) >> 30;
+	term = s;
+	sum  = s;
+
+	for(k=3; k<=11; k+=2) {
+
+		term = (term * s2) >> 30;
+		sum += term / k;
+	}
+
+	return e * PSYCHRO_Q30_LN2 + 2 * sum;
+}
+
+
+/**
+ * Exponential function of a Q30 number in Q30
+ * \note Internal function, relative error < 2e-7, |x| < 10
+ */
+static inline long long psychro_exp_q30(long long x) {
+
+	long long y, f, p;
+	int n;
+
+	// e^x = 2^n * 2^f with f in [0, 1)
+	y = x + ((x * PSYCHRO_Q30_LOG2E_M1) >> 30);
+	n = (int)(y >> 30);
+	f = y - ((long long)n << 30);
+
+	p = 2033403LL;
+	p = 9609550LL    + ((p * f) >> 30);
+	p = 59979580LL   + ((p * f) >> 30);
+	p = 257850314LL  + ((p * f) >> 30);
+	p = 744268966LL  + ((p * f) >> 30);
+	p = 1073741715LL + ((p * f) >> 30);
+
+	return (n >= 0) ? (p << n) : (p >> -n);
+}
+
+
+/**
+ * gamma = ln(RH / 100) + a of the Magnus formula in Q30
+ * \note Internal function
+ */
+static inline long long psychro_gamma_q30(int temperature, int humidity, long long *a) {
+
+	if(humidity < PSYCHRO_MIN_RH_CENTI)
+		humidity = PSYCHRO_MIN_RH_CENTI;
+
+	// 17.62 * T / (243.12 + T) with T in 0.01 deg C
+	*a = (PSYCHRO_Q30_B_WATER * temperature) / (24312 + temperature);
+
+	return psychro_ln_q30(humidity) - PSYCHRO_Q30_LN10000 + *a;
+}
+
+
+/**
+ * Vapour pressure in Pa as Q10
+ * \note Internal function
+ */
+static inline long long psychro_vapour_pressure_q10(int temperature, int humidity) {
+
+	long long a, es;
+
+	a = (PSYCHRO_Q30_B_WATER * temperature) / (24312 + temperature);
+
+	// 611.2 Pa * exp(a) in Q10
+	es = (psychro_exp_q30(a) * 6112 / 10) >> 20;
+
+	return es * humidity / 10000;
+}
+
+
+/**
+ * Get the water vapour pressure with integer arithmetic
+ * \param temperature in 0.01 deg C
+ * \param humidity in 0.01 %RH
+ * \return Vapour pressure in Pa (0.01 hPa)
+ */
+int psychro_vapour_pressure_centi(int temperature, int humidity) {
+
+	return (int)((psychro_vapour_pressure_q10(temperature, humidity) + 512) >> 10);
+}
+
+
+/**
+ * Get the dew point with integer arithmetic
+ * \param temperature in 0.01 deg C
+ * \param humidity in 0.01 %RH
+ * \return Dew point in 0.01 deg C
+ */
+int psychro_dew_point_centi(int temperature, int humidity) {
+
+	long long a, gamma, num;
+
+	gamma = psychro_gamma_q30(temperature, humidity, &a);
+	num   = 24312 * gamma;
+
+	return (int)((num + (num >= 0 ? 1 : -1) * ((PSYCHRO_Q30_B_WATER - gamma) / 2))
+			/ (PSYCHRO_Q30_B_WATER - gamma));
+}
+
+
+/**
+ * Get the frost point with integer arithmetic
+ * \param temperature in 0.01 deg C
+ * \param humidity in 0.01 %RH (over water)
+ * \return Frost point in 0.01 deg C
+ */
+int psychro_frost_point_centi(int temperature, int humidity) {
+
+	long long a, gamma, num;
+
+	gamma = psychro_gamma_q30(temperature, humidity, &a);
+	num   = 27262 * gamma;
+
+	return (int)((num + (num >= 0 ? 1 : -1) * ((PSYCHRO_Q30_B_ICE - gamma) / 2))
+			/ (PSYCHRO_Q30_B_ICE - gamma));
+}
+
+
+/**
+ * Get the absolute humidity with integer arithmetic
+ * \param temperature in 0.01 deg C
+ * \param humidity in 0.01 %RH
+ * \return Absolute humidity in 0.01 g/m3
+ */
+int psychro_absolute_humidity_centi(int temperature, int humidity) {
+
+	long long e = psychro_vapour_pressure_q10(temperature, humidity);
+
+	return (int)((21668 * e / (27315 + temperature) + 512) >> 10);
+}
+
+
+/**
+ * Integer version of psychro_batch(), inputs as produced by
+ * hih6130_decode_frames_centi(). Any output array may be NULL.
+ */
+void psychro_batch_centi(const short *temperature, const short *humidity, int count,
+		int *dew_point, int *frost_point, int *absolute_humidity, int *vapour_pressure) {
+
+	int i;
+
+	for(i=0; i<count; i++) {
+
+		if(dew_point)
+			dew_point[i] = psychro_dew_point_centi(temperature[i], humidity[i]);
+
+		if(frost_point)
+			frost_point[i] = psychro_frost_point_centi(temperature[i], humidity[i]);
+
+		if(vapour_pressure)
+			vapour_pressure[i] = psychro_vapour_pressure_centi(temperature[i], humidity[i]);
+
+		if(absolute_humidity)
+			absolute_humidity[i] = psychro_absolute_humidity_centi(temperature[i], humidity[i]);
+	}
+}
+
+
+#endif /* LIBPSYCHRO_H_ */
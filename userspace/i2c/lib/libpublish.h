@@ -0,0 +1,435 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libpublish.h shares the latest sample of each sensor with any number
+ *  of processes through a named POSIX shared memory segment.
+ *
+ *  One publisher process owns the bus and writes every new sample into
+ *  the slot of its channel. Readers map the segment read-only and copy a
+ *  slot: no syscall, no lock, no bus access, and a reader never slows
+ *  down the publisher or the other readers.
+ *
+ *  Each slot is guarded by a seqlock: the publisher makes the sequence
+ *  odd, writes the sample and makes it even again; a reader retries when
+ *  the sequence was odd or changed during its copy. Slots are 64 byte
+ *  cache lines, a write to one channel does not disturb readers of
+ *  another.
+ *
+ *  A publisher that dies in the middle of a write leaves the sequence
+ *  odd. The segment holds the pid of the publisher; a reader that keeps
+ *  failing checks it and gives up with PUB_GONE when the process is gone
+ *  or the write has not finished after PUB_TIMEOUT. A new publisher
+ *  releases the slots left odd.
+ *
+ *  Compiling Options:
+ *   -lrt (glibc before 2.17)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBPUBLISH_H_
+#define LIBPUBLISH_H_
+
+#define PUB_MAGIC    0x42555049u  ///< "IPUB" of a published segment
+#define PUB_VERSION  2
+#define PUB_CHANNELS 64           ///< Most channels of a segment
+#define PUB_SPINS    1000         ///< Failed copies before a reader checks the publisher
+#define PUB_TIMEOUT  100000000LL  ///< Longest write a reader waits for in ns
+
+#define PUB_GONE     -1           ///< pub_read(): publisher died or hangs in a write
+
+#define PUB_BMP085   1            ///< Sample of a BMP085
+#define PUB_HIH6130  2            ///< Sample of a HIH6130
+
+
+/** FUNCTION DEFINITONS **/
+
+struct pub;
+struct pub_sample;
+
+void pub_create(struct pub *pub, const char *name, int channels);
+void pub_attach(struct pub *pub, const char *name);
+void pub_detach(struct pub *pub);
+void pub_unlink(const char *name);
+void pub_write(struct pub *pub, int channel, const struct pub_sample *sample);
+int pub_read(const struct pub *pub, int channel, struct pub_sample *sample);
+
+static inline void pub_map(struct pub *pub, const char *name, int create, int channels);
+static inline int pub_alive(const struct pub *pub);
+static inline long long pub_now(int clock);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A published sample
+ * 	time:     publication time in ns of CLOCK_REALTIME
+ * 	sequence: samples published on the channel, 0 if none yet
+ * 	kind:     PUB_BMP085 or PUB_HIH6130
+ * 	status:   status of the sample (HIH6130)
+ */
+struct pub_sample {
+	long long time;
+	unsigned int sequence;
+	unsigned char kind;
+	unsigned char status;
+	unsigned short reserved;
+	float temperature;
+	float pressure;
+	float humidity;
+	float altitude;
+	unsigned int reserved2;
+};
+
+
+/**
+ * A channel, one cache line
+ * 	lock: seqlock sequence, odd while the publisher writes
+ */
+struct pub_slot {
+	unsigned int lock;
+	unsigned int reserved;
+	struct pub_sample sample;
+	unsigned char padding[64 - 8 - sizeof(struct pub_sample)];
+} __attribute__((aligned(64)));
+
+
+/**
+ * Layout of the segment
+ * 	publisher: pid of the process that created the segment last
+ */
+struct pub_segment {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int channels;
+	int publisher;
+	unsigned char padding[48];
+	struct pub_slot slot[PUB_CHANNELS];
+} __attribute__((aligned(64)));
+
+
+/**
+ * A mapped segment
+ */
+struct pub {
+	int fd;
+	int channels;
+	struct pub_segment *segment;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+/**
+ * Create a segment as publisher, an existing one is reused
+ * \param name Segment name, e.g. "/i2c-sensors"
+ * \param channels Number of channels, at most PUB_CHANNELS
+ */
+void pub_create(struct pub *pub, const char *name, int channels) {
+
+	pub_map(pub, name, 1, channels);
+}
+
+
+/**
+ * Attach to a segment as reader
+ */
+void pub_attach(struct pub *pub, const char *name) {
+
+	pub_map(pub, name, 0, 0);
+}
+
+
+/**
+ * Unmap a segment
+ */
+void pub_detach(struct pub *pub) {
+
+	munmap(pub->segment, sizeof(struct pub_segment));
+	close(pub->fd);
+
+	pub->segment = NULL;
+	pub->fd      = -1;
+}
+
+
+/**
+ * Remove a segment name, mapped segments stay valid
+ */
+void pub_unlink(const char *name) {
+
+	shm_unlink(name);
+}
+
+
+/**
+ * Publish the sample of a channel, only one process may write a channel
+ * The time and sequence of sample are filled in.
+ */
+void pub_write(struct pub *pub, int channel, const struct pub_sample *sample) {
+
+	struct pub_slot *slot;
+	struct pub_sample copy;
+	const unsigned int *from;
+	unsigned int *to, lock;
+	unsigned int i;
+
+	if(channel < 0 || channel >= pub->channels)
+		return;
+
+	slot = &pub->segment->slot[channel];
+
+	copy          = *sample;
+	copy.time     = pub_now(CLOCK_REALTIME);
+	copy.sequence = slot->sample.sequence + 1;
+
+	lock = slot->lock;
+
+	// Odd: readers retry; the fence keeps the data stores after it
+	__atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	from = (const unsigned int *)&copy;
+	to   = (unsigned int *)&slot->sample;
+
+	for(i=0; i<sizeof(copy)/sizeof(*to); i++)
+		__atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+
+	__atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Read the latest sample of a channel, consistent and without syscalls
+ * While the publisher writes the slot the copy is retried, after
+ * PUB_SPINS failed copies the reader checks that the publisher is still
+ * alive and yields the CPU to it.
+ * \return 1, 0 if the channel has no sample yet or does not exist,
+ *         PUB_GONE if the publisher died or did not finish a write within
+ *         PUB_TIMEOUT ns, sample is undefined then
+ */
+int pub_read(const struct pub *pub, int channel, struct pub_sample *sample) {
+
+	const struct pub_slot *slot;
+	const unsigned int *from;
+	unsigned int *to, before, after;
+	unsigned int i, retries = 0;
+	long long deadline = 0;
+
+	if(channel < 0 || channel >= pub->channels)
+		return 0;
+
+	slot = &pub->segment->slot[channel];
+	from = (const unsigned int *)&slot->sample;
+	to   = (unsigned int *)sample;
+
+	do {
+
+		if(retries > 0 && retries % PUB_SPINS == 0) {
+
+			// Held for long: the publisher is preempted, stopped or dead
+			if(!pub_alive(pub))
+				return PUB_GONE;
+
+			if(deadline == 0)
+				deadline = pub_now(CLOCK_MONOTONIC) + PUB_TIMEOUT;
+			else if(pub_now(CLOCK_MONOTONIC) > deadline)
+				return PUB_GONE;
+
+			sched_yield();
+		}
+
+		retries++;
+
+		before = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+
+		for(i=0; i<sizeof(*sample)/sizeof(*to); i++)
+			to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		after = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+
+	} while((before & 1) || before != after);
+
+	return sample->sequence != 0;
+}
+
+
+/**
+ * Open and map a segment (internal function)
+ */
+static inline void pub_map(struct pub *pub, const char *name, int create, int channels) {
+
+	struct pub_segment *segment;
+	int i;
+
+	if(create && (channels < 1 || channels > PUB_CHANNELS)) {
+
+		printf("Error while create segment %s: %d channels not in 1..%d\n", name, channels, PUB_CHANNELS);
+		exit(1);
+	}
+
+	if((pub->fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDONLY, 0644)) < 0) {
+
+		printf("Error while open segment %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	if(create && ftruncate(pub->fd, sizeof(struct pub_segment)) < 0) {
+
+		perror("Error while size segment:");
+		exit(1);
+	}
+
+	segment = mmap(NULL, sizeof(struct pub_segment), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, pub->fd, 0);
+
+	if(segment == MAP_FAILED) {
+
+		perror("Error while map segment:");
+		exit(1);
+	}
+
+	if(create) {
+
+		segment->version   = PUB_VERSION;
+		segment->channels  = channels;
+		segment->publisher = getpid();
+
+		// Release the slots a dead publisher left in the middle of a write
+		for(i=0; i<PUB_CHANNELS; i++) {
+
+			if(segment->slot[i].lock & 1)
+				__atomic_store_n(&segment->slot[i].lock, segment->slot[i].lock + 1, __ATOMIC_RELEASE);
+		}
+
+		__atomic_store_n(&segment->magic, PUB_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	if(__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != PUB_MAGIC || segment->version != PUB_VERSION) {
+
+		printf("Error while open segment %s: not published\n", name);
+		exit(1);
+	}
+
+	pub->segment  = segment;
+	pub->channels = segment->channels;
+}
+
+
+/**
+ * Publisher process still exists (internal function)
+ */
+static inline int pub_alive(const struct pub *pub) {
+
+	pid_t publisher = __atomic_load_n(&pub->segment->publisher, __ATOMIC_RELAXED);
+
+	// EPERM: it exists but belongs to another user
+	return publisher <= 0 || kill(publisher, 0) == 0 || errno == EPERM;
+}
+
+
+/**
+ * Time of a clock in ns (internal function)
+ */
+static inline long long pub_now(int clock) {
+
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+#endif /* LIBPUBLISH_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBPUBLISH_BMP085_)
+#define LIBPUBLISH_BMP085_
+
+/**
+ * Publish a BMP085 sample
+ */
+static inline void pub_write_bmp085(struct pub *pub, int channel, const struct bmp085_value *value) {
+
+	struct pub_sample sample;
+
+	memset(&sample, 0, sizeof(sample));
+
+	sample.kind        = PUB_BMP085;
+	sample.temperature = value->temperature;
+	sample.pressure    = value->pressure;
+	sample.altitude    = value->altitude;
+
+	pub_write(pub, channel, &sample);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBPUBLISH_HIH6130_)
+#define LIBPUBLISH_HIH6130_
+
+/**
+ * Publish a HIH6130 sample
+ */
+static inline void pub_write_hih6130(struct pub *pub, int channel, const struct hih6130_value *value) {
+
+	struct pub_sample sample;
+
+	memset(&sample, 0, sizeof(sample));
+
+	sample.kind        = PUB_HIH6130;
+	sample.status      = value->status;
+	sample.temperature = value->temperature;
+	sample.humidity    = value->humidity;
+
+	pub_write(pub, channel, &sample);
+}
+
+#endif
@@ -0,0 +1,589 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libreactor.h runs many sensor tasks as stackless coroutines on one
+ *  thread, driven by epoll and a timerfd.
+ *
+ *  A task is a function written as straight-line code between
+ *  REACTOR_BEGIN() and REACTOR_END(). REACTOR_SLEEP() and REACTOR_AWAIT_FD()
+ *  suspend it: the function returns to the reactor and continues after
+ *  the await when the time has passed or the fd is ready. All state that
+ *  lives across an await must be kept in the struct reactor_task (or the
+ *  driver handle it points to), since locals are not preserved; there is
+ *  no stack per task, so thousands of tasks cost a few dozen bytes each.
+ *  switch() can not be used around an await inside a task.
+ *
+ *  Several tasks may await the same fd, e.g. one eventfd signalled by an
+ *  interrupt handler. The reactor keeps one epoll registration per fd
+ *  with the events of all its waiters and resumes every waiter whose
+ *  events are ready, so each of them has to cope with a read that finds
+ *  nothing left (EAGAIN on a non-blocking fd).
+ *
+ *  Reading a BMP085 with the split driver calls:
+ *
+ *    static int read_bmp085(struct reactor *reactor, struct reactor_task *task) {
+ *
+ *        struct bmp085_device *dev = task->dev;
+ *        struct bmp085_value *value = task->value;
+ *
+ *        REACTOR_BEGIN(task);
+ *
+ *        for(;;) {
+ *
+ *            REACTOR_SLEEP(reactor, task, bmp085_start_temperature(dev));
+ *            bmp085_fetch_temperature(dev);
+ *
+ *            REACTOR_SLEEP(reactor, task, bmp085_start_pressure(dev));
+ *            value->temperature = bmp085_calc_temperature(&dev->calibration, dev->ut);
+ *            value->pressure    = bmp085_calc_pressure(&dev->calibration,
+ *                                     dev->oversampling, bmp085_fetch_pressure(dev));
+ *
+ *            publish(value);
+ *            REACTOR_SLEEP(reactor, task, 100000);
+ *        }
+ *
+ *        REACTOR_END(task);
+ *    }
+ *
+ *  REACTOR_AWAIT_SAMPLE() does the same for any driver with a
+ *  poll_value()/time_to_ready() pair (see libsched.h), e.g.
+ *  REACTOR_AWAIT_SAMPLE(reactor, task, hih6130_poll_value(dev, value),
+ *  hih6130_time_to_ready(dev)).
+ *
+ *  Bus transfers are plain blocking i2c-dev calls on the reactor thread,
+ *  so the transfers of one adapter (of all adapters) never overlap, and
+ *  the code between two awaits runs without any other task in between:
+ *  a multi-transfer sequence on one bus needs no lock.
+ *
+ *  This is the C counterpart of a C++20 co_await layer; the libraries
+ *  here are C and get compiled as C.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBREACTOR_H_
+#define LIBREACTOR_H_
+
+#include <time.h>
+
+#define REACTOR_WAIT 0  ///< Task function return: suspended in an await
+#define REACTOR_DONE 1  ///< Task function return: finished
+
+#define REACTOR_EVENTS 64  ///< epoll events handled per wakeup
+
+
+/*
+ * Coroutine macros, see above. Each await stores the source line as
+ * resume point, so only one await per line is possible. An await returns
+ * from the task function: a local variable set before it holds garbage
+ * after it, keep such values in task->state, task->user, ...
+ */
+#define REACTOR_BEGIN(task) switch((task)->line) { case 0:
+
+#define REACTOR_END(task) } (task)->line = 0; return REACTOR_DONE
+
+#define REACTOR_SLEEP(reactor, task, us) \
+	do { \
+		reactor_sleep((reactor), (task), (us)); \
+		(task)->line = __LINE__; \
+		return REACTOR_WAIT; \
+		case __LINE__:; \
+	} while(0)
+
+#define REACTOR_YIELD(reactor, task) REACTOR_SLEEP(reactor, task, 0)
+
+#define REACTOR_AWAIT_FD(reactor, task, fd, events) \
+	do { \
+		reactor_watch((reactor), (task), (fd), (events)); \
+		(task)->line = __LINE__; \
+		return REACTOR_WAIT; \
+		case __LINE__:; \
+	} while(0)
+
+#define REACTOR_AWAIT_SAMPLE(reactor, task, poll, time_to_ready) \
+	do { \
+		while(!(poll)) { \
+			reactor_sleep((reactor), (task), (time_to_ready)); \
+			(task)->line = __LINE__; \
+			return REACTOR_WAIT; \
+			case __LINE__:; \
+		} \
+	} while(0)
+
+
+/** FUNCTION DEFINITONS **/
+
+struct reactor;
+struct reactor_task;
+
+void reactor_init(struct reactor *reactor, struct reactor_task **heap, int max);
+void reactor_close(struct reactor *reactor);
+void reactor_spawn(struct reactor *reactor, struct reactor_task *task,
+		int (*run)(struct reactor *reactor, struct reactor_task *task));
+void reactor_sleep(struct reactor *reactor, struct reactor_task *task, long us);
+void reactor_watch(struct reactor *reactor, struct reactor_task *task, int fd, unsigned int events);
+void reactor_run(struct reactor *reactor);
+void reactor_stop(struct reactor *reactor);
+
+static inline long long reactor_now(void);
+static inline void reactor_resume(struct reactor *reactor, struct reactor_task *task);
+static inline void reactor_ready(struct reactor *reactor, int fd, unsigned int revents);
+static inline void reactor_heap_push(struct reactor *reactor, struct reactor_task *task);
+static inline struct reactor_task *reactor_heap_pop(struct reactor *reactor);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A coroutine
+ * 	run:     task function
+ * 	line:    resume point, 0 before the start
+ * 	wake:    CLOCK_MONOTONIC ns the sleeping task is due
+ * 	fd:      fd awaited by REACTOR_AWAIT_FD(), -1 if none
+ * 	events:  epoll events awaited on fd
+ * 	revents: epoll events of the awaited fd
+ * 	next:    next task awaiting an fd
+ * 	dev:     free for the task, e.g. a driver handle
+ * 	value:   free for the task, e.g. the sample storage
+ * 	user:    free for the task
+ * 	state:   free for the task, e.g. a loop counter kept over awaits
+ */
+struct reactor_task {
+	int (*run)(struct reactor *reactor, struct reactor_task *task);
+	int line;
+	long long wake;
+	int fd;
+	unsigned int events;
+	unsigned int revents;
+	struct reactor_task *next;
+	void *dev;
+	void *value;
+	void *user;
+	long state;
+};
+
+
+/**
+ * The reactor
+ * 	epoll:   epoll instance, watches timer and the awaited fds
+ * 	timer:   timerfd armed on the earliest sleeping task
+ * 	armed:   ns the timer is armed on, 0 if disarmed
+ * 	heap:    sleeping tasks, min-heap by wake, array of max provided by
+ * 	         the caller
+ * 	waiting: tasks awaiting an fd, linked by next
+ * 	tasks:   tasks not yet finished
+ * 	resumes: task function calls
+ * 	wakeups: returns of epoll_wait()
+ */
+struct reactor {
+	int epoll;
+	int timer;
+	long long armed;
+	struct reactor_task **heap;
+	int count;
+	int max;
+	struct reactor_task *waiting;
+	int tasks;
+	unsigned char stop;
+	unsigned long resumes;
+	unsigned long wakeups;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+
+/**
+ * Set up a reactor for up to max sleeping tasks
+ */
+void reactor_init(struct reactor *reactor, struct reactor_task **heap, int max) {
+
+	struct epoll_event event;
+
+	memset(reactor, 0, sizeof(*reactor));
+
+	reactor->heap = heap;
+	reactor->max  = max;
+
+	if((reactor->epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+
+		perror("Error while create epoll:");
+		exit(1);
+	}
+
+	if((reactor->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0) {
+
+		perror("Error while create timerfd:");
+		exit(1);
+	}
+
+	// Registrations carry the fd, the waiting tasks are looked up by it
+	memset(&event, 0, sizeof(event));
+	event.events  = EPOLLIN;
+	event.data.fd = reactor->timer;
+
+	if(epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, reactor->timer, &event) < 0) {
+
+		perror("Error while watch timerfd:");
+		exit(1);
+	}
+}
+
+
+/**
+ * Close the epoll instance and the timer
+ */
+void reactor_close(struct reactor *reactor) {
+
+	close(reactor->timer);
+	close(reactor->epoll);
+}
+
+
+/**
+ * Start a task, it runs first on the next turn of reactor_run()
+ */
+void reactor_spawn(struct reactor *reactor, struct reactor_task *task,
+		int (*run)(struct reactor *reactor, struct reactor_task *task)) {
+
+	task->run  = run;
+	task->line = 0;
+	task->fd   = -1;
+	task->next = NULL;
+
+	reactor->tasks++;
+
+	reactor_sleep(reactor, task, 0);
+}
+
+
+/**
+ * Suspend a task for us micro seconds, use REACTOR_SLEEP() in tasks
+ * A negative time (e.g. -1 from a driver's time_to_ready()) resumes on
+ * the next turn.
+ */
+void reactor_sleep(struct reactor *reactor, struct reactor_task *task, long us) {
+
+	task->wake = reactor_now() + (us > 0 ? (long long)us * 1000LL : 0LL);
+
+	reactor_heap_push(reactor, task);
+}
+
+
+/**
+ * Suspend a task until an fd is ready, use REACTOR_AWAIT_FD() in tasks
+ * \param events EPOLLIN, EPOLLOUT, EPOLLPRI, ...; the ready events end
+ * up in task->revents
+ * Other tasks may await the same fd at the same time.
+ */
+void reactor_watch(struct reactor *reactor, struct reactor_task *task, int fd, unsigned int events) {
+
+	struct epoll_event event;
+	struct reactor_task *other;
+	int op = EPOLL_CTL_ADD;
+
+	memset(&event, 0, sizeof(event));
+	event.events  = events;
+	event.data.fd = fd;
+
+	// One registration per fd, it watches the events of all waiters
+	for(other=reactor->waiting; other; other=other->next) {
+
+		if(other->fd == fd) {
+
+			event.events |= other->events;
+			op = EPOLL_CTL_MOD;
+		}
+	}
+
+	task->fd     = fd;
+	task->events = events;
+	task->next   = reactor->waiting;
+
+	reactor->waiting = task;
+
+	if(epoll_ctl(reactor->epoll, op, fd, &event) < 0) {
+
+		perror("Error while watch fd:");
+		exit(1);
+	}
+}
+
+
+/**
+ * Run the tasks until all are finished or reactor_stop() was called
+ */
+void reactor_run(struct reactor *reactor) {
+
+	struct epoll_event events[REACTOR_EVENTS];
+	struct itimerspec timer;
+	struct reactor_task *task;
+	unsigned long long expirations;
+	long long now;
+	int count, i, timeout;
+
+	reactor->stop = 0;
+
+	while(reactor->tasks > 0 && !reactor->stop) {
+
+		// Resume every task that is due
+		now = reactor_now();
+
+		while(reactor->count > 0 && reactor->heap[0]->wake <= now) {
+
+			task = reactor_heap_pop(reactor);
+			reactor_resume(reactor, task);
+		}
+
+		if(reactor->tasks == 0 || reactor->stop)
+			break;
+
+		// Arm the timer on the earliest sleeping task
+		timeout = -1;
+
+		if(reactor->count > 0 && reactor->heap[0]->wake != reactor->armed) {
+
+			memset(&timer, 0, sizeof(timer));
+
+			reactor->armed = reactor->heap[0]->wake;
+
+			timer.it_value.tv_sec  = reactor->armed / 1000000000LL;
+			timer.it_value.tv_nsec = reactor->armed % 1000000000LL;
+
+			if(timerfd_settime(reactor->timer, TFD_TIMER_ABSTIME, &timer, NULL) < 0) {
+
+				perror("Error while arm timerfd:");
+				exit(1);
+			}
+		}
+
+		// A task that became due meanwhile is served without sleeping
+		if(reactor->count > 0 && reactor->heap[0]->wake <= reactor_now())
+			timeout = 0;
+
+		count = epoll_wait(reactor->epoll, events, REACTOR_EVENTS, timeout);
+
+		if(count < 0) {
+
+			if(errno == EINTR)
+				continue;
+
+			perror("Error while wait for events:");
+			exit(1);
+		}
+
+		reactor->wakeups++;
+
+		for(i=0; i<count; i++) {
+
+			if(events[i].data.fd == reactor->timer) {
+
+				// Timer, the due tasks are resumed on top of the loop
+				if(read(reactor->timer, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+
+					perror("Error while read timerfd:");
+					exit(1);
+				}
+
+				reactor->armed = 0;
+				continue;
+			}
+
+			reactor_ready(reactor, events[i].data.fd, events[i].events);
+		}
+	}
+}
+
+
+/**
+ * Let reactor_run() return after the current turn, e.g. from a task
+ */
+void reactor_stop(struct reactor *reactor) {
+
+	reactor->stop = 1;
+}
+
+
+/**
+ * CLOCK_MONOTONIC time in ns (internal function)
+ */
+static inline long long reactor_now(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/**
+ * Continue a task at its resume point (internal function)
+ */
+static inline void reactor_resume(struct reactor *reactor, struct reactor_task *task) {
+
+	reactor->resumes++;
+
+	if(task->run(reactor, task) == REACTOR_DONE)
+		reactor->tasks--;
+}
+
+
+/**
+ * Resume the tasks awaiting fd that got one of their events, the others
+ * keep waiting (internal function)
+ * One-shot: a resumed task registers again if it awaits once more.
+ */
+static inline void reactor_ready(struct reactor *reactor, int fd, unsigned int revents) {
+
+	struct epoll_event event;
+	struct reactor_task **link, *task, *ready = NULL;
+
+	memset(&event, 0, sizeof(event));
+	event.data.fd = fd;
+
+	// Unlink the ready waiters first, a resumed task may await fd again
+	link = &reactor->waiting;
+
+	while((task = *link) != NULL) {
+
+		if(task->fd != fd) {
+
+			link = &task->next;
+			continue;
+		}
+
+		if(revents & (task->events | EPOLLERR | EPOLLHUP)) {
+
+			*link      = task->next;
+			task->next = ready;
+			ready      = task;
+			continue;
+		}
+
+		event.events |= task->events;
+		link = &task->next;
+	}
+
+	if(event.events)
+		epoll_ctl(reactor->epoll, EPOLL_CTL_MOD, fd, &event);
+	else
+		epoll_ctl(reactor->epoll, EPOLL_CTL_DEL, fd, NULL);
+
+	while((task = ready) != NULL) {
+
+		ready = task->next;
+
+		task->revents = revents & (task->events | EPOLLERR | EPOLLHUP);
+		task->fd      = -1;
+		task->next    = NULL;
+
+		reactor_resume(reactor, task);
+	}
+}
+
+
+/**
+ * Add a sleeping task to the heap (internal function)
+ */
+static inline void reactor_heap_push(struct reactor *reactor, struct reactor_task *task) {
+
+	struct reactor_task **heap = reactor->heap;
+	int i, parent;
+
+	if(reactor->count >= reactor->max) {
+
+		printf("Error while suspend task: more than %d sleeping tasks\n", reactor->max);
+		exit(1);
+	}
+
+	i = reactor->count++;
+
+	while(i > 0) {
+
+		parent = (i - 1) / 2;
+
+		if(heap[parent]->wake <= task->wake)
+			break;
+
+		heap[i] = heap[parent];
+		i = parent;
+	}
+
+	heap[i] = task;
+}
+
+
+/**
+ * Remove the earliest sleeping task from the heap (internal function)
+ */
+static inline struct reactor_task *reactor_heap_pop(struct reactor *reactor) {
+
+	struct reactor_task **heap = reactor->heap;
+	struct reactor_task *top, *last;
+	int i = 0, child;
+
+	top  = heap[0];
+	last = heap[--reactor->count];
+
+	for(;;) {
+
+		child = 2 * i + 1;
+
+		if(child >= reactor->count)
+			break;
+
+		if(child + 1 < reactor->count && heap[child + 1]->wake < heap[child]->wake)
+			child++;
+
+		if(last->wake <= heap[child]->wake)
+			break;
+
+		heap[i] = heap[child];
+		i = child;
+	}
+
+	if(reactor->count > 0)
+		heap[i] = last;
+
+	return top;
+}
+
+
+#endif /* LIBREACTOR_H_ */
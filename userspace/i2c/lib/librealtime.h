@@ -0,0 +1,391 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  librealtime.h is an opt-in real-time profile for acquisition threads.
+ *
+ *  On a loaded system a sampling thread is delayed by tens of ms when it
+ *  is preempted by normal tasks or takes a page fault on a stack or heap
+ *  page that was never touched or has been swapped out. realtime_enter()
+ *  applies, to the calling thread:
+ *
+ *    - SCHED_FIFO with the given priority
+ *    - affinity to a CPU set, e.g. an isolated core
+ *    - mlockall(MCL_CURRENT | MCL_FUTURE), no heap trimming and no mmap
+ *      for malloc, so memory once touched stays resident
+ *    - prefaulted stack and a prefaulted, locked buffer pool that
+ *      realtime_alloc() hands out without calling malloc
+ *
+ *  All buffers the loop needs should be taken from the pool (or be
+ *  static) before sampling starts. The libraries in this directory do not
+ *  allocate on their own, their state lives in caller provided structs.
+ *
+ *  realtime_selftest() samples periodically with libperiodic.h and
+ *  reports the worst-case wakeup latency, the worst-case latency of a
+ *  read callback and the page faults taken during the test.
+ *
+ *  SCHED_FIFO and mlockall() need CAP_SYS_NICE and CAP_IPC_LOCK (or
+ *  root and a sufficient RLIMIT_MEMLOCK).
+ *
+ *  Compiling Options:
+ *   -D_GNU_SOURCE (cpu_set_t, before the first system header)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBREALTIME_H_
+#define LIBREALTIME_H_
+
+// cpu_set_t and CPU_SET() are GNU extensions, a define here would come
+// too late for system headers included before
+#ifndef _GNU_SOURCE
+#error "librealtime.h needs -D_GNU_SOURCE"
+#endif
+
+#include <sched.h>
+
+#include "libperiodic.h"
+
+#define REALTIME_PRIORITY 80            ///< Default SCHED_FIFO priority
+#define REALTIME_STACK    (256 * 1024)  ///< Default stack to prefault in bytes
+#define REALTIME_POOL     (1024 * 1024) ///< Default buffer pool in bytes
+
+
+/** FUNCTION DEFINITONS **/
+
+struct realtime_profile;
+struct realtime_selftest;
+
+void realtime_profile_init(struct realtime_profile *profile);
+int realtime_parse_cpus(const char *list, cpu_set_t *cpus);
+int realtime_enter(struct realtime_profile *profile);
+void *realtime_alloc(size_t size);
+void realtime_selftest(struct realtime_selftest *test, long period, int count,
+		int (*sample)(void *context), void *context);
+void realtime_report(const struct realtime_selftest *test);
+
+static __attribute__((noinline)) void realtime_prefault_stack(size_t size);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Real-time profile of a thread
+ * 	priority:  SCHED_FIFO priority 1..99, 0 keeps the scheduling policy
+ * 	cpus:      CPUs the thread may run on, empty keeps the affinity
+ * 	lock:      lock all current and future memory
+ * 	stack:     bytes of stack to prefault
+ * 	pool:      bytes of the prefaulted buffer pool for realtime_alloc()
+ */
+struct realtime_profile {
+	int priority;
+	cpu_set_t cpus;
+	unsigned char lock;
+	size_t stack;
+	size_t pool;
+};
+
+
+/**
+ * Result of realtime_selftest()
+ * 	wakeup:        lateness of the periodic wakeups
+ * 	read:          duration of the sample callback, in the same histogram
+ * 	               form (period and skip counters unused)
+ * 	minor_faults:  minor page faults of the process during the test
+ * 	major_faults:  major page faults of the process during the test
+ * 	errors:        read callbacks that returned < 0
+ */
+struct realtime_selftest {
+	struct periodic wakeup;
+	struct periodic read;
+	long minor_faults;
+	long major_faults;
+	unsigned long errors;
+};
+
+
+
+/** RUNTIME VARIABLES **/
+
+/**
+ * Buffer pool of realtime_alloc(), set up by realtime_enter()
+ */
+unsigned char *realtime_pool = NULL;
+size_t realtime_pool_size = 0;
+size_t realtime_pool_used = 0;
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+
+/**
+ * Default profile: priority REALTIME_PRIORITY, all CPUs, memory locked,
+ * REALTIME_STACK and REALTIME_POOL bytes
+ */
+void realtime_profile_init(struct realtime_profile *profile) {
+
+	memset(profile, 0, sizeof(*profile));
+
+	CPU_ZERO(&profile->cpus);
+
+	profile->priority = REALTIME_PRIORITY;
+	profile->lock     = 1;
+	profile->stack    = REALTIME_STACK;
+	profile->pool     = REALTIME_POOL;
+}
+
+
+/**
+ * Parse a CPU list like "2" or "0-1,3" into a CPU set
+ * \return 0 on success, -1 on a malformed list
+ */
+int realtime_parse_cpus(const char *list, cpu_set_t *cpus) {
+
+	char *end;
+	long first, last;
+
+	CPU_ZERO(cpus);
+
+	while(*list) {
+
+		first = strtol(list, &end, 10);
+
+		if(end == list || first < 0)
+			return -1;
+
+		last = first;
+		list = end;
+
+		if(*list == '-') {
+
+			last = strtol(list + 1, &end, 10);
+
+			if(end == list + 1 || last < first)
+				return -1;
+
+			list = end;
+		}
+
+		if(last >= CPU_SETSIZE)
+			return -1;
+
+		for(; first <= last; first++)
+			CPU_SET(first, cpus);
+
+		if(*list == ',')
+			list++;
+		else if(*list)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Apply a real-time profile to the calling thread
+ * Call it once before the sampling loop, after the sensors are opened
+ * and all other buffers are set up. Steps that fail (usually for missing
+ * privileges) are reported and the remaining ones still applied.
+ * \return 0 if every step was applied, -1 otherwise
+ */
+int realtime_enter(struct realtime_profile *profile) {
+
+	struct sched_param param;
+	int result = 0;
+
+	if(CPU_COUNT(&profile->cpus) > 0 && sched_setaffinity(0, sizeof(profile->cpus), &profile->cpus) < 0) {
+
+		perror("Error while set CPU affinity:");
+		result = -1;
+	}
+
+	if(profile->lock) {
+
+		// Keep freed memory in the heap and never hand out fresh mmap pages
+		mallopt(M_TRIM_THRESHOLD, -1);
+		mallopt(M_MMAP_MAX, 0);
+
+		if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+
+			perror("Error while lock memory:");
+			result = -1;
+		}
+	}
+
+	if(profile->pool > 0 && realtime_pool == NULL) {
+
+		if((realtime_pool = malloc(profile->pool)) == NULL) {
+
+			perror("Error while allocate buffer pool:");
+			return -1;
+		}
+
+		// Touch every page so it is resident (and locked) from now on
+		memset(realtime_pool, 0, profile->pool);
+
+		realtime_pool_size = profile->pool;
+		realtime_pool_used = 0;
+	}
+
+	realtime_prefault_stack(profile->stack);
+
+	if(profile->priority > 0) {
+
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = profile->priority;
+
+		if(sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+
+			perror("Error while set SCHED_FIFO:");
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+
+/**
+ * Take a zeroed buffer from the prefaulted pool, never calls malloc
+ * \return The buffer (16 byte aligned), NULL if the pool is exhausted
+ */
+void *realtime_alloc(size_t size) {
+
+	void *buffer;
+
+	size = (size + 15) & ~(size_t)15;
+
+	if(realtime_pool == NULL || size > realtime_pool_size - realtime_pool_used)
+		return NULL;
+
+	buffer = realtime_pool + realtime_pool_used;
+	realtime_pool_used += size;
+
+	return buffer;
+}
+
+
+/**
+ * Latency self-test of the calling thread
+ * Wakes up count times every period us and calls sample(context) each
+ * time, e.g. a blocking sensor read. Run it after realtime_enter() with
+ * the same load the system sees in production.
+ * \param sample Callback, may be NULL to test the wakeup latency only
+ */
+void realtime_selftest(struct realtime_selftest *test, long period, int count,
+		int (*sample)(void *context), void *context) {
+
+	struct rusage before, after;
+	struct timespec start, end;
+	int i;
+
+	memset(test, 0, sizeof(*test));
+
+	getrusage(RUSAGE_SELF, &before);
+
+	periodic_init(&test->wakeup, period, PERIODIC_SKIP, PERIODIC_SLACK_DEFAULT);
+
+	for(i=0; i<count; i++) {
+
+		periodic_wait(&test->wakeup, NULL);
+
+		if(sample == NULL)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if(sample(context) < 0)
+			test->errors++;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		periodic_record(&test->read, periodic_ns(&end) - periodic_ns(&start));
+	}
+
+	periodic_close(&test->wakeup);
+
+	getrusage(RUSAGE_SELF, &after);
+
+	test->minor_faults = after.ru_minflt - before.ru_minflt;
+	test->major_faults = after.ru_majflt - before.ru_majflt;
+}
+
+
+/**
+ * Print the result of realtime_selftest()
+ */
+void realtime_report(const struct realtime_selftest *test) {
+
+	int policy = sched_getscheduler(0);
+
+	printf("Policy %s, %ld minor and %ld major page faults during the test\n",
+			policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_OTHER",
+			test->minor_faults, test->major_faults);
+
+	printf("\nWakeup latency: ");
+	periodic_report(&test->wakeup);
+
+	if(test->read.samples == 0)
+		return;
+
+	printf("\nRead latency: %lu errors, ", test->errors);
+	periodic_report(&test->read);
+}
+
+
+/**
+ * Touch size bytes of stack so the pages are resident (internal function)
+ * Not inlined, the array must live in its own frame below the caller.
+ */
+static __attribute__((noinline)) void realtime_prefault_stack(size_t size) {
+
+	volatile unsigned char *stack;
+	size_t i;
+
+	if(size == 0)
+		return;
+
+	stack = alloca(size);
+
+	for(i=0; i<size; i+=4096)
+		stack[i] = 0;
+}
+
+
+#endif /* LIBREALTIME_H_ */
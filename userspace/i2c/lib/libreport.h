@@ -0,0 +1,314 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libreport.h forwards a sample stream only when the value has changed
+ *  meaningfully, to save uplink bandwidth and consumer wakeups.
+ *
+ *  Each quantity has a band: the larger of an absolute deadband and a
+ *  relative one (a fraction of the value). Two modes:
+ *
+ *    deadband:       a sample is reported when it is more than the band
+ *                    away from the last reported value; a consumer
+ *                    holding the last value is never off by more
+ *    swinging door:  a sample is reported when the straight line from
+ *                    the last reported point to the next sample would
+ *                    leave the band of a sample in between; the point
+ *                    reported is the last sample that still fit, i.e. it
+ *                    is one sample late, and a consumer interpolating
+ *                    linearly between points is never off by more than
+ *                    the band
+ *
+ *  A heartbeat reports the current sample after a maximum silence, so a
+ *  consumer can tell a steady value from a dead sensor.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBREPORT_H_
+#define LIBREPORT_H_
+
+#define REPORT_DEADBAND       0   ///< Report on leaving the band around the last report
+#define REPORT_SWINGING_DOOR  1   ///< Report the corners of a piecewise linear trace
+
+
+/** FUNCTION DEFINITONS **/
+
+struct report;
+
+void report_init(struct report *report, int mode, float absolute, float relative, long long heartbeat,
+				 void (*notify)(struct report *report, long long time, float value), void *user);
+void report_update(struct report *report, long long time, float value);
+void report_flush(struct report *report);
+void report_print(const struct report *report, const char *name);
+
+static inline void report_emit(struct report *report, long long time, float value);
+static inline float report_band(const struct report *report, float value);
+static inline void report_open_door(struct report *report);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Reporting of one quantity
+ * 	mode:       REPORT_DEADBAND or REPORT_SWINGING_DOOR
+ * 	absolute:   band in the unit of the value
+ * 	relative:   band as fraction of the value, e.g. 0.001
+ * 	heartbeat:  longest time without report, in the unit of the
+ * 	            timestamps; 0 for none
+ * 	notify:     called for each reported point
+ * 	time:       last reported point
+ * 	held:       last sample, not reported yet (swinging door)
+ * 	upper:      smallest slope from the last report that passes below
+ * 	            the upper band of all samples since
+ * 	lower:      largest slope that passes above their lower band
+ * 	samples:    samples seen
+ * 	emitted:    points reported
+ * 	heartbeats: of emitted, reported by the heartbeat
+ */
+struct report {
+	int mode;
+	float absolute;
+	float relative;
+	long long heartbeat;
+	void (*notify)(struct report *report, long long time, float value);
+	void *user;
+	unsigned char started;
+	unsigned char pending;
+	long long time;
+	float value;
+	long long held_time;
+	float held_value;
+	double upper;
+	double lower;
+	unsigned long samples;
+	unsigned long emitted;
+	unsigned long heartbeats;
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <math.h>
+
+
+/**
+ * Initialize the reporting of a quantity
+ * \param absolute, relative Band, 0 to disable one of them
+ * \param heartbeat Longest silence, 0 for none
+ * \param notify Callback of a reported point, user is for its use
+ */
+void report_init(struct report *report, int mode, float absolute, float relative, long long heartbeat,
+				 void (*notify)(struct report *report, long long time, float value), void *user) {
+
+	report->mode       = mode;
+	report->absolute   = absolute;
+	report->relative   = relative;
+	report->heartbeat  = heartbeat;
+	report->notify     = notify;
+	report->user       = user;
+	report->started    = 0;
+	report->pending    = 0;
+	report->samples    = 0;
+	report->emitted    = 0;
+	report->heartbeats = 0;
+}
+
+
+/**
+ * Add a sample, timestamps strictly increasing
+ */
+void report_update(struct report *report, long long time, float value) {
+
+	double band, slope;
+
+	report->samples++;
+
+	// The first sample is always reported
+	if(!report->started) {
+
+		report->started = 1;
+		report_emit(report, time, value);
+		report_open_door(report);
+		return;
+	}
+
+	if(report->mode == REPORT_DEADBAND) {
+
+		if(fabsf(value - report->value) > report_band(report, report->value)) {
+
+			report_emit(report, time, value);
+		}
+		else if(report->heartbeat > 0 && time - report->time >= report->heartbeat) {
+
+			report->heartbeats++;
+			report_emit(report, time, value);
+		}
+
+		return;
+	}
+
+	// Swinging door: the line to the sample must pass the bands of the samples before
+	slope = (value - report->value) / (double)(time - report->time);
+
+	if(slope > report->upper || slope < report->lower) {
+
+		// Door closed: the held sample is the corner, start anew from it
+		report_emit(report, report->held_time, report->held_value);
+		report_open_door(report);
+	}
+
+	// Narrow the door by the band of the sample
+	band  = report_band(report, report->value);
+	slope = (value + band - report->value) / (double)(time - report->time);
+
+	if(slope < report->upper)
+		report->upper = slope;
+
+	slope = (value - band - report->value) / (double)(time - report->time);
+
+	if(slope > report->lower)
+		report->lower = slope;
+
+	report->held_time  = time;
+	report->held_value = value;
+	report->pending    = 1;
+
+	// The sample fits the door, reporting it keeps the error bound
+	if(report->heartbeat > 0 && time - report->time >= report->heartbeat) {
+
+		report->heartbeats++;
+		report_flush(report);
+	}
+}
+
+
+/**
+ * Report the held sample of a swinging door, e.g. at the end of a stream
+ */
+void report_flush(struct report *report) {
+
+	if(report->pending) {
+
+		report_emit(report, report->held_time, report->held_value);
+		report_open_door(report);
+	}
+}
+
+
+/**
+ * Print the counters of a quantity
+ */
+void report_print(const struct report *report, const char *name) {
+
+	printf("%s: %lu samples, %lu reported (%lu heartbeats), %lu suppressed, %.1f%%\n", name,
+			report->samples, report->emitted, report->heartbeats,
+			report->samples > report->emitted ? report->samples - report->emitted : 0,
+			report->samples ? 100.0 * report->emitted / report->samples : 0.0);
+}
+
+
+/**
+ * Report a point (internal function)
+ */
+static inline void report_emit(struct report *report, long long time, float value) {
+
+	report->time  = time;
+	report->value = value;
+
+	report->emitted++;
+
+	if(report->notify)
+		report->notify(report, time, value);
+}
+
+
+/**
+ * Band around a value (internal function)
+ */
+static inline float report_band(const struct report *report, float value) {
+
+	float relative = report->relative * fabsf(value);
+
+	return relative > report->absolute ? relative : report->absolute;
+}
+
+
+/**
+ * Fully open door at a reported point (internal function)
+ */
+static inline void report_open_door(struct report *report) {
+
+	report->upper   = HUGE_VAL;
+	report->lower   = -HUGE_VAL;
+	report->pending = 0;
+}
+
+
+#endif /* LIBREPORT_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBREPORT_BMP085_)
+#define LIBREPORT_BMP085_
+
+/**
+ * Add a BMP085 sample to a temperature and a pressure report
+ */
+static inline void report_update_bmp085(struct report *temperature, struct report *pressure, long long time, const struct bmp085_value *value) {
+
+	report_update(temperature, time, value->temperature);
+	report_update(pressure, time, value->pressure);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBREPORT_HIH6130_)
+#define LIBREPORT_HIH6130_
+
+/**
+ * Add a HIH6130 sample to a humidity and a temperature report, stale
+ * samples are left out
+ */
+static inline void report_update_hih6130(struct report *humidity, struct report *temperature, long long time, const struct hih6130_value *value) {
+
+	if(value->status != HIH6130_STATUS_NORMAL)
+		return;
+
+	report_update(humidity, time, value->humidity);
+	report_update(temperature, time, value->temperature);
+}
+
+#endif
@@ -0,0 +1,877 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libsamplelog.h writes samples into a compact binary ring file and
+ *  reads them back.
+ *
+ *  File layout, all fields in host byte order:
+ *
+ *    page 0:   struct slog_header (magic, geometry)
+ *    block n:  struct slog_block, then the records, SLOG_BLOCK bytes each
+ *
+ *  The file has a fixed size and is used as a ring of blocks: block
+ *  sequence s lives in slot s % blocks, so the newest data overwrites the
+ *  oldest. Every block is self-contained, its records are delta coded
+ *  against the previous record of the same kind in the block only, so a
+ *  reader can start at any block and an overwritten block does not affect
+ *  the others.
+ *
+ *  A record is a varint tag (channel, status, kind), the timestamp in us
+ *  as zigzag varint delta and the raw and compensated values as zigzag
+ *  varint deltas:
+ *
+ *    BMP085:  UT, UP, temperature in 0.1 deg C, pressure in Pa
+ *    HIH6130: raw humidity and raw temperature (14 bit); the
+ *             compensated values are an exact function of them
+ *
+ *  A record takes 6 to 10 bytes, a line of text with the same values
+ *  about 40. The values are stored in the integer units the drivers
+ *  compute in, so decoding gives bit identical floats.
+ *
+ *  The file is mapped shared: an appended record is visible to readers
+ *  and survives a crash of the writer as soon as slog_append() returns
+ *  (the block's used counter is the commit point and is stored last);
+ *  slog_sync() also flushes it to the disk. On reopen the writer
+ *  continues in a new block after the newest one.
+ *
+ *  Include libbmp085.h and libhih6130.h before this header to get
+ *  slog_append_bmp085()/slog_append_hih6130() and the matching decoders.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBSAMPLELOG_H_
+#define LIBSAMPLELOG_H_
+
+#define SLOG_MAGIC       0x474f4c53u  ///< "SLOG" of the file header and of valid blocks
+#define SLOG_VERSION     1
+#define SLOG_BLOCK       4096         ///< Block size in bytes
+#define SLOG_RECORD_MAX  64           ///< Longest encoded record
+
+#define SLOG_BMP085      1            ///< Record kind of a BMP085 sample
+#define SLOG_HIH6130     2            ///< Record kind of a HIH6130 sample
+
+
+/** FUNCTION DEFINITONS **/
+
+struct slog;
+struct slog_record;
+struct slog_cursor;
+
+void slog_open(struct slog *log, const char *path, size_t size);
+void slog_open_read(struct slog *log, const char *path);
+void slog_close(struct slog *log);
+void slog_sync(struct slog *log);
+void slog_append(struct slog *log, const struct slog_record *record);
+
+void slog_first(struct slog_cursor *cursor, struct slog *log);
+void slog_seek(struct slog_cursor *cursor, struct slog *log, long long time);
+int slog_next(struct slog_cursor *cursor, struct slog_record *record);
+
+static inline void slog_map(struct slog *log, const char *path, int writable, size_t size);
+static inline struct slog_block *slog_block_at(const struct slog *log, unsigned long long sequence);
+static inline void slog_start_block(struct slog *log, long long time);
+static inline void slog_cursor_block(struct slog_cursor *cursor, unsigned long long sequence);
+static inline void slog_refresh(struct slog *log);
+static inline int slog_fields(unsigned char kind);
+static inline unsigned char *slog_put_varint(unsigned char *out, unsigned long long value);
+static inline const unsigned char *slog_get_varint(const unsigned char *in, const unsigned char *end, unsigned long long *value);
+static inline unsigned long long slog_zigzag(long long value);
+static inline long long slog_unzigzag(unsigned long long value);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * A decoded sample
+ * 	time:    timestamp in us, e.g. CLOCK_REALTIME
+ * 	channel: sensor number chosen by the writer (0..4095)
+ * 	kind:    SLOG_BMP085 or SLOG_HIH6130
+ * 	status:  status bits of the sample (HIH6130), 0..3
+ * 	raw:     BMP085: UT, UP; HIH6130: raw humidity, raw temperature
+ * 	value:   BMP085: temperature in 0.1 deg C, pressure in Pa
+ */
+struct slog_record {
+	long long time;
+	unsigned short channel;
+	unsigned char kind;
+	unsigned char status;
+	int raw[2];
+	int value[2];
+};
+
+
+/**
+ * File header in page 0
+ */
+struct slog_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int block_size;
+	unsigned int blocks;
+};
+
+
+/**
+ * Block header
+ * 	magic:    SLOG_MAGIC while the block holds the data of sequence
+ * 	used:     bytes of record data, commit point of the records
+ * 	sequence: running block number, starts at 1
+ * 	first:    timestamp of the first record
+ * 	last:     timestamp of the last record
+ * 	count:    records in the block
+ */
+struct slog_block {
+	unsigned int magic;
+	unsigned int used;
+	unsigned long long sequence;
+	long long first;
+	long long last;
+	unsigned int count;
+	unsigned int reserved;
+};
+
+#define SLOG_DATA (SLOG_BLOCK - (int)sizeof(struct slog_block))  ///< Record bytes per block
+
+
+/**
+ * Delta coding state of one record kind
+ */
+struct slog_delta {
+	long long time;
+	int field[4];
+};
+
+
+/**
+ * An open log
+ * 	map:      the mapped file
+ * 	blocks:   number of blocks in the ring
+ * 	newest:   sequence of the newest block, 0 if empty
+ * 	oldest:   sequence of the oldest block still in the ring
+ * 	restart:  the next record starts a new block
+ * 	delta:    writer state by kind of the newest block
+ */
+struct slog {
+	int fd;
+	unsigned char writable;
+	unsigned char restart;
+	unsigned char *map;
+	size_t size;
+	unsigned int blocks;
+	unsigned long long newest;
+	unsigned long long oldest;
+	struct slog_delta delta[3];
+};
+
+
+/**
+ * Read position in a log
+ */
+struct slog_cursor {
+	struct slog *log;
+	unsigned long long sequence;
+	unsigned int offset;
+	struct slog_delta delta[3];
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/**
+ * Open or create a log for writing
+ * \param size File size in bytes for a new file, rounded down to whole
+ * blocks (at least 2); an existing file keeps its size
+ */
+void slog_open(struct slog *log, const char *path, size_t size) {
+
+	slog_map(log, path, 1, size);
+
+	// Continue in a fresh block, the last one may be half written
+	log->restart = 1;
+}
+
+
+/**
+ * Open a log for reading, a writer may append at the same time
+ */
+void slog_open_read(struct slog *log, const char *path) {
+
+	slog_map(log, path, 0, 0);
+}
+
+
+/**
+ * Unmap and close a log
+ */
+void slog_close(struct slog *log) {
+
+	munmap(log->map, log->size);
+	close(log->fd);
+
+	log->map = NULL;
+	log->fd  = -1;
+}
+
+
+/**
+ * Flush the written records to the disk
+ */
+void slog_sync(struct slog *log) {
+
+	if(msync(log->map, log->size, MS_SYNC) < 0) {
+
+		perror("Error while sync sample log:");
+		exit(1);
+	}
+}
+
+
+/**
+ * Append a record
+ * Records should be appended in time order; a timestamp before the
+ * previous record is stored as is, but slog_seek() assumes the blocks are
+ * ordered.
+ */
+void slog_append(struct slog *log, const struct slog_record *record) {
+
+	unsigned char buffer[SLOG_RECORD_MAX], *out;
+	struct slog_block *block;
+	struct slog_delta *delta;
+	int fields, i, field[4];
+
+	if(record->kind != SLOG_BMP085 && record->kind != SLOG_HIH6130)
+		return;
+
+	block = log->newest ? slog_block_at(log, log->newest) : NULL;
+
+	// Start with a new block if there is none or the record may not fit
+	if(block == NULL || log->restart || block->used + SLOG_RECORD_MAX > SLOG_DATA) {
+
+		slog_start_block(log, record->time);
+		block = slog_block_at(log, log->newest);
+	}
+
+	delta  = &log->delta[record->kind];
+	fields = slog_fields(record->kind);
+
+	field[0] = record->raw[0];
+	field[1] = record->raw[1];
+	field[2] = record->value[0];
+	field[3] = record->value[1];
+
+	out = slog_put_varint(buffer, ((unsigned long long)(record->channel & 0x0FFF) << 4)
+								| ((record->status & 0x03) << 2) | record->kind);
+	out = slog_put_varint(out, slog_zigzag(record->time - delta->time));
+
+	for(i=0; i<fields; i++)
+		out = slog_put_varint(out, slog_zigzag((long long)field[i] - delta->field[i]));
+
+	delta->time = record->time;
+
+	for(i=0; i<fields; i++)
+		delta->field[i] = field[i];
+
+	memcpy((unsigned char *)(block + 1) + block->used, buffer, out - buffer);
+
+	block->last = record->time;
+	block->count++;
+
+	// Commit: the record is complete before used covers it
+	__atomic_store_n(&block->used, block->used + (unsigned int)(out - buffer), __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Position a cursor on the oldest record
+ */
+void slog_first(struct slog_cursor *cursor, struct slog *log) {
+
+	cursor->log = log;
+
+	slog_cursor_block(cursor, log->oldest);
+}
+
+
+/**
+ * Position a cursor on the first record at or after a time
+ * Binary search over the blocks, then a scan of one block.
+ */
+void slog_seek(struct slog_cursor *cursor, struct slog *log, long long time) {
+
+	struct slog_block *block;
+	struct slog_record record;
+	struct slog_cursor probe;
+	unsigned long long low, high, middle;
+
+	cursor->log = log;
+
+	low  = log->oldest;
+	high = log->newest;
+
+	// Last block whose first record is not after time
+	while(low < high) {
+
+		middle = low + (high - low + 1) / 2;
+		block  = slog_block_at(log, middle);
+
+		if(block && block->first <= time)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	slog_cursor_block(cursor, low);
+
+	// Skip the records before time
+	for(;;) {
+
+		probe = *cursor;
+
+		if(!slog_next(&probe, &record) || record.time >= time)
+			break;
+
+		*cursor = probe;
+	}
+}
+
+
+/**
+ * Read the next record
+ * Records of a block the writer recycles meanwhile are dropped, the
+ * cursor then continues with the oldest block.
+ * \return 1 and fills record, 0 at the end of the log
+ */
+int slog_next(struct slog_cursor *cursor, struct slog_record *record) {
+
+	const unsigned char *in, *end, *start;
+	struct slog_block *block;
+	struct slog_delta *delta;
+	unsigned long long value;
+	unsigned int used;
+	int fields, i;
+
+	for(;;) {
+
+		if(cursor->sequence == 0) {
+
+			// Empty log when the cursor was placed
+			slog_refresh(cursor->log);
+
+			if(cursor->log->oldest == 0)
+				return 0;
+
+			slog_cursor_block(cursor, cursor->log->oldest);
+		}
+
+		block = slog_block_at(cursor->log, cursor->sequence);
+
+		// Overwritten by the writer meanwhile: continue with the next block,
+		// unless the block is the newest one and just being started
+		if(block == NULL) {
+
+			slog_refresh(cursor->log);
+
+			if(cursor->sequence >= cursor->log->newest)
+				return 0;
+
+			slog_cursor_block(cursor, cursor->sequence + 1);
+			continue;
+		}
+
+		used = __atomic_load_n(&block->used, __ATOMIC_ACQUIRE);
+
+		if(cursor->offset < used)
+			break;
+
+		if(cursor->sequence == cursor->log->newest) {
+
+			slog_refresh(cursor->log);
+
+			if(cursor->sequence == cursor->log->newest)
+				return 0;
+		}
+
+		slog_cursor_block(cursor, cursor->sequence + 1);
+	}
+
+	start = (const unsigned char *)(block + 1);
+	in    = start + cursor->offset;
+	end   = start + used;
+
+	in = slog_get_varint(in, end, &value);
+
+	record->kind    = value & 0x03;
+	record->status  = (value >> 2) & 0x03;
+	record->channel = (unsigned short)(value >> 4);
+
+	if(record->kind != SLOG_BMP085 && record->kind != SLOG_HIH6130) {
+
+		// Corrupt record, give up on the rest of the block
+		cursor->offset = used;
+		return slog_next(cursor, record);
+	}
+
+	delta  = &cursor->delta[record->kind];
+	fields = slog_fields(record->kind);
+
+	in = slog_get_varint(in, end, &value);
+	delta->time += slog_unzigzag(value);
+
+	for(i=0; i<fields; i++) {
+
+		in = slog_get_varint(in, end, &value);
+		delta->field[i] += (int)slog_unzigzag(value);
+	}
+
+	record->time     = delta->time;
+	record->raw[0]   = delta->field[0];
+	record->raw[1]   = delta->field[1];
+	record->value[0] = fields > 2 ? delta->field[2] : 0;
+	record->value[1] = fields > 3 ? delta->field[3] : 0;
+
+	// Recycled by the writer while decoding: the record may be torn, drop
+	// it and continue with the oldest block still in the ring
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if(slog_block_at(cursor->log, cursor->sequence) != block) {
+
+		slog_refresh(cursor->log);
+		slog_cursor_block(cursor, cursor->log->oldest);
+		return slog_next(cursor, record);
+	}
+
+	cursor->offset = (unsigned int)(in - start);
+
+	return 1;
+}
+
+
+/**
+ * Open and map a log, create it if needed (internal function)
+ */
+static inline void slog_map(struct slog *log, const char *path, int writable, size_t size) {
+
+	struct slog_header *header;
+	struct slog_block *block;
+	struct stat status;
+	unsigned int i;
+
+	memset(log, 0, sizeof(*log));
+
+	log->writable = writable;
+
+	if((log->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644)) < 0) {
+
+		printf("Error while open sample log %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	if(fstat(log->fd, &status) < 0) {
+
+		perror("Error while stat sample log:");
+		exit(1);
+	}
+
+	// New file: fixed size of whole blocks after the header page
+	if(status.st_size == 0 && writable) {
+
+		size = size / SLOG_BLOCK * SLOG_BLOCK;
+
+		if(size < 3 * SLOG_BLOCK)
+			size = 3 * SLOG_BLOCK;
+
+		if(ftruncate(log->fd, size) < 0) {
+
+			perror("Error while size sample log:");
+			exit(1);
+		}
+
+		status.st_size = size;
+	}
+
+	log->size = status.st_size;
+	log->map  = mmap(NULL, log->size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, log->fd, 0);
+
+	if(log->map == MAP_FAILED) {
+
+		perror("Error while map sample log:");
+		exit(1);
+	}
+
+	header = (struct slog_header *)log->map;
+
+	if(header->magic == 0 && writable) {
+
+		header->version    = SLOG_VERSION;
+		header->block_size = SLOG_BLOCK;
+		header->blocks     = log->size / SLOG_BLOCK - 1;
+		header->magic      = SLOG_MAGIC;
+	}
+
+	if(header->magic != SLOG_MAGIC || header->version != SLOG_VERSION || header->block_size != SLOG_BLOCK
+	|| (size_t)(header->blocks + 1) * SLOG_BLOCK > log->size) {
+
+		printf("Error while open sample log %s: not a sample log\n", path);
+		exit(1);
+	}
+
+	log->blocks = header->blocks;
+
+	// Find the newest block, the ring ends there
+	for(i=0; i<log->blocks; i++) {
+
+		block = (struct slog_block *)(log->map + (size_t)(i + 1) * SLOG_BLOCK);
+
+		if(block->magic == SLOG_MAGIC && block->sequence > log->newest)
+			log->newest = block->sequence;
+	}
+
+	log->oldest = log->newest > log->blocks ? log->newest - log->blocks + 1 : 1;
+
+	if(log->newest == 0)
+		log->oldest = 0;
+}
+
+
+/**
+ * Block of a sequence, NULL if it is not (or no longer) in the ring
+ * (internal function)
+ */
+static inline struct slog_block *slog_block_at(const struct slog *log, unsigned long long sequence) {
+
+	struct slog_block *block;
+
+	if(sequence == 0)
+		return NULL;
+
+	block = (struct slog_block *)(log->map + (size_t)(sequence % log->blocks + 1) * SLOG_BLOCK);
+
+	if(__atomic_load_n(&block->magic, __ATOMIC_ACQUIRE) != SLOG_MAGIC
+	|| __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) != sequence)
+		return NULL;
+
+	return block;
+}
+
+
+/**
+ * Take over the oldest slot for a new block (internal function)
+ */
+static inline void slog_start_block(struct slog *log, long long time) {
+
+	struct slog_block *block;
+	unsigned long long sequence = log->newest + 1;
+
+	block = (struct slog_block *)(log->map + (size_t)(sequence % log->blocks + 1) * SLOG_BLOCK);
+
+	// Invalidate first, readers of the old block see it disappear: the
+	// fence keeps every later write to the block (header and records)
+	// behind the cleared magic, like pub_write() does with the lock
+	__atomic_store_n(&block->magic, 0u, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&block->used, 0u, __ATOMIC_RELAXED);
+
+	block->count    = 0;
+	block->first    = time;
+	block->last     = time;
+	block->reserved = 0;
+
+	__atomic_store_n(&block->sequence, sequence, __ATOMIC_RELEASE);
+	__atomic_store_n(&block->magic, SLOG_MAGIC, __ATOMIC_RELEASE);
+
+	log->newest  = sequence;
+	log->oldest  = sequence > log->blocks ? sequence - log->blocks + 1 : 1;
+	log->restart = 0;
+
+	memset(log->delta, 0, sizeof(log->delta));
+}
+
+
+/**
+ * Move a cursor to the start of a block (internal function)
+ */
+static inline void slog_cursor_block(struct slog_cursor *cursor, unsigned long long sequence) {
+
+	slog_refresh(cursor->log);
+
+	if(sequence != 0 && sequence < cursor->log->oldest)
+		sequence = cursor->log->oldest;
+
+	cursor->sequence = sequence;
+	cursor->offset   = 0;
+
+	memset(cursor->delta, 0, sizeof(cursor->delta));
+}
+
+
+/**
+ * Pick up the blocks a writer has started since (internal function)
+ */
+static inline void slog_refresh(struct slog *log) {
+
+	struct slog_block *block;
+	unsigned int i;
+
+	if(log->writable)
+		return;
+
+	// Empty so far or the writer went round the ring since: search the
+	// newest block
+	if(slog_block_at(log, log->newest) == NULL) {
+
+		for(i=0; i<log->blocks; i++) {
+
+			block = (struct slog_block *)(log->map + (size_t)(i + 1) * SLOG_BLOCK);
+
+			if(__atomic_load_n(&block->magic, __ATOMIC_ACQUIRE) == SLOG_MAGIC
+			&& __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) > log->newest)
+				log->newest = __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE);
+		}
+	}
+
+	while(slog_block_at(log, log->newest + 1))
+		log->newest++;
+
+	if(log->newest)
+		log->oldest = log->newest > log->blocks ? log->newest - log->blocks + 1 : 1;
+}
+
+
+/**
+ * Number of delta coded fields of a record kind (internal function)
+ */
+static inline int slog_fields(unsigned char kind) {
+
+	return kind == SLOG_BMP085 ? 4 : 2;
+}
+
+
+/**
+ * LEB128 encoding, 7 bits per byte (internal function)
+ */
+static inline unsigned char *slog_put_varint(unsigned char *out, unsigned long long value) {
+
+	while(value >= 0x80) {
+
+		*out++ = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+
+	*out++ = (unsigned char)value;
+
+	return out;
+}
+
+
+/**
+ * LEB128 decoding, stops at end (internal function)
+ */
+static inline const unsigned char *slog_get_varint(const unsigned char *in, const unsigned char *end, unsigned long long *value) {
+
+	unsigned long long result = 0;
+	int shift = 0;
+
+	while(in < end && shift < 64) {
+
+		result |= (unsigned long long)(*in & 0x7F) << shift;
+		shift += 7;
+
+		if(!(*in++ & 0x80))
+			break;
+	}
+
+	*value = result;
+
+	return in;
+}
+
+
+/**
+ * Signed to unsigned, small magnitudes stay small (internal function)
+ */
+static inline unsigned long long slog_zigzag(long long value) {
+
+	return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+
+/**
+ * Inverse of slog_zigzag() (internal function)
+ */
+static inline long long slog_unzigzag(unsigned long long value) {
+
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+
+#endif /* LIBSAMPLELOG_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBSAMPLELOG_BMP085_)
+#define LIBSAMPLELOG_BMP085_
+
+#include <math.h>
+
+/**
+ * Append a BMP085 sample
+ * \param ut, up Raw readings, e.g. dev->ut and the result of
+ * bmp085_fetch_pressure(); 0 if not known
+ */
+static inline void slog_append_bmp085(struct slog *log, unsigned short channel, long long time, const struct bmp085_value *value, int ut, int up) {
+
+	struct slog_record record;
+
+	record.time     = time;
+	record.channel  = channel;
+	record.kind     = SLOG_BMP085;
+	record.status   = 0;
+	record.raw[0]   = ut;
+	record.raw[1]   = up;
+
+	// The driver computes in these units, the conversion is exact
+	record.value[0] = (int)lrintf(value->temperature * 10.0f);
+	record.value[1] = (int)lrintf(value->pressure * 100.0f);
+
+	slog_append(log, &record);
+}
+
+
+/**
+ * Values of a BMP085 record, bit identical to the ones appended
+ */
+static inline void slog_bmp085_value(const struct slog_record *record, struct bmp085_value *value) {
+
+	value->temperature = (float)record->value[0] / 10.0f;
+	value->pressure    = (float)record->value[1] / 100.0f;
+	value->altitude    = bmp085_get_altitude(value->pressure);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBSAMPLELOG_HIH6130_)
+#define LIBSAMPLELOG_HIH6130_
+
+#include <math.h>
+
+/**
+ * Frame of raw humidity and temperature (internal function)
+ */
+static inline void slog_hih6130_frame(int humidity, int temperature, __u8 *data) {
+
+	data[0] = (humidity >> 8) & 0x3F;
+	data[1] = humidity & 0xFF;
+	data[2] = (temperature >> 6) & 0xFF;
+	data[3] = (temperature << 2) & 0xFC;
+}
+
+
+/**
+ * Append a HIH6130 sample
+ * The raw readings are recovered from the compensated values, the
+ * driver formulas are invertible on the 14 bit range.
+ */
+static inline void slog_append_hih6130(struct slog *log, unsigned short channel, long long time, const struct hih6130_value *value) {
+
+	struct slog_record record;
+	__u8 data[4];
+	int humidity, temperature, i;
+
+	humidity    = (int)lrintf(value->humidity * 163.82f);
+	temperature = (int)lrintf((value->temperature + 40.0f) * 16382.0f / 165.0f);
+
+	// Take the neighbour that gives the same float back
+	for(i=-1; i<=1; i++) {
+
+		slog_hih6130_frame(humidity + i, temperature, data);
+
+		if(humidity + i >= 0 && hih6130_calc_humidity(data) == value->humidity) {
+
+			humidity += i;
+			break;
+		}
+	}
+
+	for(i=-1; i<=1; i++) {
+
+		slog_hih6130_frame(humidity, temperature + i, data);
+
+		if(temperature + i >= 0 && hih6130_calc_temperature(data) == value->temperature) {
+
+			temperature += i;
+			break;
+		}
+	}
+
+	record.time     = time;
+	record.channel  = channel;
+	record.kind     = SLOG_HIH6130;
+	record.status   = value->status;
+	record.raw[0]   = humidity & 0x3FFF;
+	record.raw[1]   = temperature & 0x3FFF;
+	record.value[0] = 0;
+	record.value[1] = 0;
+
+	slog_append(log, &record);
+}
+
+
+/**
+ * Values of a HIH6130 record, bit identical to the ones appended
+ */
+static inline void slog_hih6130_value(const struct slog_record *record, struct hih6130_value *value) {
+
+	__u8 data[4];
+
+	slog_hih6130_frame(record->raw[0], record->raw[1], data);
+
+	value->humidity    = hih6130_calc_humidity(data);
+	value->temperature = hih6130_calc_temperature(data);
+	value->status      = record->status;
+}
+
+#endif
@@ -0,0 +1,853 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libsched.h drives many sensors on one or more i2c buses from a single
+ *  thread and overlaps their conversions.
+ *
+ *  Reading a BMP085 and a HIH6130 one after the other costs the sum of
+ *  all conversion waits (5 ms UT, up to 26 ms UP, ~37 ms for the HIH6130)
+ *  although the bus is idle for nearly all of that time. The scheduler
+ *  uses the non-blocking API of the drivers instead: every sensor is
+ *  asked to do the bus transfers of its next phase as soon as that phase
+ *  is due (start a conversion, read a result and start the next one, ...),
+ *  and the thread sleeps until the earliest due sensor in between. A cycle
+ *  in which every sensor delivers one sample then takes about the longest
+ *  single measurement plus the bus time of all transfers.
+ *
+ *  A sensor is described by struct sched_sensor with two callbacks:
+ *
+ *    poll(sensor):          do the transfers of the due phase, return 1
+ *                           when a sample was completed into sensor->value
+ *    time_to_ready(sensor): us until the next phase is due, 0 if due now,
+ *                           -1 if idle (the next poll starts a measurement)
+ *
+ *  These are the signatures of bmp085_poll_value()/bmp085_time_to_ready()
+ *  and hih6130_poll_value()/hih6130_time_to_ready(); include the driver
+ *  headers before this one to get sched_add_bmp085() and
+ *  sched_add_hih6130().
+ *
+ *  Periodic sensors with different rates and deadlines are run with
+ *  sched_run() instead of sched_cycle(). Every sensor admitted with
+ *  sched_admit() releases a measurement each period, which has to be
+ *  complete within its relative deadline. Of all sensors with a due phase
+ *  the one with the earliest absolute deadline gets the bus (EDF), equal
+ *  deadlines go to the higher priority class (0 is highest). A
+ *  measurement still running at its deadline counts as a miss and the
+ *  sensor continues with its next period.
+ *
+ *  Admission control only admits a sensor if its bus stays below its
+ *  capacity and every sensor on the bus still meets its deadline in the
+ *  worst case:
+ *
+ *    sum(cost / min(deadline, period)) <= capacity
+ *    conversion + cost + sum over the others(cost * (deadline / period + 1))
+ *        <= deadline
+ *
+ *  with cost the bus time of one measurement and conversion the time its
+ *  conversions take. A sensor waits for its own conversions and, at worst,
+ *  for every transfer the other sensors can issue within its deadline
+ *  (the + 1 covers one measurement carried into the window, a transfer is
+ *  never interrupted). The cost estimates start from the driver defaults
+ *  and follow the measured transfer times.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBSCHED_H_
+#define LIBSCHED_H_
+
+#include <time.h>
+
+#define SCHED_MAX_BUS 8  ///< Highest i2c bus number + 1 the statistics cover
+#define SCHED_CLASSES 4  ///< Priority classes, 0 is the highest
+
+#define SCHED_CAPACITY     0.9f  ///< Default share of a bus admission may use
+#define SCHED_DEFAULT_COST 1000  ///< Bus time in us of one measurement, if unknown
+#define SCHED_CYCLE_TIMEOUT 1000000  ///< Default us after which sched_cycle() gives up on a sensor
+
+/*
+ * Bus time of one sample at 100 kHz (90 us per byte incl. ACK)
+ */
+#define SCHED_BMP085_COST   1530  ///< 3 + 5+3 + 6 bytes
+#define SCHED_HIH6130_COST  990   ///< request + two 4 byte frames (one stale poll)
+
+
+/** FUNCTION DEFINITONS **/
+
+struct sched;
+struct sched_sensor;
+
+void sched_init(struct sched *sched, struct sched_sensor *sensor, int max);
+struct sched_sensor *sched_add(struct sched *sched, int bus, void *dev, void *value,
+		int (*poll)(struct sched_sensor *sensor), long (*time_to_ready)(struct sched_sensor *sensor));
+long sched_cycle(struct sched *sched);
+float sched_bus_load(const struct sched *sched, int bus);
+void sched_reset_stats(struct sched *sched);
+
+int sched_admit(struct sched *sched, struct sched_sensor *sensor, long period, long deadline, int priority);
+float sched_bus_utilization(const struct sched *sched, int bus);
+void sched_run(struct sched *sched, long duration);
+void sched_report(const struct sched *sched);
+
+static inline long sched_response(const struct sched *sched, const struct sched_sensor *sensor);
+static inline void sched_account(struct sched *sched, struct sched_sensor *sensor, long long busy);
+static inline void sched_complete_job(struct sched *sched, struct sched_sensor *sensor, long long now);
+
+static inline long long sched_elapsed(const struct timespec *since);
+static inline long long sched_elapsed_ns(const struct timespec *since);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * One sensor of a schedule
+ * 	bus:           i2c bus number the sensor is on
+ * 	dev:           driver handle (struct bmp085_device, ...)
+ * 	value:         receives the sample (struct bmp085_value, ...)
+ * 	poll:          transfers of the due phase, 1 if a sample completed
+ * 	time_to_ready: us until the next phase is due, 0 due, -1 idle
+ * 	done:          called with every completed sample, may be NULL
+ * 	user:          free for the caller, e.g. for done()
+ * 	complete:      sample of the current cycle is in
+ * 	failed:        no sample in the last cycle within sched->timeout
+ * 	failures:      cycles the sensor failed
+ * 	latency:       us from the start of the last cycle (or release) to
+ * 	               its sample
+ * 	samples:       completed samples
+ *
+ * EDF scheduling (sched_admit()/sched_run()), times in us:
+ * 	period:        release interval, 0 if not admitted
+ * 	deadline:      relative to the release
+ * 	priority:      class 0..SCHED_CLASSES-1, breaks deadline ties
+ * 	cost:          estimated bus time of one measurement
+ * 	conversion:    shortest time from start to sample (conversion waits)
+ * 	release:       start of the current or next period since the epoch,
+ * 	               -1 before the first sched_run()
+ * 	due:           absolute deadline of the active measurement
+ * 	active:        a released measurement is not yet complete
+ * 	bus_ns:        bus time of the active measurement so far, ns
+ * 	misses:        measurements not complete by their deadline
+ * 	skipped:       periods not released because the sensor was late
+ */
+struct sched_sensor {
+	int bus;
+	void *dev;
+	void *value;
+	int (*poll)(struct sched_sensor *sensor);
+	long (*time_to_ready)(struct sched_sensor *sensor);
+	void (*done)(struct sched_sensor *sensor);
+	void *user;
+	unsigned char complete;
+	unsigned char failed;
+	unsigned long failures;
+	long latency;
+	unsigned long samples;
+
+	long period;
+	long deadline;
+	int priority;
+	long cost;
+	long conversion;
+	long long release;
+	long long due;
+	unsigned char active;
+	long long bus_ns;
+	unsigned long misses;
+	unsigned long skipped;
+};
+
+
+/**
+ * Statistics of one priority class under sched_run()
+ * 	samples:     completed samples
+ * 	misses:      measurements not complete by their deadline
+ * 	latency_sum: us from release to sample, summed
+ * 	latency_max: longest us from release to sample
+ */
+struct sched_class {
+	unsigned long samples;
+	unsigned long misses;
+	long long latency_sum;
+	long latency_max;
+};
+
+
+/**
+ * Statistics of one i2c bus
+ * 	busy:      ns spent in transfers in the last cycle
+ * 	busy_sum:  ns spent in transfers since the last reset
+ * 	transfers: poll() calls (one phase each) since the last reset
+ */
+struct sched_bus {
+	long long busy;
+	long long busy_sum;
+	unsigned long transfers;
+};
+
+
+/**
+ * A schedule
+ * 	sensor:    array of max sensors, provided by the caller
+ * 	count:     sensors in use
+ * 	bus:       statistics by bus number
+ * 	cycle:     us the last cycle took
+ * 	cycle_sum: us spent in sched_cycle() and sched_run() since the last
+ * 	           reset
+ * 	cycles:    cycles since the last reset
+ * 	timeout:   longest us of a sched_cycle(), SCHED_CYCLE_TIMEOUT;
+ * 	           sensors without a sample by then fail for the cycle
+ * 	sleeps:    times the thread slept for a conversion
+ * 	epoch:     CLOCK_MONOTONIC time the EDF times are relative to
+ * 	capacity:  share of each bus admission may use, SCHED_CAPACITY
+ * 	class:     statistics by priority class
+ */
+struct sched {
+	struct sched_sensor *sensor;
+	int count;
+	int max;
+	struct sched_bus bus[SCHED_MAX_BUS];
+	long cycle;
+	long long cycle_sum;
+	unsigned long cycles;
+	long timeout;
+	unsigned long sleeps;
+	struct timespec epoch;
+	float capacity;
+	struct sched_class class[SCHED_CLASSES];
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/**
+ * Set up an empty schedule
+ * The sensors are kept in the caller's array, nothing is allocated.
+ */
+void sched_init(struct sched *sched, struct sched_sensor *sensor, int max) {
+
+	memset(sched, 0, sizeof(*sched));
+
+	sched->sensor   = sensor;
+	sched->max      = max;
+	sched->capacity = SCHED_CAPACITY;
+	sched->timeout  = SCHED_CYCLE_TIMEOUT;
+
+	clock_gettime(CLOCK_MONOTONIC, &sched->epoch);
+}
+
+
+/**
+ * Add a sensor to a schedule
+ * \return The new entry, e.g. to set done and user
+ */
+struct sched_sensor *sched_add(struct sched *sched, int bus, void *dev, void *value,
+		int (*poll)(struct sched_sensor *sensor), long (*time_to_ready)(struct sched_sensor *sensor)) {
+
+	struct sched_sensor *sensor;
+
+	if(sched->count >= sched->max || bus < 0 || bus >= SCHED_MAX_BUS) {
+
+		printf("Error while add sensor on bus %d to schedule: no slot left or bus out of range\n", bus);
+		exit(1);
+	}
+
+	sensor = &sched->sensor[sched->count++];
+
+	memset(sensor, 0, sizeof(*sensor));
+
+	sensor->bus           = bus;
+	sensor->dev           = dev;
+	sensor->value         = value;
+	sensor->poll          = poll;
+	sensor->time_to_ready = time_to_ready;
+	sensor->cost          = SCHED_DEFAULT_COST;
+
+	return sensor;
+}
+
+
+/**
+ * Run one cycle: every sensor delivers one sample
+ * All idle sensors start a measurement right away, afterwards each sensor
+ * is served when its next phase is due and the thread sleeps until the
+ * earliest due one. Sensors that are pipelined by their driver (e.g.
+ * hih6130_open() with pipelined set) already convert between cycles.
+ * A sensor that has no sample after sched->timeout us (e.g. stuck in
+ * command mode) is marked failed for the cycle, so it cannot hold up the
+ * others; its measurement is continued in the next cycle.
+ * \return The cycle time in us
+ */
+long sched_cycle(struct sched *sched) {
+
+	struct sched_sensor *sensor;
+	struct timespec start, transfer;
+	long long busy;
+	long ready, wait, left;
+	int remaining, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(i=0; i<SCHED_MAX_BUS; i++)
+		sched->bus[i].busy = 0;
+
+	for(i=0; i<sched->count; i++) {
+
+		sched->sensor[i].complete = 0;
+		sched->sensor[i].failed   = 0;
+	}
+
+	remaining = sched->count;
+
+	while(remaining > 0) {
+
+		// Give up on the sensors that are still missing
+		if((left = sched->timeout - sched_elapsed(&start)) <= 0) {
+
+			for(i=0; i<sched->count; i++) {
+
+				sensor = &sched->sensor[i];
+
+				if(!sensor->complete) {
+
+					sensor->failed = 1;
+					sensor->failures++;
+				}
+			}
+
+			break;
+		}
+
+		wait = -1;
+
+		for(i=0; i<sched->count; i++) {
+
+			sensor = &sched->sensor[i];
+
+			if(sensor->complete)
+				continue;
+
+			ready = sensor->time_to_ready(sensor);
+
+			if(ready <= 0) {
+
+				clock_gettime(CLOCK_MONOTONIC, &transfer);
+
+				if(sensor->poll(sensor)) {
+
+					sensor->complete = 1;
+					sensor->latency  = sched_elapsed(&start);
+					sensor->samples++;
+					remaining--;
+				}
+
+				busy = sched_elapsed_ns(&transfer);
+
+				sched_account(sched, sensor, busy);
+
+				if(sensor->complete) {
+
+					if(sensor->done)
+						sensor->done(sensor);
+
+					continue;
+				}
+
+				ready = sensor->time_to_ready(sensor);
+			}
+
+			// An idle sensor (e.g. after a poll timeout) is started next round
+			if(ready < 0)
+				ready = 0;
+
+			if(wait < 0 || ready < wait)
+				wait = ready;
+		}
+
+		// Nothing due, sleep until the earliest conversion ends
+		if(remaining > 0 && wait > 0) {
+
+			usleep(wait < left ? wait : left);
+			sched->sleeps++;
+		}
+	}
+
+	sched->cycle = sched_elapsed(&start);
+	sched->cycle_sum += sched->cycle;
+	sched->cycles++;
+
+	return sched->cycle;
+}
+
+
+/**
+ * Share of the time a bus was busy with transfers since the last reset
+ * \return 0.0 (idle) to 1.0 (saturated)
+ */
+float sched_bus_load(const struct sched *sched, int bus) {
+
+	if(bus < 0 || bus >= SCHED_MAX_BUS || sched->cycle_sum == 0)
+		return 0.0f;
+
+	return (float)sched->bus[bus].busy_sum / ((float)sched->cycle_sum * 1000.0f);
+}
+
+
+/**
+ * Clear the cycle and bus statistics
+ */
+void sched_reset_stats(struct sched *sched) {
+
+	int i;
+
+	memset(&sched->bus[0], 0, sizeof(sched->bus));
+	memset(&sched->class[0], 0, sizeof(sched->class));
+
+	for(i=0; i<sched->count; i++) {
+
+		sched->sensor[i].misses  = 0;
+		sched->sensor[i].skipped = 0;
+	}
+
+	sched->cycle_sum = 0;
+	sched->cycles    = 0;
+	sched->sleeps    = 0;
+}
+
+
+/**
+ * Admit a sensor for periodic EDF scheduling
+ * The sensor's cost and conversion estimates are used as they are
+ * (the driver adapters preset them). Admission can be repeated to change
+ * the rate; the first measurement is released when sched_run() starts.
+ * \param period Release interval in us
+ * \param deadline Relative deadline in us, 0 for the period
+ * \param priority Class 0 (highest) .. SCHED_CLASSES-1
+ * \return 0 if admitted, -1 if the deadline is shorter than a measurement
+ * or the bus would exceed sched->capacity; the sensor is then left
+ * unscheduled (period 0)
+ */
+int sched_admit(struct sched *sched, struct sched_sensor *sensor, long period, long deadline, int priority) {
+
+	struct sched_sensor *other;
+	float density = 0.0f;
+	int i;
+
+	if(deadline <= 0)
+		deadline = period;
+
+	sensor->period = 0;
+
+	if(period <= 0 || priority < 0 || priority >= SCHED_CLASSES)
+		return -1;
+
+	// Test the bus with the sensor tentatively admitted
+	sensor->period   = period;
+	sensor->deadline = deadline;
+	sensor->priority = priority;
+
+	for(i=0; i<sched->count; i++) {
+
+		other = &sched->sensor[i];
+
+		if(other->bus != sensor->bus || other->period == 0)
+			continue;
+
+		density += (float)other->cost / (float)(other->deadline < other->period ? other->deadline : other->period);
+
+		if(sched_response(sched, other) > other->deadline) {
+
+			sensor->period = 0;
+			return -1;
+		}
+	}
+
+	if(density > sched->capacity) {
+
+		sensor->period = 0;
+		return -1;
+	}
+
+	// The first period starts with the next sched_run()
+	sensor->release = -1;
+	sensor->active  = 0;
+
+	return 0;
+}
+
+
+/**
+ * Bus time the admitted sensors of a bus need by their estimates
+ * \return Share of the bus, sum(cost / period)
+ */
+float sched_bus_utilization(const struct sched *sched, int bus) {
+
+	float utilization = 0.0f;
+	int i;
+
+	for(i=0; i<sched->count; i++) {
+
+		if(sched->sensor[i].bus == bus && sched->sensor[i].period > 0)
+			utilization += (float)sched->sensor[i].cost / (float)sched->sensor[i].period;
+	}
+
+	return utilization;
+}
+
+
+/**
+ * Run the admitted sensors for duration us with EDF dispatching
+ * Each sensor's done() is called with every sample; sensor->latency is
+ * the time from its release. Sensors that are not admitted are left
+ * alone. Can be called repeatedly, the periods continue.
+ */
+void sched_run(struct sched *sched, long duration) {
+
+	struct sched_sensor *sensor, *next;
+	struct timespec transfer;
+	long long now, start, end, ready, wait;
+	int i;
+
+	start = sched_elapsed(&sched->epoch);
+	end   = start + duration;
+
+	for(;;) {
+
+		now  = sched_elapsed(&sched->epoch);
+		next = NULL;
+		wait = end - now;
+
+		if(wait <= 0)
+			break;
+
+		for(i=0; i<sched->count; i++) {
+
+			sensor = &sched->sensor[i];
+
+			if(sensor->period == 0)
+				continue;
+
+			// Not complete by its deadline: a miss, a stuck sensor must not
+			// keep the earliest deadline; the next period takes over
+			if(sensor->active && now > sensor->due) {
+
+				sensor->misses++;
+				sched->class[sensor->priority].misses++;
+
+				sensor->active   = 0;
+				sensor->release += sensor->period;
+			}
+
+			// Release the measurement of the current period
+			if(!sensor->active) {
+
+				if(sensor->release < 0)
+					sensor->release = start;
+
+				if(now < sensor->release) {
+
+					if(sensor->release - now < wait)
+						wait = sensor->release - now;
+
+					continue;
+				}
+
+				// Passed periods are skipped, the sensor restarts its period now
+				if(sensor->release + sensor->period <= now) {
+
+					sensor->skipped += (now - sensor->release) / sensor->period;
+					sensor->release  = now;
+				}
+
+				sensor->active = 1;
+				sensor->due    = sensor->release + sensor->deadline;
+				sensor->bus_ns = 0;
+			}
+
+			ready = sensor->time_to_ready(sensor);
+
+			if(ready > 0) {
+
+				if(ready < wait)
+					wait = ready;
+
+				continue;
+			}
+
+			// Earliest deadline first, ties by priority class
+			if(next == NULL || sensor->due < next->due
+			|| (sensor->due == next->due && sensor->priority < next->priority))
+				next = sensor;
+		}
+
+		if(next == NULL) {
+
+			usleep(wait);
+			sched->sleeps++;
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &transfer);
+
+		if(next->poll(next)) {
+
+			sched_account(sched, next, sched_elapsed_ns(&transfer));
+			sched_complete_job(sched, next, sched_elapsed(&sched->epoch));
+		}
+		else {
+
+			sched_account(sched, next, sched_elapsed_ns(&transfer));
+		}
+	}
+
+	sched->cycle_sum += sched_elapsed(&sched->epoch) - start;
+}
+
+
+/**
+ * Print the bus load and the latency and deadline misses by class
+ */
+void sched_report(const struct sched *sched) {
+
+	const struct sched_class *class;
+	int i, bus;
+
+	for(bus=0; bus<SCHED_MAX_BUS; bus++) {
+
+		if(sched->bus[bus].transfers == 0)
+			continue;
+
+		printf("bus %d:   load %5.1f%%  admitted %5.1f%%  %lu transfers\n", bus,
+				sched_bus_load(sched, bus) * 100.0f,
+				sched_bus_utilization(sched, bus) * 100.0f,
+				sched->bus[bus].transfers);
+	}
+
+	for(i=0; i<SCHED_CLASSES; i++) {
+
+		class = &sched->class[i];
+
+		if(class->samples == 0)
+			continue;
+
+		printf("class %d: %lu samples  latency avg %ld us  max %ld us  %lu deadline misses\n", i,
+				class->samples, (long)(class->latency_sum / (long long)class->samples),
+				class->latency_max, class->misses);
+	}
+}
+
+
+/**
+ * Worst case us from release to sample of an admitted sensor
+ * (internal function)
+ */
+static inline long sched_response(const struct sched *sched, const struct sched_sensor *sensor) {
+
+	const struct sched_sensor *other;
+	long response;
+	int i;
+
+	response = sensor->conversion + sensor->cost;
+
+	for(i=0; i<sched->count; i++) {
+
+		other = &sched->sensor[i];
+
+		if(other == sensor || other->bus != sensor->bus || other->period == 0)
+			continue;
+
+		response += other->cost * (sensor->deadline / other->period + 1);
+	}
+
+	return response;
+}
+
+
+/**
+ * Account the bus time of one transfer (internal function)
+ */
+static inline void sched_account(struct sched *sched, struct sched_sensor *sensor, long long busy) {
+
+	sched->bus[sensor->bus].busy += busy;
+	sched->bus[sensor->bus].busy_sum += busy;
+	sched->bus[sensor->bus].transfers++;
+
+	sensor->bus_ns += busy;
+}
+
+
+/**
+ * Book a completed EDF measurement and release the next one
+ * (internal function)
+ * The cost estimate is an EWMA (1/8) of the measured bus time.
+ */
+static inline void sched_complete_job(struct sched *sched, struct sched_sensor *sensor, long long now) {
+
+	struct sched_class *class = &sched->class[sensor->priority];
+
+	sensor->latency = now - sensor->release;
+	sensor->samples++;
+	sensor->active  = 0;
+	sensor->cost   += ((long)(sensor->bus_ns / 1000) - sensor->cost) / 8;
+
+	class->samples++;
+	class->latency_sum += sensor->latency;
+
+	if(sensor->latency > class->latency_max)
+		class->latency_max = sensor->latency;
+
+	if(now > sensor->due) {
+
+		sensor->misses++;
+		class->misses++;
+	}
+
+	sensor->release += sensor->period;
+
+	if(sensor->done)
+		sensor->done(sensor);
+}
+
+
+/**
+ * Micro seconds elapsed since a CLOCK_MONOTONIC time (internal function)
+ * 64 bit, the EDF times count from the epoch and a 32 bit long overflows
+ * after 35 minutes.
+ */
+static inline long long sched_elapsed(const struct timespec *since) {
+
+	return sched_elapsed_ns(since) / 1000LL;
+}
+
+
+/**
+ * Nano seconds elapsed since a CLOCK_MONOTONIC time (internal function)
+ */
+static inline long long sched_elapsed_ns(const struct timespec *since) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - since->tv_sec) * 1000000000LL
+		 + (now.tv_nsec - since->tv_nsec);
+}
+
+
+#endif /* LIBSCHED_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard so a later include of this
+ * header after another driver header still defines its adapter.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBSCHED_BMP085_)
+#define LIBSCHED_BMP085_
+
+/**
+ * poll() of a BMP085 (internal function)
+ */
+static inline int sched_bmp085_poll(struct sched_sensor *sensor) {
+
+	return bmp085_poll_value((struct bmp085_device *)sensor->dev, (struct bmp085_value *)sensor->value);
+}
+
+
+/**
+ * time_to_ready() of a BMP085 (internal function)
+ */
+static inline long sched_bmp085_time_to_ready(struct sched_sensor *sensor) {
+
+	return bmp085_time_to_ready((struct bmp085_device *)sensor->dev);
+}
+
+
+/**
+ * Add a BMP085 opened with bmp085_open()
+ */
+static inline struct sched_sensor *sched_add_bmp085(struct sched *sched, struct bmp085_device *dev, struct bmp085_value *value) {
+
+	struct sched_sensor *sensor;
+
+	sensor = sched_add(sched, dev->i2c_device, dev, value, sched_bmp085_poll, sched_bmp085_time_to_ready);
+
+	sensor->cost       = SCHED_BMP085_COST;
+	sensor->conversion = BMP085_UT_TIME + BMP085_UP_TIME(dev->oversampling);
+
+	return sensor;
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBSCHED_HIH6130_)
+#define LIBSCHED_HIH6130_
+
+/**
+ * poll() of a HIH6130 (internal function)
+ */
+static inline int sched_hih6130_poll(struct sched_sensor *sensor) {
+
+	return hih6130_poll_value((struct hih6130_device *)sensor->dev, (struct hih6130_value *)sensor->value);
+}
+
+
+/**
+ * time_to_ready() of a HIH6130 (internal function)
+ */
+static inline long sched_hih6130_time_to_ready(struct sched_sensor *sensor) {
+
+	return hih6130_time_to_ready((struct hih6130_device *)sensor->dev);
+}
+
+
+/**
+ * Add a HIH6130 opened with hih6130_open()
+ */
+static inline struct sched_sensor *sched_add_hih6130(struct sched *sched, struct hih6130_device *dev, struct hih6130_value *value) {
+
+	struct sched_sensor *sensor;
+
+	sensor = sched_add(sched, dev->i2c_device, dev, value, sched_hih6130_poll, sched_hih6130_time_to_ready);
+
+	sensor->cost       = SCHED_HIH6130_COST;
+	sensor->conversion = dev->model.mean;
+
+	return sensor;
+}
+
+#endif
@@ -0,0 +1,409 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libstream.h writes a stream of samples as CSV, JSON lines or binary
+ *  records through one large buffer and keeps rate and latency counters
+ *  for a summary.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBSTREAM_H_
+#define LIBSTREAM_H_
+
+#define STREAM_CSV     0   ///< Text, one header line and one line per sample
+#define STREAM_JSON    1   ///< JSON lines, one object per sample
+#define STREAM_BINARY  2   ///< Records of a 64 bit time and the float values, host byte order
+
+#ifndef STREAM_BUFFER
+#define STREAM_BUFFER  65536   ///< Output buffer in bytes
+#endif
+
+#define STREAM_COLUMNS 8       ///< Most values per sample
+#define STREAM_RECORD  512     ///< Room kept free for one record
+#define STREAM_MAX_AGE 1000000 ///< Longest time in us a record waits in the buffer
+
+
+/** FUNCTION DEFINITONS **/
+
+struct stream;
+
+int stream_format(const char *name);
+void stream_init(struct stream *stream, int fd, int format, const char * const *names, int columns);
+void stream_write(struct stream *stream, long long time, long latency, const float *values);
+void stream_flush(struct stream *stream);
+void stream_summary(const struct stream *stream, FILE *out);
+
+static inline char *stream_put_int(char *p, long long value);
+static inline char *stream_put_fixed(char *p, float value);
+static inline char *stream_put_string(char *p, const char *value);
+static inline long long stream_now(void);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Output stream of samples
+ * 	fd:       descriptor written to
+ * 	format:   STREAM_CSV, STREAM_JSON or STREAM_BINARY
+ * 	names:    name of each value, for the CSV header and the JSON keys
+ * 	columns:  values per sample
+ * 	used:     bytes in the buffer
+ * 	flushed:  CLOCK_MONOTONIC time in us of the last write(2)
+ * 	started:  CLOCK_MONOTONIC time in us of the first sample
+ * 	last:     CLOCK_MONOTONIC time in us of the last sample
+ * 	samples:  samples written
+ * 	writes:   write(2) calls
+ * 	bytes:    bytes written
+ * 	latency_min, latency_max, latency_sum: latency in us of the samples
+ */
+struct stream {
+	int fd;
+	int format;
+	const char * const *names;
+	int columns;
+	int used;
+	long long flushed;
+	long long started;
+	long long last;
+	unsigned long samples;
+	unsigned long writes;
+	unsigned long long bytes;
+	long latency_min;
+	long latency_max;
+	long long latency_sum;
+	char buffer[STREAM_BUFFER];
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/**
+ * Look up an output format by name: csv, json or bin
+ * \return The format, -1 if the name is unknown
+ */
+int stream_format(const char *name) {
+
+	if(!strcmp(name, "csv"))
+		return STREAM_CSV;
+
+	if(!strcmp(name, "json"))
+		return STREAM_JSON;
+
+	if(!strcmp(name, "bin"))
+		return STREAM_BINARY;
+
+	return -1;
+}
+
+
+/**
+ * Initialize a stream, the CSV header goes into the buffer
+ * \param names Name of each value, kept by reference; short names only, a
+ * record must fit into STREAM_RECORD
+ * \param columns Values per sample, at most STREAM_COLUMNS
+ */
+void stream_init(struct stream *stream, int fd, int format, const char * const *names, int columns) {
+
+	char *p;
+	int i;
+
+	if(columns > STREAM_COLUMNS) {
+
+		printf("Stream error: %d values, at most %d\n", columns, STREAM_COLUMNS);
+		exit(1);
+	}
+
+	stream->fd          = fd;
+	stream->format      = format;
+	stream->names       = names;
+	stream->columns     = columns;
+	stream->used        = 0;
+	stream->flushed     = stream_now();
+	stream->started     = 0;
+	stream->last        = 0;
+	stream->samples     = 0;
+	stream->writes      = 0;
+	stream->bytes       = 0;
+	stream->latency_min = 0;
+	stream->latency_max = 0;
+	stream->latency_sum = 0;
+
+	if(format != STREAM_CSV)
+		return;
+
+	p = stream_put_string(stream->buffer, "time");
+
+	for(i=0; i<columns; i++) {
+
+		*p++ = ',';
+		p = stream_put_string(p, names[i]);
+	}
+
+	*p++ = '\n';
+
+	stream->used = p - stream->buffer;
+}
+
+
+/**
+ * Add a sample
+ * The record is formatted into the buffer, which is written out when it
+ * is nearly full or has waited STREAM_MAX_AGE.
+ * \param time Timestamp of the sample, e.g. CLOCK_REALTIME in us
+ * \param latency Time in us the sample took to acquire
+ * \param values stream->columns values
+ */
+void stream_write(struct stream *stream, long long time, long latency, const float *values) {
+
+	char *p = stream->buffer + stream->used;
+	long long now;
+	int i;
+
+	switch(stream->format) {
+
+	case STREAM_BINARY:
+		memcpy(p, &time, sizeof(time));
+		memcpy(p + sizeof(time), values, stream->columns * sizeof(*values));
+		p += sizeof(time) + stream->columns * sizeof(*values);
+		break;
+
+	case STREAM_JSON:
+		p = stream_put_string(p, "{\"time\":");
+		p = stream_put_int(p, time);
+
+		for(i=0; i<stream->columns; i++) {
+
+			p = stream_put_string(p, ",\"");
+			p = stream_put_string(p, stream->names[i]);
+			p = stream_put_string(p, "\":");
+
+			// JSON has no NaN
+			if(values[i] != values[i])
+				p = stream_put_string(p, "null");
+			else
+				p = stream_put_fixed(p, values[i]);
+		}
+
+		*p++ = '}';
+		*p++ = '\n';
+		break;
+
+	default:
+		p = stream_put_int(p, time);
+
+		for(i=0; i<stream->columns; i++) {
+
+			*p++ = ',';
+			p = stream_put_fixed(p, values[i]);
+		}
+
+		*p++ = '\n';
+		break;
+	}
+
+	stream->used = p - stream->buffer;
+
+	// Counters
+	now = stream_now();
+
+	if(stream->samples == 0) {
+
+		stream->started     = now;
+		stream->latency_min = latency;
+		stream->latency_max = latency;
+	}
+
+	if(latency < stream->latency_min)
+		stream->latency_min = latency;
+
+	if(latency > stream->latency_max)
+		stream->latency_max = latency;
+
+	stream->latency_sum += latency;
+	stream->last         = now;
+	stream->samples++;
+
+	if(stream->used > STREAM_BUFFER - STREAM_RECORD || now - stream->flushed >= STREAM_MAX_AGE)
+		stream_flush(stream);
+}
+
+
+/**
+ * Write out the buffer
+ */
+void stream_flush(struct stream *stream) {
+
+	ssize_t done;
+	int offset = 0;
+
+	while(offset < stream->used) {
+
+		done = write(stream->fd, stream->buffer + offset, stream->used - offset);
+
+		if(done < 0) {
+
+			if(errno == EINTR)
+				continue;
+
+			perror("Stream error while write");
+			exit(1);
+		}
+
+		offset += done;
+		stream->writes++;
+	}
+
+	stream->bytes  += stream->used;
+	stream->used    = 0;
+	stream->flushed = stream_now();
+}
+
+
+/**
+ * Print samples, achieved rate and latency
+ * The rate is taken between the first and the last sample.
+ */
+void stream_summary(const struct stream *stream, FILE *out) {
+
+	double seconds = (stream->last - stream->started) / 1e6;
+	double rate = 0;
+
+	if(stream->samples > 1 && seconds > 0)
+		rate = (stream->samples - 1) / seconds;
+
+	fprintf(out, "Samples:\t %lu in %.3fs\n", stream->samples, seconds);
+	fprintf(out, "Rate:\t\t %.1f samples/s\n", rate);
+
+	if(stream->samples > 0)
+		fprintf(out, "Latency:\t min %.3fms, mean %.3fms, max %.3fms\n",
+				stream->latency_min / 1e3,
+				stream->latency_sum / 1e3 / stream->samples,
+				stream->latency_max / 1e3);
+
+	fprintf(out, "Output:\t\t %llu bytes in %lu writes\n", stream->bytes, stream->writes);
+}
+
+
+/**
+ * Format an integer (internal function)
+ * \return The end of the text
+ */
+static inline char *stream_put_int(char *p, long long value) {
+
+	char digits[20];
+	unsigned long long rest = value;
+	int n = 0;
+
+	if(value < 0) {
+
+		*p++ = '-';
+		rest = -(unsigned long long)value;
+	}
+
+	do {
+		digits[n++] = '0' + rest % 10;
+		rest /= 10;
+	} while(rest);
+
+	while(n)
+		*p++ = digits[--n];
+
+	return p;
+}
+
+
+/**
+ * Format a value w/ two decimals, rounded (internal function)
+ * Values beyond the range of long long are printed by snprintf.
+ * \return The end of the text
+ */
+static inline char *stream_put_fixed(char *p, float value) {
+
+	long long centi;
+	int fraction;
+
+	if(!(value > -9e15f && value < 9e15f))
+		return p + snprintf(p, 32, "%g", value);
+
+	centi = (long long)(value * 100.0 + (value < 0 ? -0.5 : 0.5));
+
+	if(centi < 0) {
+
+		*p++ = '-';
+		centi = -centi;
+	}
+
+	fraction = centi % 100;
+
+	p    = stream_put_int(p, centi / 100);
+	*p++ = '.';
+	*p++ = '0' + fraction / 10;
+	*p++ = '0' + fraction % 10;
+
+	return p;
+}
+
+
+/**
+ * Copy a string without its terminator (internal function)
+ * \return The end of the text
+ */
+static inline char *stream_put_string(char *p, const char *value) {
+
+	while(*value)
+		*p++ = *value++;
+
+	return p;
+}
+
+
+/**
+ * CLOCK_MONOTONIC time in us (internal function)
+ */
+static inline long long stream_now(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+
+#endif /* LIBSTREAM_H_ */
@@ -0,0 +1,822 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  libtsdb.h is an append-only store for long-term sensor history,
+ *  compressed after Facebook's Gorilla time series database.
+ *
+ *  Every series (one quantity of one sensor) collects its points in a
+ *  block of TSDB_BLOCK bytes in memory. A full block is appended to the
+ *  file in one write and never touched again, which suits flash. Inside a
+ *  block the points are a bit stream:
+ *
+ *    time:  first in 64 bit, then the delta of the deltas, 1 bit for a
+ *           regular interval, 9, 12 or 16 bit for small jitter
+ *    float: first in 32 bit, then XOR with the previous value, 1 bit for
+ *           an unchanged value, otherwise only the meaningful bits
+ *    int:   first in 32 bit, then the delta in 1 to 16 bit, for raw
+ *           readings
+ *
+ *  Times are in ms. A point every second of a slowly changing value
+ *  takes 3 to 10 bits including its time.
+ *
+ *  The block headers form a fixed-size index loaded at open, a query
+ *  finds the first block by binary search and decodes only the blocks of
+ *  its series and time range. The points of a block not yet written are
+ *  lost in a crash; tsdb_flush() writes it early, e.g. on shutdown.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LIBTSDB_H_
+#define LIBTSDB_H_
+
+#define TSDB_MAGIC   0x42445354u   ///< "TSDB" of the file header and of each block
+#define TSDB_VERSION 1
+#define TSDB_BLOCK   4096          ///< Block size in bytes, the erase size of most flash
+
+#define TSDB_FLOAT   0             ///< Series of float values, XOR coded
+#define TSDB_INT     1             ///< Series of integer values, delta coded
+
+
+/** FUNCTION DEFINITONS **/
+
+struct tsdb;
+struct tsdb_series;
+struct tsdb_index;
+struct tsdb_cursor;
+struct tsdb_point;
+
+void tsdb_open(struct tsdb *db, const char *path, struct tsdb_index *index, int max);
+void tsdb_close(struct tsdb *db);
+void tsdb_series_init(struct tsdb_series *series, unsigned short id, unsigned char type);
+void tsdb_append(struct tsdb *db, struct tsdb_series *series, long long time, float value);
+void tsdb_append_int(struct tsdb *db, struct tsdb_series *series, long long time, int value);
+void tsdb_flush(struct tsdb *db, struct tsdb_series *series);
+
+void tsdb_query(struct tsdb_cursor *cursor, struct tsdb *db, unsigned short id, long long from, long long to);
+int tsdb_next(struct tsdb_cursor *cursor, struct tsdb_point *point);
+
+static inline void tsdb_append_word(struct tsdb *db, struct tsdb_series *series, long long time, unsigned int word);
+static inline void tsdb_write_block(struct tsdb *db, struct tsdb_series *series);
+static inline void tsdb_start_block(struct tsdb_series *series);
+static inline int tsdb_read_block(struct tsdb_cursor *cursor);
+static inline unsigned int tsdb_checksum(const unsigned char *data, int length);
+static inline void tsdb_put_bits(unsigned char *data, unsigned int *position, unsigned long long value, int bits);
+static inline unsigned long long tsdb_get_bits(const unsigned char *data, unsigned int *position, int bits);
+static inline void tsdb_put_delta(unsigned char *data, unsigned int *position, long long delta, int wide);
+static inline long long tsdb_get_delta(const unsigned char *data, unsigned int *position, int wide);
+
+
+
+/** TYPE DEFINITIONS **/
+
+/**
+ * Block header, followed by the bit stream
+ * 	checksum: of the bit stream, a torn block is skipped at open
+ * 	series:   series id
+ * 	type:     TSDB_FLOAT or TSDB_INT
+ * 	count:    number of points
+ * 	bits:     length of the bit stream
+ * 	first:    time of the first point
+ * 	last:     time of the last point
+ */
+struct tsdb_block {
+	unsigned int magic;
+	unsigned int checksum;
+	unsigned short series;
+	unsigned char type;
+	unsigned char reserved;
+	unsigned int count;
+	unsigned int bits;
+	unsigned int reserved2;
+	long long first;
+	long long last;
+};
+
+#define TSDB_DATA ((int)(TSDB_BLOCK - sizeof(struct tsdb_block)))  ///< Bit stream bytes per block
+#define TSDB_POINT_MAX 128   ///< Longest coded point in bits
+
+
+/**
+ * Index entry of a written block
+ */
+struct tsdb_index {
+	long long first;
+	long long last;
+	unsigned int block;
+	unsigned short series;
+	unsigned char type;
+};
+
+
+/**
+ * An open store
+ * 	index:  entries of the written blocks in file order
+ * 	count:  used entries
+ * 	max:    size of index
+ * 	blocks: next block number to write, block 0 is the file header
+ */
+struct tsdb {
+	int fd;
+	struct tsdb_index *index;
+	int count;
+	int max;
+	unsigned int blocks;
+};
+
+
+/**
+ * Writer state of a series, holds its open block
+ * 	time:     time of the previous point
+ * 	delta:    time delta of the previous point
+ * 	word:     value of the previous point (float bits or int)
+ * 	leading:  leading zero bits of the previous XOR window
+ * 	trailing: trailing zero bits of the previous XOR window
+ */
+struct tsdb_series {
+	long long time;
+	long long delta;
+	unsigned int word;
+	int leading;
+	int trailing;
+	struct tsdb_block header;
+	unsigned char data[TSDB_DATA];
+};
+
+
+/**
+ * A decoded point, value for float series, raw for int series
+ */
+struct tsdb_point {
+	long long time;
+	float value;
+	int raw;
+};
+
+
+/**
+ * Query state, holds the block being decoded
+ */
+struct tsdb_cursor {
+	struct tsdb *db;
+	unsigned short series;
+	long long from;
+	long long to;
+	int entry;
+	unsigned int position;
+	unsigned int done;
+	long long time;
+	long long delta;
+	unsigned int word;
+	int leading;
+	int trailing;
+	struct tsdb_block header;
+	unsigned char data[TSDB_DATA + 8];
+};
+
+
+
+/** FUNCTIONS **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+
+/**
+ * Open or create a store and load its block index
+ * \param index Array for max block entries, TSDB_BLOCK bytes of data
+ * per entry
+ */
+void tsdb_open(struct tsdb *db, const char *path, struct tsdb_index *index, int max) {
+
+	struct tsdb_block header;
+	struct stat status;
+	unsigned char data[TSDB_DATA];
+	unsigned int block;
+
+	db->index = index;
+	db->count = 0;
+	db->max   = max;
+
+	if((db->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+
+		printf("Error while open time series store %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	if(fstat(db->fd, &status) < 0) {
+
+		perror("Error while stat time series store:");
+		exit(1);
+	}
+
+	// New file: block 0 is the header, a block header with the version in bits
+	if(status.st_size == 0) {
+
+		memset(&header, 0, sizeof(header));
+		memset(data, 0, sizeof(data));
+
+		header.magic = TSDB_MAGIC;
+		header.bits  = TSDB_VERSION;
+
+		if(pwrite(db->fd, &header, sizeof(header), 0) != sizeof(header)
+		|| pwrite(db->fd, data, sizeof(data), sizeof(header)) != sizeof(data)) {
+
+			perror("Error while write time series store:");
+			exit(1);
+		}
+
+		status.st_size = TSDB_BLOCK;
+	}
+
+	if(pread(db->fd, &header, sizeof(header), 0) != sizeof(header)
+	|| header.magic != TSDB_MAGIC || header.bits != TSDB_VERSION) {
+
+		printf("Error while open time series store %s: not a time series store\n", path);
+		exit(1);
+	}
+
+	// A partly written last block is overwritten by the next one
+	db->blocks = status.st_size / TSDB_BLOCK;
+
+	for(block=1; block<db->blocks; block++) {
+
+		if(pread(db->fd, &header, sizeof(header), (off_t)block * TSDB_BLOCK) != sizeof(header))
+			break;
+
+		if(header.magic != TSDB_MAGIC || header.bits > TSDB_DATA * 8)
+			continue;
+
+		if(pread(db->fd, data, (header.bits + 7) / 8, (off_t)block * TSDB_BLOCK + sizeof(header)) != (header.bits + 7) / 8
+		|| tsdb_checksum(data, (header.bits + 7) / 8) != header.checksum)
+			continue;
+
+		if(db->count == db->max) {
+
+			printf("Error while open time series store %s: more than %d blocks\n", path, db->max);
+			exit(1);
+		}
+
+		db->index[db->count].first  = header.first;
+		db->index[db->count].last   = header.last;
+		db->index[db->count].block  = block;
+		db->index[db->count].series = header.series;
+		db->index[db->count].type   = header.type;
+		db->count++;
+	}
+}
+
+
+/**
+ * Close a store, flush the series first
+ */
+void tsdb_close(struct tsdb *db) {
+
+	close(db->fd);
+	db->fd = -1;
+}
+
+
+/**
+ * Initialize the writer state of a series
+ * \param id Series id, unique in the store
+ * \param type TSDB_FLOAT or TSDB_INT
+ */
+void tsdb_series_init(struct tsdb_series *series, unsigned short id, unsigned char type) {
+
+	memset(series, 0, sizeof(*series));
+
+	series->header.series = id;
+	series->header.type   = type;
+
+	tsdb_start_block(series);
+}
+
+
+/**
+ * Append a point to a float series
+ * Points are appended in time order, also across the series of a store,
+ * so the blocks are ordered by their last time.
+ */
+void tsdb_append(struct tsdb *db, struct tsdb_series *series, long long time, float value) {
+
+	unsigned int word;
+
+	memcpy(&word, &value, sizeof(word));
+
+	tsdb_append_word(db, series, time, word);
+}
+
+
+/**
+ * Append a point to an int series
+ */
+void tsdb_append_int(struct tsdb *db, struct tsdb_series *series, long long time, int value) {
+
+	tsdb_append_word(db, series, time, (unsigned int)value);
+}
+
+
+/**
+ * Write the open block of a series, the next point starts a new one
+ */
+void tsdb_flush(struct tsdb *db, struct tsdb_series *series) {
+
+	if(series->header.count == 0)
+		return;
+
+	tsdb_write_block(db, series);
+	tsdb_start_block(series);
+}
+
+
+/**
+ * Start a query of the points of a series with from <= time <= to
+ */
+void tsdb_query(struct tsdb_cursor *cursor, struct tsdb *db, unsigned short id, long long from, long long to) {
+
+	int low, high, middle;
+
+	cursor->db     = db;
+	cursor->series = id;
+	cursor->from   = from;
+	cursor->to     = to;
+	cursor->done   = 0;
+
+	cursor->header.count = 0;
+
+	// First block that ends at or after from
+	low  = 0;
+	high = db->count;
+
+	while(low < high) {
+
+		middle = (low + high) / 2;
+
+		if(db->index[middle].last < from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	cursor->entry = low;
+}
+
+
+/**
+ * Read the next point of a query
+ * \return 1 and fills point, 0 at the end of the range
+ */
+int tsdb_next(struct tsdb_cursor *cursor, struct tsdb_point *point) {
+
+	unsigned int x;
+	int length;
+
+	for(;;) {
+
+		// Next block of the series
+		while(cursor->done == cursor->header.count) {
+
+			if(!tsdb_read_block(cursor))
+				return 0;
+		}
+
+		if(cursor->done == 0) {
+
+			cursor->time  = (long long)tsdb_get_bits(cursor->data, &cursor->position, 64);
+			cursor->word  = (unsigned int)tsdb_get_bits(cursor->data, &cursor->position, 32);
+			cursor->delta = 0;
+		}
+		else {
+
+			cursor->delta += tsdb_get_delta(cursor->data, &cursor->position, 1);
+			cursor->time  += cursor->delta;
+
+			if(cursor->header.type == TSDB_INT) {
+
+				cursor->word += (unsigned int)tsdb_get_delta(cursor->data, &cursor->position, 0);
+			}
+			else if(tsdb_get_bits(cursor->data, &cursor->position, 1)) {
+
+				// New window, else the one of the previous value
+				if(tsdb_get_bits(cursor->data, &cursor->position, 1)) {
+
+					cursor->leading  = (int)tsdb_get_bits(cursor->data, &cursor->position, 5);
+					length           = (int)tsdb_get_bits(cursor->data, &cursor->position, 5) + 1;
+					cursor->trailing = 32 - cursor->leading - length;
+				}
+
+				length = 32 - cursor->leading - cursor->trailing;
+				x      = (unsigned int)tsdb_get_bits(cursor->data, &cursor->position, length);
+
+				cursor->word ^= x << cursor->trailing;
+			}
+		}
+
+		cursor->done++;
+
+		if(cursor->time > cursor->to) {
+
+			// Past the range, blocks of the series are in time order
+			cursor->entry = cursor->db->count;
+			cursor->done  = cursor->header.count;
+			return 0;
+		}
+
+		if(cursor->time >= cursor->from)
+			break;
+	}
+
+	point->time = cursor->time;
+	point->raw  = (int)cursor->word;
+
+	memcpy(&point->value, &cursor->word, sizeof(point->value));
+
+	return 1;
+}
+
+
+/**
+ * Code a point into the open block of a series (internal function)
+ */
+static inline void tsdb_append_word(struct tsdb *db, struct tsdb_series *series, long long time, unsigned int word) {
+
+	struct tsdb_block *header = &series->header;
+	unsigned int x;
+	int leading, trailing, length;
+
+	if(header->count == 0) {
+
+		tsdb_put_bits(series->data, &header->bits, (unsigned long long)time, 64);
+		tsdb_put_bits(series->data, &header->bits, word, 32);
+
+		header->first   = time;
+		series->delta   = 0;
+		series->leading = -1;
+	}
+	else {
+
+		tsdb_put_delta(series->data, &header->bits, (time - series->time) - series->delta, 1);
+		series->delta = time - series->time;
+
+		if(header->type == TSDB_INT) {
+
+			tsdb_put_delta(series->data, &header->bits, (long long)(int)word - (int)series->word, 0);
+		}
+		else if((x = word ^ series->word) == 0) {
+
+			tsdb_put_bits(series->data, &header->bits, 0, 1);
+		}
+		else {
+
+			leading  = __builtin_clz(x);
+			trailing = __builtin_ctz(x);
+
+			// Reuse the window of the previous value if the bits fit
+			if(series->leading >= 0 && leading >= series->leading && trailing >= series->trailing) {
+
+				length = 32 - series->leading - series->trailing;
+
+				tsdb_put_bits(series->data, &header->bits, 2, 2);
+				tsdb_put_bits(series->data, &header->bits, x >> series->trailing, length);
+			}
+			else {
+
+				length = 32 - leading - trailing;
+
+				tsdb_put_bits(series->data, &header->bits, 3, 2);
+				tsdb_put_bits(series->data, &header->bits, leading, 5);
+				tsdb_put_bits(series->data, &header->bits, length - 1, 5);
+				tsdb_put_bits(series->data, &header->bits, x >> trailing, length);
+
+				series->leading  = leading;
+				series->trailing = trailing;
+			}
+		}
+	}
+
+	series->time = time;
+	series->word = word;
+
+	header->last = time;
+	header->count++;
+
+	// Block full: write it, a point never spans blocks
+	if(header->bits + TSDB_POINT_MAX > TSDB_DATA * 8) {
+
+		tsdb_write_block(db, series);
+		tsdb_start_block(series);
+	}
+}
+
+
+/**
+ * Append the open block of a series to the file (internal function)
+ */
+static inline void tsdb_write_block(struct tsdb *db, struct tsdb_series *series) {
+
+	struct tsdb_index *entry;
+	struct iovec block[2];
+
+	if(db->count == db->max) {
+
+		printf("Error while write time series store: more than %d blocks\n", db->max);
+		exit(1);
+	}
+
+	series->header.magic    = TSDB_MAGIC;
+	series->header.checksum = tsdb_checksum(series->data, (series->header.bits + 7) / 8);
+
+	block[0].iov_base = &series->header;
+	block[0].iov_len  = sizeof(series->header);
+	block[1].iov_base = series->data;
+	block[1].iov_len  = sizeof(series->data);
+
+	// Header and data are one write of the whole block
+	if(pwritev(db->fd, block, 2, (off_t)db->blocks * TSDB_BLOCK) != TSDB_BLOCK) {
+
+		perror("Error while write time series store:");
+		exit(1);
+	}
+
+	entry = &db->index[db->count++];
+
+	entry->first  = series->header.first;
+	entry->last   = series->header.last;
+	entry->block  = db->blocks++;
+	entry->series = series->header.series;
+	entry->type   = series->header.type;
+}
+
+
+/**
+ * Empty the open block of a series (internal function)
+ */
+static inline void tsdb_start_block(struct tsdb_series *series) {
+
+	series->header.count = 0;
+	series->header.bits  = 0;
+
+	memset(series->data, 0, sizeof(series->data));
+}
+
+
+/**
+ * Load the next block of the series of a query (internal function)
+ * \return 0 if there is none
+ */
+static inline int tsdb_read_block(struct tsdb_cursor *cursor) {
+
+	struct tsdb_index *entry;
+	unsigned int length;
+
+	for(; cursor->entry < cursor->db->count; cursor->entry++) {
+
+		entry = &cursor->db->index[cursor->entry];
+
+		if(entry->series != cursor->series || entry->last < cursor->from)
+			continue;
+
+		if(entry->first > cursor->to)
+			break;
+
+		if(pread(cursor->db->fd, &cursor->header, sizeof(cursor->header), (off_t)entry->block * TSDB_BLOCK) != sizeof(cursor->header)) {
+
+			perror("Error while read time series store:");
+			exit(1);
+		}
+
+		length = (cursor->header.bits + 7) / 8;
+
+		if(pread(cursor->db->fd, cursor->data, length, (off_t)entry->block * TSDB_BLOCK + sizeof(cursor->header)) != length) {
+
+			perror("Error while read time series store:");
+			exit(1);
+		}
+
+		// Padding for the 8 byte loads of tsdb_get_bits()
+		memset(cursor->data + length, 0, 8);
+
+		cursor->entry++;
+		cursor->position = 0;
+		cursor->done     = 0;
+		cursor->leading  = 0;
+		cursor->trailing = 0;
+
+		return 1;
+	}
+
+	cursor->entry = cursor->db->count;
+
+	return 0;
+}
+
+
+/**
+ * FNV-1a of the bit stream (internal function)
+ */
+static inline unsigned int tsdb_checksum(const unsigned char *data, int length) {
+
+	unsigned int hash = 2166136261u;
+	int i;
+
+	for(i=0; i<length; i++)
+		hash = (hash ^ data[i]) * 16777619u;
+
+	return hash;
+}
+
+
+/**
+ * Write the low bits of value, most significant first (internal function)
+ */
+static inline void tsdb_put_bits(unsigned char *data, unsigned int *position, unsigned long long value, int bits) {
+
+	int room, take;
+
+	while(bits > 0) {
+
+		room = 8 - (*position & 7);
+		take = bits < room ? bits : room;
+
+		data[*position >> 3] |= (unsigned char)(((value >> (bits - take)) & ((1u << take) - 1)) << (room - take));
+
+		*position += take;
+		bits      -= take;
+	}
+}
+
+
+/**
+ * Read bits, most significant first (internal function)
+ * Loads 8 bytes at once, the buffer needs 8 bytes of padding.
+ */
+static inline unsigned long long tsdb_get_bits(const unsigned char *data, unsigned int *position, int bits) {
+
+	const unsigned char *p;
+	unsigned long long window;
+	int shift;
+
+	if(bits > 56) {
+
+		window = tsdb_get_bits(data, position, bits - 32) << 32;
+
+		return window | tsdb_get_bits(data, position, 32);
+	}
+
+	p     = data + (*position >> 3);
+	shift = *position & 7;
+
+	window = (unsigned long long)p[0] << 56 | (unsigned long long)p[1] << 48
+		   | (unsigned long long)p[2] << 40 | (unsigned long long)p[3] << 32
+		   | (unsigned long long)p[4] << 24 | (unsigned long long)p[5] << 16
+		   | (unsigned long long)p[6] << 8  | (unsigned long long)p[7];
+
+	*position += bits;
+
+	return bits ? (window << shift) >> (64 - bits) : 0;
+}
+
+
+/**
+ * Write a signed delta with the Gorilla prefix code (internal function)
+ * '0' zero, '10' 7 bit, '110' 9 bit, '1110' 12 bit, '1111' 32 bit or,
+ * if wide, 64 bit.
+ */
+static inline void tsdb_put_delta(unsigned char *data, unsigned int *position, long long delta, int wide) {
+
+	if(delta == 0) {
+
+		tsdb_put_bits(data, position, 0, 1);
+	}
+	else if(delta >= -63 && delta <= 64) {
+
+		tsdb_put_bits(data, position, 0x2, 2);
+		tsdb_put_bits(data, position, (unsigned long long)delta & 0x7F, 7);
+	}
+	else if(delta >= -255 && delta <= 256) {
+
+		tsdb_put_bits(data, position, 0x6, 3);
+		tsdb_put_bits(data, position, (unsigned long long)delta & 0x1FF, 9);
+	}
+	else if(delta >= -2047 && delta <= 2048) {
+
+		tsdb_put_bits(data, position, 0xE, 4);
+		tsdb_put_bits(data, position, (unsigned long long)delta & 0xFFF, 12);
+	}
+	else {
+
+		tsdb_put_bits(data, position, 0xF, 4);
+		tsdb_put_bits(data, position, (unsigned long long)delta, wide ? 64 : 32);
+	}
+}
+
+
+/**
+ * Read a delta written by tsdb_put_delta() (internal function)
+ */
+static inline long long tsdb_get_delta(const unsigned char *data, unsigned int *position, int wide) {
+
+	long long delta;
+
+	if(!tsdb_get_bits(data, position, 1))
+		return 0;
+
+	if(!tsdb_get_bits(data, position, 1)) {
+
+		delta = (long long)tsdb_get_bits(data, position, 7);
+		return delta > 64 ? delta - 128 : delta;
+	}
+
+	if(!tsdb_get_bits(data, position, 1)) {
+
+		delta = (long long)tsdb_get_bits(data, position, 9);
+		return delta > 256 ? delta - 512 : delta;
+	}
+
+	if(!tsdb_get_bits(data, position, 1)) {
+
+		delta = (long long)tsdb_get_bits(data, position, 12);
+		return delta > 2048 ? delta - 4096 : delta;
+	}
+
+	if(wide)
+		return (long long)tsdb_get_bits(data, position, 64);
+
+	return (long long)(int)tsdb_get_bits(data, position, 32);
+}
+
+
+#endif /* LIBTSDB_H_ */
+
+
+/*
+ * Driver adapters, available for the driver headers included before this
+ * one. Kept outside of the include guard like the ones of libsched.h.
+ */
+#if defined(LIBBMP085_H_) && !defined(LIBTSDB_BMP085_)
+#define LIBTSDB_BMP085_
+
+/**
+ * Append a BMP085 sample to a temperature and a pressure series
+ */
+static inline void tsdb_append_bmp085(struct tsdb *db, struct tsdb_series *temperature, struct tsdb_series *pressure,
+									  long long time, const struct bmp085_value *value) {
+
+	tsdb_append(db, temperature, time, value->temperature);
+	tsdb_append(db, pressure, time, value->pressure);
+}
+
+#endif
+
+
+#if defined(HIH6130_H_) && !defined(LIBTSDB_HIH6130_)
+#define LIBTSDB_HIH6130_
+
+/**
+ * Append a HIH6130 sample to a humidity and a temperature series, stale
+ * samples are left out
+ */
+static inline void tsdb_append_hih6130(struct tsdb *db, struct tsdb_series *humidity, struct tsdb_series *temperature,
+									   long long time, const struct hih6130_value *value) {
+
+	if(value->status != HIH6130_STATUS_NORMAL)
+		return;
+
+	tsdb_append(db, humidity, time, value->humidity);
+	tsdb_append(db, temperature, time, value->temperature);
+}
+
+#endif
@@ -27,6 +27,10 @@
 #include <linux/types.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
+#include "libprobe.h"
+
+PROBE_SEMAPHORE(smbus, access_entry);
+PROBE_SEMAPHORE(smbus, access_return);
 
 //NB: Added by John Burns
 #ifndef NULL
@@ -52,9 +56,14 @@ __s32 i2c_smbus_access(int file, char read_write, __u8 command,
 	args.size = size;
 	args.data = data;
 
+	PROBE4(smbus, access_entry, file, read_write, command, size);
+
 	err = ioctl(file, I2C_SMBUS, &args);
 	if (err == -1)
 		err = -errno;
+
+	PROBE5(smbus, access_return, file, read_write, command, size, err);
+
 	return err;
 }
 
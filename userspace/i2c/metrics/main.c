@@ -0,0 +1,297 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c measures the scrape latency of libmetrics.h on a Unix socket while
+ *  clients scrape concurrently and a thread updates the metrics. No sensor
+ *  is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm -lpthread
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../lib/libmetrics.h"
+
+
+#define SOCKET      "/tmp/metrics-benchmark.sock"
+#define DURATION    3            ///< Seconds of scraping
+#define MAX_CLIENTS 16           ///< Most concurrent scrapers
+#define MAX_SCRAPES 200000       ///< Latencies kept per scraper
+#define SENSORS     8            ///< Sensors of the page, 3 gauges each
+
+#define USAGE "Usage: main [CLIENTS [IDLE]]\n" \
+	"\n" \
+	"Scrape latency of libmetrics.h under concurrent clients.\n" \
+	"  CLIENTS  scrapers in a loop, 1..16, default 4\n" \
+	"  IDLE     connections opened without a request, default 0\n"
+
+
+struct metrics metrics;
+int histogram;
+volatile int stop, stop_server;
+
+double latency[MAX_CLIENTS][MAX_SCRAPES];
+int scrapes[MAX_CLIENTS];
+unsigned long failed;
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Connect to the exporter
+ * \return The socket, -1 on error
+ */
+static int metrics_connect(void) {
+
+	struct sockaddr_un address;
+	int fd;
+
+	memset(&address, 0, sizeof(address));
+
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, SOCKET, sizeof(address.sun_path) - 1);
+
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+
+	if(connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+/**
+ * A scraper: connect, request, read the page, as fast as possible
+ */
+static void *client(void *arg) {
+
+	static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	char page[METRICS_BUFFER + 256];
+	long id = (long)arg;
+	double start;
+	ssize_t length;
+	int fd, total;
+
+	while(!stop) {
+
+		start = now();
+
+		if((fd = metrics_connect()) < 0)
+			continue;
+
+		total = 0;
+
+		if(write(fd, request, sizeof(request) - 1) == sizeof(request) - 1) {
+
+			while((length = read(fd, page + total, sizeof(page) - 1 - total)) > 0)
+				total += length;
+		}
+
+		close(fd);
+
+		page[total] = '\0';
+
+		if(strstr(page, "200 OK") == NULL) {
+
+			__atomic_add_fetch(&failed, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if(scrapes[id] < MAX_SCRAPES)
+			latency[id][scrapes[id]++] = now() - start;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * The serving thread
+ */
+static void *server(void *arg) {
+
+	(void)arg;
+
+	while(!stop_server)
+		metrics_serve(&metrics, 10);
+
+	return NULL;
+}
+
+
+/**
+ * Sampling thread: updates the gauges and the histogram all the time
+ */
+static void *producer(void *arg) {
+
+	long i;
+	int k;
+
+	(void)arg;
+
+	for(i=0; !stop; i++) {
+
+		for(k=0; k<SENSORS*3; k++)
+			metrics_set(&metrics, k, 1000.0 + (i + k) % 100 / 100.0);
+
+		metrics_observe(&metrics, histogram, (i % 50) * 1e-3);
+
+		if(i % 1000 == 0)
+			usleep(100);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * qsort() comparison
+ */
+static int compare_double(const void *a, const void *b) {
+
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+int main(int argc, char **argv) {
+
+	static const double bounds[] = { 0.001, 0.005, 0.01, 0.025, 0.05 };
+	static double all[MAX_CLIENTS * MAX_SCRAPES];
+	static const char *quantity[] = { "temperature_celsius", "pressure_hpa", "humidity_percent" };
+	pthread_t server_thread, producer_thread, client_thread[MAX_CLIENTS];
+	int idle[METRICS_CLIENTS];
+	char labels[32];
+	int clients = 4, idles = 0, count = 0, i, k;
+
+	if(argc > 1)
+		clients = atoi(argv[1]);
+
+	if(argc > 2)
+		idles = atoi(argv[2]);
+
+	if(argc > 3 || clients < 1 || clients > MAX_CLIENTS || idles < 0 || idles > METRICS_CLIENTS) {
+
+		printf(USAGE);
+		return 1;
+	}
+
+	metrics_init(&metrics);
+
+	// Gauges first, their indices are 0..SENSORS*3-1
+	for(k=0; k<3; k++) {
+
+		for(i=0; i<SENSORS; i++) {
+
+			snprintf(labels, sizeof(labels), "sensor=\"%d\"", i);
+			metrics_add(&metrics, quantity[k], labels, NULL, METRICS_GAUGE);
+		}
+	}
+
+	histogram = metrics_add_histogram(&metrics, "sample_latency_seconds", NULL, "Sample latency", bounds, 5);
+
+	printf("Page of %d bytes, %d lines\n", metrics.length, metrics.fields);
+
+	metrics_listen_unix(&metrics, SOCKET);
+
+	pthread_create(&server_thread, NULL, server, NULL);
+	pthread_create(&producer_thread, NULL, producer, NULL);
+
+	// Idle connections hold an entry until METRICS_CLIENT_TIMEOUT
+	for(i=0; i<idles; i++)
+		idle[i] = metrics_connect();
+
+	for(i=0; i<clients; i++)
+		pthread_create(&client_thread[i], NULL, client, (void *)(long)i);
+
+	sleep(DURATION);
+	stop = 1;
+
+	for(i=0; i<clients; i++)
+		pthread_join(client_thread[i], NULL);
+
+	stop_server = 1;
+
+	pthread_join(server_thread, NULL);
+	pthread_join(producer_thread, NULL);
+
+	for(i=0; i<idles; i++) {
+
+		if(idle[i] >= 0)
+			close(idle[i]);
+	}
+
+	for(i=0; i<clients; i++) {
+
+		memcpy(all + count, latency[i], scrapes[i] * sizeof(double));
+		count += scrapes[i];
+	}
+
+	if(count == 0) {
+
+		puts("Error: no scrape succeeded");
+		return 1;
+	}
+
+	qsort(all, count, sizeof(double), compare_double);
+
+	printf("%d clients, %d idle: %lu scrapes in %d s (%.0f/s), %lu failed\n",
+			clients, idles, metrics.scrapes, DURATION, metrics.scrapes / (double)DURATION, failed);
+	printf("Latency p50 %.1fus, p99 %.1fus, max %.1fus\n",
+			all[count / 2] * 1e6, all[count * 99 / 100] * 1e6, all[count - 1] * 1e6);
+
+	metrics_close(&metrics);
+	unlink(SOCKET);
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c benchmarks libpool.h against a serial loop on a simulated
+ *  multi-bus backend. No sensor is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lpthread
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/libpool.h"
+
+
+#define USAGE "libpool.h benchmark on a simulated multi-bus backend\n" \
+	          "Usage: pool [TRANSFER CPU JOBS]\n" \
+	          "\n" \
+	          "TRANSFER  us one transfer occupies its bus, default 500\n" \
+	          "CPU       us of CPU work per sample, default 50\n" \
+	          "JOBS      jobs per bus, default 200\n"
+
+
+/*
+ * Simulated backend: a transfer sleeps like a thread blocked in the i2c
+ * ioctl, the CPU side spins like the compensation math. A counter per
+ * bus catches two transfers overlapping on one adapter.
+ */
+long transfer_us = 500;
+long cpu_us = 50;
+int bus_active[POOL_MAX_BUS];
+volatile double sink;
+
+
+/**
+ * CLOCK_MONOTONIC time in ns
+ */
+static long long now_ns(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+/**
+ * Bus side of a simulated sensor
+ */
+static int sim_transfer(struct pool_job *job) {
+
+	struct timespec wait = { 0, transfer_us * 1000 };
+
+	if(__sync_add_and_fetch(&bus_active[job->bus], 1) != 1) {
+
+		printf("Error: transfers overlap on bus %d\n", job->bus);
+		exit(1);
+	}
+
+	nanosleep(&wait, NULL);
+
+	__sync_sub_and_fetch(&bus_active[job->bus], 1);
+
+	return 0;
+}
+
+
+/**
+ * CPU side of a simulated sensor
+ */
+static void sim_process(struct pool_job *job) {
+
+	long long start = now_ns();
+	double x = 1.0;
+
+	(void)job;
+
+	while(now_ns() - start < cpu_us * 1000LL)
+		x *= 1.0000001;
+
+	sink = x;
+}
+
+
+int main(int argc, char **argv) {
+
+	static struct pool_job job[POOL_MAX_BUS * 1000];
+	static struct pool pool;
+
+	int jobs = 200, buses, workers, i;
+	unsigned long stolen;
+	long long start;
+	double serial, parallel;
+
+	if(argc == 4) {
+
+		transfer_us = atol(argv[1]);
+		cpu_us      = atol(argv[2]);
+		jobs        = atoi(argv[3]);
+	}
+	else if(argc != 1) {
+
+		puts(USAGE);
+		return 1;
+	}
+
+	if(jobs < 1 || jobs > 1000 || transfer_us < 0 || transfer_us >= 1000000 || cpu_us < 0) {
+
+		puts("Error: TRANSFER below 1 s and JOBS 1..1000 please");
+		return 1;
+	}
+
+	printf("%ld us transfer, %ld us CPU side, %d jobs per bus\n\n", transfer_us, cpu_us, jobs);
+	puts("buses workers   serial     pool   speedup  stolen");
+
+	for(buses=1; buses<=POOL_MAX_BUS; buses*=2) {
+
+		// Baseline: one thread, bus after bus
+		start = now_ns();
+
+		for(i=0; i<buses*jobs; i++) {
+
+			job[i].bus = i % buses;
+			sim_transfer(&job[i]);
+			sim_process(&job[i]);
+		}
+
+		serial = (now_ns() - start) / 1e6;
+
+		// One and two workers per bus
+		for(workers=buses; workers<=2*buses && workers<=POOL_MAX_WORKERS; workers+=buses) {
+
+			memset(job, 0, sizeof(job));
+
+			for(i=0; i<buses*jobs; i++) {
+
+				job[i].bus      = i % buses;
+				job[i].transfer = sim_transfer;
+				job[i].process  = sim_process;
+			}
+
+			pool_start(&pool, workers);
+
+			start = now_ns();
+
+			for(i=0; i<buses*jobs; i++)
+				pool_submit(&pool, &job[i]);
+
+			pool_wait(&pool);
+
+			parallel = (now_ns() - start) / 1e6;
+
+			for(stolen=0, i=0; i<workers; i++)
+				stolen += pool.worker[i].stolen;
+
+			pool_stop(&pool);
+
+			printf("%5d %7d %7.1fms %7.1fms %8.2f %7lu\n", buses, workers, serial, parallel, serial / parallel, stolen);
+		}
+	}
+
+	return 0;
+}
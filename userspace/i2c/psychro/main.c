@@ -0,0 +1,173 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c measures the accuracy and the throughput of libpsychro.h against
+ *  the Magnus formula evaluated with libm. No sensor is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/libpsychro.h"
+
+
+#define SAMPLES 1000000
+
+
+float temperature[SAMPLES], humidity[SAMPLES];
+float dew_point[SAMPLES], frost_point[SAMPLES], absolute_humidity[SAMPLES], vapour_pressure[SAMPLES];
+short temperature_centi[SAMPLES], humidity_centi[SAMPLES];
+int dew_point_centi[SAMPLES], frost_point_centi[SAMPLES], absolute_humidity_centi[SAMPLES], vapour_pressure_centi[SAMPLES];
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Largest error of the float and the integer functions against the
+ * Magnus formula in double precision with libm, on a grid over
+ * -40..85 deg C and 0.5..100 %RH
+ */
+static void accuracy(void) {
+
+	double t, rh, a, gamma, e, dew, frost, ah;
+	double error[8] = { 0 };
+	int tc, rhc;
+	float tf, rhf;
+
+	for(tc=-4000; tc<=8500; tc+=7) {
+
+		for(rhc=50; rhc<=10000; rhc+=13) {
+
+			t     = tc / 100.0;
+			rh    = rhc / 100.0;
+			a     = 17.62 * t / (243.12 + t);
+			gamma = log(rh / 100.0) + a;
+			dew   = 243.12 * gamma / (17.62 - gamma);
+			frost = 272.62 * gamma / (22.46 - gamma);
+			e     = 6.112 * rh / 100.0 * exp(a);
+			ah    = 216.68 * e / (273.15 + t);
+
+			tf  = tc / 100.0f;
+			rhf = rhc / 100.0f;
+
+			error[0] = fmax(error[0], fabs(psychro_dew_point(tf, rhf) - dew));
+			error[1] = fmax(error[1], fabs(psychro_frost_point(tf, rhf) - frost));
+			error[2] = fmax(error[2], fabs(psychro_vapour_pressure(tf, rhf) / e - 1.0));
+			error[3] = fmax(error[3], fabs(psychro_absolute_humidity(tf, rhf) / ah - 1.0));
+
+			error[4] = fmax(error[4], fabs(psychro_dew_point_centi(tc, rhc) / 100.0 - dew));
+			error[5] = fmax(error[5], fabs(psychro_frost_point_centi(tc, rhc) / 100.0 - frost));
+			error[6] = fmax(error[6], fabs(psychro_vapour_pressure_centi(tc, rhc) - e * 100.0));
+			error[7] = fmax(error[7], fabs(psychro_absolute_humidity_centi(tc, rhc) / 100.0 - ah));
+		}
+	}
+
+	puts("Largest error against double precision libm:");
+	printf("float:\t\t dew %.1e°C, frost %.1e°C, vapour pressure %.1e, absolute humidity %.1e (relative)\n",
+			error[0], error[1], error[2], error[3]);
+	printf("integer:\t dew %.4f°C, frost %.4f°C, vapour pressure %.3fPa, absolute humidity %.4fg/m3\n",
+			error[4], error[5], error[6], error[7]);
+}
+
+
+/**
+ * Time per sample of all four quantities: logf/expf, psychro_batch()
+ * and psychro_batch_centi()
+ */
+static void throughput(void) {
+
+	double start, libm, batch, centi;
+	float t, rh, a, gamma;
+	int i;
+
+	for(i=0; i<SAMPLES; i++) {
+
+		temperature[i]       = -40.0f + 125.0f * i / SAMPLES;
+		humidity[i]          = 1.0f + 99.0f * ((i * 7919LL) % SAMPLES) / SAMPLES;
+		temperature_centi[i] = temperature[i] * 100.0f;
+		humidity_centi[i]    = humidity[i] * 100.0f;
+	}
+
+	start = now();
+
+	for(i=0; i<SAMPLES; i++) {
+
+		t     = temperature[i];
+		rh    = humidity[i];
+		a     = 17.62f * t / (243.12f + t);
+		gamma = logf(rh / 100.0f) + a;
+
+		dew_point[i]         = 243.12f * gamma / (17.62f - gamma);
+		frost_point[i]       = 272.62f * gamma / (22.46f - gamma);
+		vapour_pressure[i]   = 6.112f * rh / 100.0f * expf(a);
+		absolute_humidity[i] = 216.68f * vapour_pressure[i] / (273.15f + t);
+	}
+
+	libm = now() - start;
+
+	start = now();
+	psychro_batch(temperature, humidity, SAMPLES, dew_point, frost_point, absolute_humidity, vapour_pressure);
+	batch = now() - start;
+
+	start = now();
+	psychro_batch_centi(temperature_centi, humidity_centi, SAMPLES,
+			dew_point_centi, frost_point_centi, absolute_humidity_centi, vapour_pressure_centi);
+	centi = now() - start;
+
+	printf("\nTime per sample, all four quantities, %d samples:\n", SAMPLES);
+	printf("logf/expf:\t\t %6.1fns\n", libm * 1e9 / SAMPLES);
+	printf("psychro_batch:\t\t %6.1fns\n", batch * 1e9 / SAMPLES);
+	printf("psychro_batch_centi:\t %6.1fns\n", centi * 1e9 / SAMPLES);
+}
+
+
+int main(void) {
+
+	accuracy();
+	throughput();
+
+	return 0;
+}
@@ -0,0 +1,341 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  reactor/main.c shows libreactor.h tasks reading a BMP085 and a HIH6130
+ *  and measures the reactor on simulated sensors.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <linux/i2c-dev.h>
+
+#include "../lib/libbmp085.h"
+#include "../lib/libhih6130.h"
+#include "../lib/libreactor.h"
+
+
+#define USAGE "libreactor.h demo and benchmark\n" \
+	          "Usage: reactor [-s] [TASKS]\n" \
+	          "\n" \
+	          "TASKS  simulated BMP085 and HIH6130 tasks each, default 500\n" \
+	          "-s     read a real BMP085 and HIH6130 instead, 10 samples\n" \
+	          "       (bus and address of bmp085_i2c_device/address and\n" \
+	          "       hih6130_i2c_device/address)\n"
+
+#define MAX_TASKS 10000
+#define SAMPLES   5       ///< Samples per simulated task
+#define PAUSE     50000   ///< us between two samples of a simulated task
+
+
+/*
+ * Simulated sensors sleep the conversion times of the drivers instead of
+ * talking to the bus. Two listeners await the same eventfd, which a third
+ * task signals once per pause.
+ */
+long samples;
+int event_fd = -1;
+
+struct listener {
+	unsigned long wakeups;
+	unsigned long long events;
+} listener[2];
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/**
+ * BMP085 task, conversion times of ultra high over sampling
+ */
+static int sim_bmp085(struct reactor *reactor, struct reactor_task *task) {
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<SAMPLES; task->state++) {
+
+		REACTOR_SLEEP(reactor, task, BMP085_UT_TIME);
+		REACTOR_SLEEP(reactor, task, BMP085_UP_TIME(BMP085_OVERSAMPLING_ULTRA));
+
+		samples++;
+
+		REACTOR_SLEEP(reactor, task, PAUSE);
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * HIH6130 task, one measurement cycle per sample
+ */
+static int sim_hih6130(struct reactor *reactor, struct reactor_task *task) {
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<SAMPLES; task->state++) {
+
+		REACTOR_SLEEP(reactor, task, HIH6130_MEASUREMENT_TIME);
+
+		samples++;
+
+		REACTOR_SLEEP(reactor, task, PAUSE);
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * Signals the eventfd once per pause, like an alarm interrupt would
+ */
+static int signal_event(struct reactor *reactor, struct reactor_task *task) {
+
+	unsigned long long one = 1;
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<SAMPLES; task->state++) {
+
+		REACTOR_SLEEP(reactor, task, PAUSE);
+
+		if(write(event_fd, &one, sizeof(one)) != sizeof(one)) {
+
+			perror("Error while write eventfd:");
+			exit(1);
+		}
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * Awaits the eventfd, the other listener may have read the count already
+ */
+static int await_event(struct reactor *reactor, struct reactor_task *task) {
+
+	struct listener *self = task->user;
+	unsigned long long count;
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<SAMPLES; task->state++) {
+
+		REACTOR_AWAIT_FD(reactor, task, event_fd, EPOLLIN);
+
+		self->wakeups++;
+
+		if(read(event_fd, &count, sizeof(count)) == sizeof(count))
+			self->events += count;
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * BMP085 example task, see libreactor.h
+ */
+static int read_bmp085(struct reactor *reactor, struct reactor_task *task) {
+
+	struct bmp085_device *dev = task->dev;
+	struct bmp085_value *value = task->value;
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<10; task->state++) {
+
+		REACTOR_SLEEP(reactor, task, bmp085_start_temperature(dev));
+		bmp085_fetch_temperature(dev);
+
+		REACTOR_SLEEP(reactor, task, bmp085_start_pressure(dev));
+		value->temperature = bmp085_calc_temperature(&dev->calibration, dev->ut);
+		value->pressure    = bmp085_calc_pressure(&dev->calibration,
+				dev->oversampling, bmp085_fetch_pressure(dev));
+
+		printf("BMP085:  %.1f deg C, %.2f mbar\n", value->temperature, value->pressure);
+
+		REACTOR_SLEEP(reactor, task, 1000000);
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * HIH6130 example task, awaits the measurement cycle
+ */
+static int read_hih6130(struct reactor *reactor, struct reactor_task *task) {
+
+	struct hih6130_device *dev = task->dev;
+	struct hih6130_value *value = task->value;
+
+	REACTOR_BEGIN(task);
+
+	for(task->state=0; task->state<10; task->state++) {
+
+		REACTOR_AWAIT_SAMPLE(reactor, task, hih6130_poll_value(dev, value),
+				hih6130_time_to_ready(dev));
+
+		printf("HIH6130: %.1f deg C, %.1f %%rH\n", value->temperature, value->humidity);
+
+		REACTOR_SLEEP(reactor, task, 1000000);
+	}
+
+	REACTOR_END(task);
+}
+
+
+/**
+ * Both example tasks on the real sensors
+ */
+static void sensors(void) {
+
+	static struct reactor_task *heap[2];
+
+	struct reactor reactor;
+	struct reactor_task task[2];
+	struct bmp085_device bmp085;
+	struct bmp085_value bmp085_value;
+	struct hih6130_device hih6130;
+	struct hih6130_value hih6130_value;
+
+	bmp085_open(&bmp085, bmp085_i2c_device, bmp085_i2c_address, BMP085_OVERSAMPLING_ULTRA);
+	hih6130_open(&hih6130, hih6130_i2c_device, hih6130_i2c_address, 0);
+
+	memset(task, 0, sizeof(task));
+
+	task[0].dev   = &bmp085;
+	task[0].value = &bmp085_value;
+	task[1].dev   = &hih6130;
+	task[1].value = &hih6130_value;
+
+	reactor_init(&reactor, heap, 2);
+	reactor_spawn(&reactor, &task[0], read_bmp085);
+	reactor_spawn(&reactor, &task[1], read_hih6130);
+	reactor_run(&reactor);
+	reactor_close(&reactor);
+
+	bmp085_close(&bmp085);
+	hih6130_close(&hih6130);
+}
+
+
+int main(int argc, char **argv) {
+
+	static struct reactor_task task[2 * MAX_TASKS + 3];
+	static struct reactor_task *heap[2 * MAX_TASKS + 3];
+
+	struct reactor reactor;
+	int tasks = 500, i;
+	double start, elapsed;
+
+	if(argc == 2 && strcmp(argv[1], "-s") == 0) {
+
+		sensors();
+		return 0;
+	}
+
+	if(argc == 2)
+		tasks = atoi(argv[1]);
+	else if(argc != 1) {
+
+		puts(USAGE);
+		return 1;
+	}
+
+	if(tasks < 1 || tasks > MAX_TASKS) {
+
+		printf("Error: TASKS 1..%d please\n", MAX_TASKS);
+		return 1;
+	}
+
+	if((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+
+		perror("Error while create eventfd:");
+		return 1;
+	}
+
+	reactor_init(&reactor, heap, 2 * tasks + 3);
+
+	for(i=0; i<tasks; i++) {
+
+		reactor_spawn(&reactor, &task[2 * i], sim_bmp085);
+		reactor_spawn(&reactor, &task[2 * i + 1], sim_hih6130);
+	}
+
+	task[2 * tasks].user     = &listener[0];
+	task[2 * tasks + 1].user = &listener[1];
+
+	reactor_spawn(&reactor, &task[2 * tasks], await_event);
+	reactor_spawn(&reactor, &task[2 * tasks + 1], await_event);
+	reactor_spawn(&reactor, &task[2 * tasks + 2], signal_event);
+
+	start = now();
+	reactor_run(&reactor);
+	elapsed = now() - start;
+
+	reactor_close(&reactor);
+	close(event_fd);
+
+	printf("%d tasks on one thread, %zu bytes each\n", 2 * tasks + 3, sizeof(struct reactor_task));
+	printf("%ld samples in %.0f ms (%d x %.0f ms HIH6130 cycle)\n", samples, elapsed * 1e3,
+			SAMPLES, (HIH6130_MEASUREMENT_TIME + PAUSE) / 1e3);
+	printf("%lu resumes, %lu epoll wakeups\n", reactor.resumes, reactor.wakeups);
+	printf("eventfd: %d signals, listeners woken %lu and %lu times, %llu events read\n",
+			SAMPLES, listener[0].wakeups, listener[1].wakeups, listener[0].events + listener[1].events);
+
+	if(listener[0].wakeups != SAMPLES || listener[1].wakeups != SAMPLES
+			|| listener[0].events + listener[1].events != SAMPLES) {
+
+		puts("Error: every listener must see every signal");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,316 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  samplelog/main.c measures libsamplelog.h and tests a reader against a
+ *  writer that recycles the blocks under it.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lm
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <linux/i2c-dev.h>
+
+#include "../lib/libbmp085.h"
+#include "../lib/libhih6130.h"
+#include "../lib/libsamplelog.h"
+
+
+#define RECORDS 3000000   ///< Benchmark records, BMP085 and HIH6130 alternating
+#define SEEKS   100000
+
+#define USAGE "libsamplelog.h benchmark and reader/writer stress test\n" \
+	          "Usage: samplelog [-t SECONDS] [FILE]\n" \
+	          "\n" \
+	          "Without -t: append, scan and seek RECORDS samples and check that\n" \
+	          "            they round trip bit exact\n" \
+	          "-t          a writer process appends into the smallest ring (2\n" \
+	          "            blocks) for SECONDS while this process reads with\n" \
+	          "            slog_next(); every record must be consistent\n" \
+	          "FILE        the temporary log, default /tmp/samplelog-test.log\n"
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Sample i of the benchmark, values the drivers can return
+ */
+static void sample(long i, struct bmp085_value *bmp085, struct hih6130_value *hih6130) {
+
+	__u8 data[4];
+
+	bmp085->temperature = (float)(215 + i % 40) / 10.0f;
+	bmp085->pressure    = (float)(101325 + (i * 7) % 900 - 450) / 100.0f;
+
+	slog_hih6130_frame(8000 + (int)(i % 300), 6500 + (int)(i % 120), data);
+
+	hih6130->humidity    = hih6130_calc_humidity(data);
+	hih6130->temperature = hih6130_calc_temperature(data);
+	hih6130->status      = (unsigned char)(i % 3 == 0);
+}
+
+
+/**
+ * Append, scan and seek; the values must come back bit identical
+ */
+static int benchmark(const char *path) {
+
+	struct slog log;
+	struct slog_cursor cursor;
+	struct slog_record record;
+	struct bmp085_value bmp085, bmp085_read;
+	struct hih6130_value hih6130, hih6130_read;
+	double start, append, scan, seek;
+	long i, count = 0, errors = 0;
+	long long time;
+
+	unlink(path);
+
+	slog_open(&log, path, (size_t)RECORDS * 12);
+
+	start = now();
+
+	for(i=0; i<RECORDS; i++) {
+
+		sample(i / 2, &bmp085, &hih6130);
+
+		if(i % 2 == 0)
+			slog_append_bmp085(&log, 1, i * 500LL, &bmp085, 27898 + (int)(i % 11), 23843 + (int)(i % 17));
+		else
+			slog_append_hih6130(&log, 2, i * 500LL, &hih6130);
+	}
+
+	append = now() - start;
+
+	start = now();
+
+	for(slog_first(&cursor, &log); slog_next(&cursor, &record); count++) {
+
+		i = (long)(record.time / 500);
+
+		sample(i / 2, &bmp085, &hih6130);
+
+		if(record.kind == SLOG_BMP085) {
+
+			slog_bmp085_value(&record, &bmp085_read);
+
+			if(i % 2 != 0 || bmp085_read.temperature != bmp085.temperature
+			|| bmp085_read.pressure != bmp085.pressure || record.raw[0] != 27898 + (int)(i % 11))
+				errors++;
+		}
+		else {
+
+			slog_hih6130_value(&record, &hih6130_read);
+
+			if(i % 2 != 1 || hih6130_read.humidity != hih6130.humidity
+			|| hih6130_read.temperature != hih6130.temperature || hih6130_read.status != hih6130.status)
+				errors++;
+		}
+	}
+
+	scan = now() - start;
+
+	start = now();
+
+	for(i=0; i<SEEKS; i++) {
+
+		time = (i * 7919L % RECORDS) * 500LL;
+
+		slog_seek(&cursor, &log, time);
+
+		if(!slog_next(&cursor, &record) || record.time != time)
+			errors++;
+	}
+
+	seek = now() - start;
+
+	printf("%d records, %llu blocks, %.1f bytes per record\n", RECORDS, log.newest,
+			(double)log.newest * SLOG_BLOCK / RECORDS);
+	printf("append: %6.2f M records/s\n", RECORDS / append / 1e6);
+	printf("scan:   %6.2f M records/s\n", count / scan / 1e6);
+	printf("seek:   %6.2f us\n", seek / SEEKS * 1e6);
+
+	slog_close(&log);
+	unlink(path);
+
+	if(count != RECORDS || errors) {
+
+		printf("Error: %ld of %d records read, %ld wrong\n", count, RECORDS, errors);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Record of time t in the stress test, every field derives from t
+ */
+static void stress_record(long long t, struct slog_record *record) {
+
+	memset(record, 0, sizeof(*record));
+
+	record->time     = t;
+	record->kind     = t % 3 ? SLOG_BMP085 : SLOG_HIH6130;
+	record->channel  = (unsigned short)(t % 4096);
+	record->status   = record->kind == SLOG_HIH6130 ? (unsigned char)(t % 4) : 0;
+	record->raw[0]   = (int)(t % 16384);
+	record->raw[1]   = (int)(t * 7 % 16381);
+
+	if(record->kind == SLOG_BMP085) {
+
+		record->value[0] = (int)(t % 1000) - 400;
+		record->value[1] = 90000 + (int)(t * 13 % 20011);
+	}
+}
+
+
+/**
+ * Reader against a writer process recycling a 2 block ring
+ */
+static int stress(const char *path, double seconds) {
+
+	struct slog writer, reader;
+	struct slog_cursor cursor;
+	struct slog_record record, expect;
+	unsigned long long t;
+	long long last = -1;
+	long count = 0, errors = 0, lost = 0, status;
+	double stop;
+	pid_t pid;
+
+	unlink(path);
+
+	slog_open(&writer, path, 3 * SLOG_BLOCK);
+
+	stop = now() + seconds;
+
+	if((pid = fork()) < 0) {
+
+		perror("Error while fork writer:");
+		return 1;
+	}
+
+	if(pid == 0) {
+
+		for(t=1; now() < stop; t++) {
+
+			stress_record(t, &record);
+			slog_append(&writer, &record);
+		}
+
+		printf("writer: %llu records, %llu blocks\n", t - 1, writer.newest);
+		exit(0);
+	}
+
+	slog_close(&writer);
+	slog_open_read(&reader, path);
+	slog_first(&cursor, &reader);
+
+	while(now() < stop + 0.1) {
+
+		if(!slog_next(&cursor, &record))
+			continue;
+
+		stress_record(record.time, &expect);
+
+		if(memcmp(&record, &expect, sizeof(record)) != 0 || record.time <= last) {
+
+			if(errors++ < 10)
+				printf("Error: record of %lld after %lld is torn\n", record.time, last);
+		}
+
+		// A gap is a block overwritten before the reader got to it
+		if(record.time > last + 1 && last >= 0)
+			lost++;
+
+		last = record.time;
+		count++;
+	}
+
+	waitpid(pid, NULL, 0);
+
+	status = errors ? 1 : 0;
+
+	printf("reader: %ld records, %ld gaps from recycled blocks, %ld torn\n", count, lost, errors);
+
+	slog_close(&reader);
+	unlink(path);
+
+	return (int)status;
+}
+
+
+int main(int argc, char **argv) {
+
+	const char *path = "/tmp/samplelog-test.log";
+	double seconds = 0;
+	int i = 1;
+
+	if(argc > 2 && strcmp(argv[1], "-t") == 0) {
+
+		seconds = atof(argv[2]);
+		i = 3;
+
+		if(seconds <= 0) {
+
+			puts(USAGE);
+			return 1;
+		}
+	}
+
+	if(argc == i + 1)
+		path = argv[i];
+	else if(argc != i) {
+
+		puts(USAGE);
+		return 1;
+	}
+
+	return seconds > 0 ? stress(path, seconds) : benchmark(path);
+}
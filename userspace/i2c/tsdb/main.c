@@ -0,0 +1,286 @@
+/**
+ *  Copyright (C) 2013 Knut Welzel (knut@welzels.de)
+ *
+ *  main.c compares the size and the encode and decode throughput of libtsdb.h
+ *  with CSV and CSV compressed with zlib. No sensor is needed.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ *  der GNU General Public License, wie von der Free Software Foundation,
+ *  Version 3 der Lizenz oder (nach Ihrer Option) jeder späteren
+ *  veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+ *
+ *  Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ *  OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ *  Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ *  Siehe die GNU General Public License für weitere Details.
+ *
+ *  Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ *  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Compiling Options:
+ *   -O2 -lz
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "../lib/libtsdb.h"
+
+
+#define ROWS    2000000           ///< Rows of 1 s samples, about 23 days
+#define INDEX   100000            ///< Index entries, enough for ROWS
+#define SERIES  4
+
+#define USAGE "Usage: main [FILE]\n" \
+	"\n" \
+	"Benchmark of libtsdb.h against CSV and CSV compressed with zlib.\n" \
+	"FILE is the temporary store, default /tmp/tsdb-benchmark.db\n"
+
+
+long long row_time[ROWS];
+float temperature[ROWS], pressure[ROWS], humidity[ROWS];
+int raw[ROWS];
+
+struct tsdb_index tsdb_index[INDEX];
+struct tsdb_series series[SERIES];
+
+
+/**
+ * CLOCK_MONOTONIC time in seconds
+ */
+static double now(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Rows of a BMP085 and a HIH6130 sampled every second: random walks in
+ * the resolution of the sensors, a raw UP reading and some timing jitter
+ */
+static void generate(void) {
+
+	long long t = 1700000000000LL;
+	int t10 = 215, pa = 101325, rh = 8000, up = 23843;
+	int i;
+
+	srand(7);
+
+	for(i=0; i<ROWS; i++) {
+
+		t += 1000;
+
+		if(rand() % 50 == 0)
+			t += rand() % 5 - 2;
+
+		if(rand() % 20 == 0)
+			t10 += rand() % 3 - 1;
+
+		if(rand() % 3 == 0)
+			pa += rand() % 5 - 2;
+
+		if(rand() % 4 == 0)
+			rh += rand() % 5 - 2;
+
+		up += rand() % 9 - 4;
+
+		row_time[i]    = t;
+		temperature[i] = t10 / 10.0f;
+		pressure[i]    = pa / 100.0f;
+		humidity[i]    = rh / 163.82f;
+		raw[i]         = up;
+	}
+}
+
+
+/**
+ * Compression ratio, encode and decode throughput of libtsdb.h,
+ * the decoded points are compared bit by bit with the input
+ * \return Number of mismatches
+ */
+static long benchmark_tsdb(const char *path) {
+
+	struct tsdb db;
+	struct tsdb_cursor cursor;
+	struct tsdb_point point;
+	double start, encode, decode, bits[SERIES] = { 0 };
+	long points = 0, mismatches = 0, i;
+	float expect;
+	int k;
+
+	unlink(path);
+
+	tsdb_open(&db, path, tsdb_index, INDEX);
+
+	for(k=0; k<SERIES; k++)
+		tsdb_series_init(&series[k], k, k < 3 ? TSDB_FLOAT : TSDB_INT);
+
+	start = now();
+
+	for(i=0; i<ROWS; i++) {
+
+		tsdb_append(&db, &series[0], row_time[i], temperature[i]);
+		tsdb_append(&db, &series[1], row_time[i], pressure[i]);
+		tsdb_append(&db, &series[2], row_time[i], humidity[i]);
+		tsdb_append_int(&db, &series[3], row_time[i], raw[i]);
+	}
+
+	for(k=0; k<SERIES; k++)
+		tsdb_flush(&db, &series[k]);
+
+	encode = now() - start;
+
+	for(k=0; k<db.count; k++)
+		bits[tsdb_index[k].series] += TSDB_BLOCK * 8.0;
+
+	printf("tsdb:\t\t %9ld bytes, %5.2f bytes/row, encode %6.1fM points/s\n",
+			(long)db.blocks * TSDB_BLOCK, (double)db.blocks * TSDB_BLOCK / ROWS,
+			SERIES * (double)ROWS / encode / 1e6);
+	printf("\t\t temperature %.1f, pressure %.1f, humidity %.1f, raw UP %.1f bits/point\n",
+			bits[0] / ROWS, bits[1] / ROWS, bits[2] / ROWS, bits[3] / ROWS);
+
+	// Reopen, the queries run from the index read back from the file
+	tsdb_close(&db);
+	tsdb_open(&db, path, tsdb_index, INDEX);
+
+	start = now();
+
+	for(k=0; k<SERIES; k++) {
+
+		tsdb_query(&cursor, &db, k, 0, 1LL << 62);
+
+		for(i=0; tsdb_next(&cursor, &point); i++, points++) {
+
+			if(i >= ROWS) {
+
+				mismatches++;
+				continue;
+			}
+
+			expect = k == 0 ? temperature[i] : k == 1 ? pressure[i] : humidity[i];
+
+			if(point.time != row_time[i]
+			|| (k < 3 ? memcmp(&point.value, &expect, sizeof(expect)) != 0 : point.raw != raw[i]))
+				mismatches++;
+		}
+	}
+
+	decode = now() - start;
+
+	printf("\t\t decode %6.1fM points/s, %ld points, %ld mismatches\n",
+			points / decode / 1e6, points, mismatches);
+
+	tsdb_close(&db);
+	unlink(path);
+
+	return mismatches + (points != SERIES * (long)ROWS);
+}
+
+
+/**
+ * Size and speed of the same rows as CSV, plain and deflated with zlib
+ */
+static void benchmark_csv(void) {
+
+	char *csv;
+	unsigned char *deflated;
+	uLongf deflated_length, inflated_length;
+	size_t length = 0;
+	double start, format, compress, inflate;
+	long i;
+
+	if((csv = malloc((size_t)ROWS * 64)) == NULL) {
+
+		perror("Error while allocate CSV buffer:");
+		exit(1);
+	}
+
+	start = now();
+
+	for(i=0; i<ROWS; i++)
+		length += sprintf(csv + length, "%lld,%.1f,%.2f,%.2f,%d\n",
+				row_time[i], temperature[i], pressure[i], humidity[i], raw[i]);
+
+	format = now() - start;
+
+	deflated_length = compressBound(length);
+
+	if((deflated = malloc(deflated_length)) == NULL) {
+
+		perror("Error while allocate zlib buffer:");
+		exit(1);
+	}
+
+	start = now();
+	compress2(deflated, &deflated_length, (unsigned char *)csv, length, 6);
+	compress = now() - start;
+
+	inflated_length = length;
+
+	start = now();
+	uncompress((unsigned char *)csv, &inflated_length, deflated, deflated_length);
+	inflate = now() - start;
+
+	printf("csv:\t\t %9zu bytes, %5.2f bytes/row, format %6.1fM points/s\n",
+			length, (double)length / ROWS, SERIES * (double)ROWS / format / 1e6);
+	printf("csv+zlib -6:\t %9lu bytes, %5.2f bytes/row, deflate %6.1fM points/s on top of formatting\n",
+			(unsigned long)deflated_length, (double)deflated_length / ROWS,
+			SERIES * (double)ROWS / compress / 1e6);
+	printf("\t\t inflate %6.1fM points/s before parsing\n",
+			SERIES * (double)ROWS / inflate / 1e6);
+
+	free(deflated);
+	free(csv);
+}
+
+
+int main(int argc, char **argv) {
+
+	const char *path = "/tmp/tsdb-benchmark.db";
+
+	if(argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+
+		printf(USAGE);
+		return 1;
+	}
+
+	if(argc == 2)
+		path = argv[1];
+
+	generate();
+
+	printf("%d rows of temperature, pressure, humidity and raw UP at 1Hz:\n", ROWS);
+
+	if(benchmark_tsdb(path) > 0) {
+
+		puts("Error: decoded points differ from the input");
+		return 1;
+	}
+
+	benchmark_csv();
+
+	return 0;
+}